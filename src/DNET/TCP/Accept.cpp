@@ -1,5 +1,6 @@
 ﻿#include "Accept.h"
 #include "Poco/Random.h"
+#include <algorithm>
 
 namespace dnet {
 
@@ -11,7 +12,7 @@ Accept::~Accept()
 {
 }
 
-std::string Accept::CreateAcceptString(const std::string& uuidC, const std::string& nameC)
+std::string Accept::CreateAcceptString(const std::string& uuidC, const std::string& nameC, int packet)
 {
 
     Poco::Random rnd;
@@ -19,6 +20,7 @@ std::string Accept::CreateAcceptString(const std::string& uuidC, const std::stri
 
     this->nameC = nameC;
     this->uuidC = uuidC;
+    this->packet = packet;
     this->keyC.clear();
 
     //生成一段16个字节的随机字符串
@@ -43,7 +45,7 @@ bool Accept::VerifyAccept(const std::string& AcceptString)
     return true;
 }
 
-std::string Accept::ReplyAcceptString(const std::string& acceptString, const std::string& uuidS, const std::string& nameS, int conv)
+std::string Accept::ReplyAcceptString(const std::string& acceptString, const std::string& uuidS, const std::string& nameS, int conv, int packet)
 {
     *this = xuexue::json::JsonMapper::toObject<Accept>(acceptString);
     if (this->keyC.empty() || this->uuidC.empty()) {
@@ -54,6 +56,7 @@ std::string Accept::ReplyAcceptString(const std::string& acceptString, const std
     this->nameS = nameS;
     this->uuidS = uuidS;
     this->conv = conv;
+    this->packet = std::min(this->packet, packet); // 双方都支持的协议
     this->keyS.clear();
 
     Poco::Random rnd;
@@ -91,6 +94,7 @@ bool Accept::VerifyReplyAccept(const std::string& replyAcceptString)
         this->nameS = serverDto.nameS;
         this->uuidS = serverDto.uuidS;
         this->conv = serverDto.conv;
+        this->packet = serverDto.packet;
     }
 
     this->_isVerified = isSuccess;
@@ -4,6 +4,12 @@
 #include <memory>
 #include "xuexuejson/JsonMapper.hpp"
 
+// 握手协商的协议:FastPacket
+#define DNET_ACCEPT_PACKET_FAST 0
+
+// 握手协商的协议:CompactPacket
+#define DNET_ACCEPT_PACKET_COMPACT 1
+
 namespace dnet {
 
 /**
@@ -39,7 +45,10 @@ class Accept : XUEXUE_JSON_OBJECT
     // 通信ID
     int conv = -1;
 
-    XUEXUE_JSON_OBJECT_M7(nameC, nameS, keyC, keyS, uuidC, uuidS, conv)
+    // 协商的打包协议.客户端填它支持的协议,服务器端回复双方都支持的协议.老版本没有这个字段,那么就是FastPacket.
+    int packet = DNET_ACCEPT_PACKET_FAST;
+
+    XUEXUE_JSON_OBJECT_M8(nameC, nameS, keyC, keyS, uuidC, uuidS, conv, packet)
 
     // 这个认证是否加密
     bool isEncrypt = false;
@@ -50,12 +59,13 @@ class Accept : XUEXUE_JSON_OBJECT
      * @author daixian
      * @date 2020/12/19
      *
-     * @param  uuidC 客户端的uuid.
-     * @param  nameC 客户端自己的名字.
+     * @param  uuidC  客户端的uuid.
+     * @param  nameC  客户端自己的名字.
+     * @param  packet (Optional) 客户端支持的打包协议.
      *
      * @returns The accept string.
      */
-    std::string CreateAcceptString(const std::string& uuidC, const std::string& nameC);
+    std::string CreateAcceptString(const std::string& uuidC, const std::string& nameC, int packet = DNET_ACCEPT_PACKET_FAST);
 
     /**
      * 对一个随机的认证字符串进行校验.(服务器端调用)
@@ -79,10 +89,11 @@ class Accept : XUEXUE_JSON_OBJECT
      * @param  uuidS        uuid(服务器端).
      * @param  nameS        自己的名字(服务器端).
      * @param  conv         一个用于表示会话编号的整数.
+     * @param  packet       (Optional) 服务器端支持的打包协议,回复的是双方都支持的协议.
      *
      * @returns 如果认证失败返回空字符串.
      */
-    std::string ReplyAcceptString(const std::string& acceptString, const std::string& uuidS, const std::string& nameS, int conv);
+    std::string ReplyAcceptString(const std::string& acceptString, const std::string& uuidS, const std::string& nameS, int conv, int packet = DNET_ACCEPT_PACKET_FAST);
 
     /**
      * 校验服务端的返回,之后使用协商的conv进行连接.
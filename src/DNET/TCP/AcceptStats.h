@@ -0,0 +1,35 @@
+﻿#pragma once
+
+#include <cstdint>
+
+namespace dnet {
+
+/**
+ * TCPServer接受连接的统计.
+ *
+ * @author daixian
+ * @date 2021/3/23
+ */
+class AcceptStats
+{
+  public:
+    AcceptStats() {}
+    ~AcceptStats() {}
+
+    // 启动之后一共accept了的连接数.
+    int64_t acceptedCount = 0;
+
+    // 启动之后一共拒绝了的连接数(accept出错或者超过了TCPOptions::maxConnections).
+    int64_t rejectedCount = 0;
+
+    // 已经accept了但是还没有完成握手的连接数.
+    int pendingCount = 0;
+
+    // 在内核的监听队列里等待accept的连接数,不支持的平台上为-1.
+    int backlogCount = -1;
+
+    // 最近一次执行accept时accept了的连接数.
+    int lastBatchCount = 0;
+};
+
+} // namespace dnet
@@ -0,0 +1,96 @@
+﻿#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "Protocol/FastPacket.h"
+#include "Protocol/CompactPacket.h"
+
+namespace dnet {
+
+/**
+ * 一条要广播的消息打包好的帧(协议头+数据).每种协议只打包一次,得到的是一块不可修改的引用计数的内存,
+ * 所有连接的发送队列都引用同一块内存,所以每多一个接收者只是发送队列里多一个引用,不需要重新打包和拷贝.
+ * 连接握手时协商的协议可能不一样(FastPacket或者CompactPacket),所以两种帧分别在第一次使用的时候打包.
+ * 只在调用广播的线程里使用,数据在这个对象的生命周期内必须有效.
+ *
+ * @author daixian
+ * @date 2021/3/31
+ */
+class BroadcastFrame
+{
+  public:
+    /**
+     * 构造,这里不拷贝数据.
+     *
+     * @param  data 要广播的数据.
+     * @param  len  数据长度.
+     * @param  type 消息类型.
+     */
+    BroadcastFrame(const char* data, size_t len, int type)
+        : data(data), len(len), type(type)
+    {
+    }
+    ~BroadcastFrame() {}
+
+    /**
+     * 得到一种协议打包的帧.
+     *
+     * @param  isCompactPacket 是否是紧凑的协议.
+     *
+     * @returns 打包好的帧,打包失败返回null.
+     */
+    const std::shared_ptr<const std::vector<char>>& Get(bool isCompactPacket)
+    {
+        if (isCompactPacket) {
+            if (compactFrame == nullptr) {
+                CompactPacket packet;
+                compactFrame = Pack(packet);
+            }
+            return compactFrame;
+        }
+        if (fastFrame == nullptr) {
+            FastPacket packet;
+            fastFrame = Pack(packet);
+        }
+        return fastFrame;
+    }
+
+    // 消息类型.
+    int Type() const
+    {
+        return type;
+    }
+
+  private:
+    // 要广播的数据
+    const char* data;
+
+    // 数据长度
+    size_t len;
+
+    // 消息类型
+    int type;
+
+    // FastPacket协议的帧
+    std::shared_ptr<const std::vector<char>> fastFrame;
+
+    // CompactPacket协议的帧
+    std::shared_ptr<const std::vector<char>> compactFrame;
+
+    std::shared_ptr<const std::vector<char>> Pack(IPacket& packet)
+    {
+        char head[DNET_PACKET_MAX_HEAD_LEN];
+        int headLen = packet.PackHead((int)len, type, head, sizeof(head));
+        if (headLen < 0) {
+            return nullptr;
+        }
+        std::shared_ptr<std::vector<char>> frame(new std::vector<char>());
+        frame->reserve(headLen + len);
+        frame->insert(frame->end(), head, head + headLen);
+        frame->insert(frame->end(), data, data + len);
+        return frame;
+    }
+};
+
+} // namespace dnet
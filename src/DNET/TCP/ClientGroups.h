@@ -0,0 +1,199 @@
+﻿#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#include "SlotMap.h"
+
+namespace dnet {
+
+/**
+ * 服务器端的客户端分组(房间,地图区域等).每个组的成员是一个连续的tcpID数组,组发送的时候直接遍历它.
+ * 同时记录每个客户端加入了哪些组,客户端被删除的时候可以直接离开它所有的组.
+ * 组id和tcpID一样是带版本号的,删除了的组的旧id不会找到新的组.只能在应用线程里使用.
+ *
+ * @author daixian
+ * @date 2021/4/1
+ */
+class ClientGroups
+{
+  public:
+    ClientGroups() {}
+    ~ClientGroups() {}
+
+    /**
+     * 创建一个空的组.
+     *
+     * @returns 组id,组的个数达到上限返回-1.
+     */
+    int Create()
+    {
+        return groups.Insert(Group());
+    }
+
+    /**
+     * 删除一个组,它的所有成员离开这个组.
+     *
+     * @param  groupID 组id.
+     *
+     * @returns 组不存在返回false.
+     */
+    bool Remove(int groupID)
+    {
+        Group* group = groups.Get(groupID);
+        if (group == nullptr) {
+            return false;
+        }
+        for (int tcpID : group->members) {
+            EraseClientGroup(tcpID, groupID);
+        }
+        groups.Remove(groupID);
+        return true;
+    }
+
+    /**
+     * 一个客户端加入一个组.
+     *
+     * @param  groupID 组id.
+     * @param  tcpID   客户端的tcpID.
+     *
+     * @returns 组不存在或者已经在这个组里了返回false.
+     */
+    bool Join(int groupID, int tcpID)
+    {
+        Group* group = groups.Get(groupID);
+        if (group == nullptr) {
+            return false;
+        }
+        if (std::find(group->members.begin(), group->members.end(), tcpID) != group->members.end()) {
+            return false;
+        }
+        group->members.push_back(tcpID);
+        clientGroups[tcpID].push_back(groupID);
+        return true;
+    }
+
+    /**
+     * 一个客户端离开一个组.
+     *
+     * @param  groupID 组id.
+     * @param  tcpID   客户端的tcpID.
+     *
+     * @returns 组不存在或者不在这个组里返回false.
+     */
+    bool Leave(int groupID, int tcpID)
+    {
+        Group* group = groups.Get(groupID);
+        if (group == nullptr || !EraseValue(group->members, tcpID)) {
+            return false;
+        }
+        EraseClientGroup(tcpID, groupID);
+        return true;
+    }
+
+    /**
+     * 一个客户端离开它加入的所有组,客户端被删除的时候调用.
+     *
+     * @param  tcpID 客户端的tcpID.
+     */
+    void LeaveAll(int tcpID)
+    {
+        auto itr = clientGroups.find(tcpID);
+        if (itr == clientGroups.end()) {
+            return;
+        }
+        for (int groupID : itr->second) {
+            Group* group = groups.Get(groupID);
+            if (group != nullptr) {
+                EraseValue(group->members, tcpID);
+            }
+        }
+        clientGroups.erase(itr);
+    }
+
+    /**
+     * 一个组的所有成员的tcpID,在修改这个组之前有效.
+     *
+     * @param  groupID 组id.
+     *
+     * @returns 组不存在返回null.
+     */
+    const std::vector<int>* Members(int groupID)
+    {
+        Group* group = groups.Get(groupID);
+        if (group == nullptr) {
+            return nullptr;
+        }
+        return &group->members;
+    }
+
+    /**
+     * 一个客户端加入的所有组的id.
+     *
+     * @param  tcpID 客户端的tcpID.
+     *
+     * @returns 没有加入任何组返回null.
+     */
+    const std::vector<int>* GroupsOf(int tcpID)
+    {
+        auto itr = clientGroups.find(tcpID);
+        if (itr == clientGroups.end()) {
+            return nullptr;
+        }
+        return &itr->second;
+    }
+
+    // 组的个数.
+    size_t Size() const
+    {
+        return groups.Size();
+    }
+
+    // 删除所有的组.
+    void Clear()
+    {
+        groups.Clear();
+        clientGroups.clear();
+    }
+
+  private:
+    struct Group
+    {
+        // 所有成员的tcpID
+        std::vector<int> members;
+    };
+
+    // 所有的组
+    SlotMap<Group> groups;
+
+    // 每个客户端加入了的组
+    std::unordered_map<int, std::vector<int>> clientGroups;
+
+    // 从数组里删除一个值,最后一个值会移动到它的位置
+    static bool EraseValue(std::vector<int>& values, int value)
+    {
+        auto itr = std::find(values.begin(), values.end(), value);
+        if (itr == values.end()) {
+            return false;
+        }
+        *itr = values.back();
+        values.pop_back();
+        return true;
+    }
+
+    // 删除一个客户端加入了一个组的记录
+    void EraseClientGroup(int tcpID, int groupID)
+    {
+        auto itr = clientGroups.find(tcpID);
+        if (itr == clientGroups.end()) {
+            return;
+        }
+        EraseValue(itr->second, groupID);
+        if (itr->second.empty()) {
+            clientGroups.erase(itr);
+        }
+    }
+};
+
+} // namespace dnet
@@ -3,7 +3,11 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <functional>
 #include "TCPClient.h"
+#include "SlotMap.h"
+#include "StringHashMap.h"
+#include "ClientGroups.h"
 
 #include "Poco/Net/StreamSocket.h"
 #include "Poco/Net/DatagramSocket.h"
@@ -11,6 +15,9 @@
 
 #include <mutex>
 
+// 回收的客户端对象最多保留的个数,超过的直接delete
+#define DNET_CLIENT_POOL_MAX_SIZE 1024
+
 namespace dnet {
 
 /**
@@ -24,23 +31,84 @@ class ClientManager
 {
   public:
     ClientManager() {}
-    ~ClientManager() {}
+    ~ClientManager()
+    {
+        ClearPool();
+    }
+
+    // 所有连接了的客户端,tcpID就是它在槽位表里的id.
+    SlotMap<TCPClient*> mClients;
+
+    // 有了uuid返回的及客户端记录,以uuid为key.
+    StringHashMap<TCPClient*> mAcceptClients;
+
+    // 所有正在使用的客户端对象,id就是TCPClient::AcceptID().Poller返回的key在这里找客户端,
+    // 已经删除了的连接的id版本号不一样了,找不到,即使它的客户端对象已经被回收给新的连接使用了.
+    SlotMap<TCPClient*> mLiveClients;
 
-    // 所有连接了的客户端.
-    std::map<int, TCPClient*> mClients;
+    // 回收了的可以重新使用的客户端对象.
+    std::vector<TCPClient*> mClientPool;
 
-    // 有了uuid返回的及客户端记录.
-    std::map<std::string, TCPClient*> mAcceptClients;
+    // 客户端的分组,客户端被删除的时候会离开它所有的组.
+    ClientGroups groups;
+
+    // 服务器的uuid,客户端握手的时候回复给它(TCPServer给它赋值).
+    std::string uuid;
+
+    // 所有客户端的kcp共用的接收buffer,kcp都是在应用线程里接收的.
+    std::vector<char> kcpReceBuf;
 
     // 用户连接成功的事件(TCPServer给它赋值).
     Poco::BasicEvent<TCPEventAccept>* eventAccept = nullptr;
 
+    // 客户端发送队列积压的事件(TCPServer给它赋值).
+    Poco::BasicEvent<TCPEventBackpressure>* eventBackpressure = nullptr;
+
     // tcp监听端口开的同端口UDP，服务器的TCPClient对象中使用了这个来bind发送的upd(TCPServer给它赋值).
     Poco::Net::DatagramSocket* acceptUDPSocket = nullptr;
 
+    // 所有客户端使用的TCP选项(TCPServer给它赋值).
+    TCPOptions options;
+
+    // 所有客户端使用的消息处理函数表.
+    MessageDispatcher dispatcher;
+
+    // delete一个客户端对象之前调用,多线程的TCPServer用它把客户端从IO线程里移除(TCPServer给它赋值).
+    std::function<void(TCPClient*)> onDeleteClient;
+
     // 锁,ClientManager类中和TCPServer类中使用
     //std::mutex mut;
 
+    /**
+     * 记录一个出错了的客户端,TCPServer在应用线程里取走之后开始删除它的计时.
+     * 客户端在IO线程里出错的时候也会调用,所以是加锁的.
+     *
+     * @author daixian
+     * @date 2021/3/30
+     *
+     * @param  tcpID 出错的客户端的tcpID.
+     */
+    void ReportError(int tcpID)
+    {
+        std::lock_guard<std::mutex> lock(errorMut);
+        mErrorIDs.push_back(tcpID);
+    }
+
+    /**
+     * 取走所有出错了的客户端的tcpID.
+     *
+     * @author daixian
+     * @date 2021/3/30
+     *
+     * @param [out] ids 出错了的客户端的tcpID(会先清空).
+     */
+    void TakeErrors(std::vector<int>& ids)
+    {
+        ids.clear();
+        std::lock_guard<std::mutex> lock(errorMut);
+        ids.swap(mErrorIDs);
+    }
+
     /**
      * 服务器添加一个客户端进来记录.
      *
@@ -49,17 +117,51 @@ class ClientManager
      *
      * @param [in] client 要记录的客户端.
      *
-     * @returns 给这个client分配的id号.
+     * @returns 添加的客户端,个数达到上限的时候返回null.
      */
     TCPClient* AddClient(Poco::Net::StreamSocket& client)
     {
-        TCPClient* tcobj = new TCPClient("TCPServer");
-        TCPClient::CreateWithServer(_clientCount, &client, this, *tcobj); //这个函数传入一个tcpID
-        mClients[_clientCount] = tcobj;
-        _clientCount++; //永远递增
+        TCPClient* tcobj = nullptr;
+        if (!mClientPool.empty()) {
+            tcobj = mClientPool.back(); //优先使用回收的对象,它已经Reset()过了
+            mClientPool.pop_back();
+        }
+        else {
+            tcobj = new TCPClient("TCPServer");
+        }
+        int tcpID = mClients.Insert(tcobj); //分配一个带版本号的tcpID,断开了的客户端的旧tcpID不会找到新的客户端
+        int acceptID = tcpID < 0 ? -1 : mLiveClients.Insert(tcobj);
+        if (acceptID < 0) {
+            LogE("ClientManager.AddClient():客户端的个数已经达到了上限!");
+            if (tcpID >= 0) {
+                mClients.Remove(tcpID);
+            }
+            mClientPool.push_back(tcobj);
+            return nullptr;
+        }
+        TCPClient::CreateWithServer(tcpID, acceptID, &client, this, *tcobj); //这个函数传入一个tcpID
         return tcobj;
     }
 
+    /**
+     * 用accept时分配的id得到一个正在使用的客户端.
+     *
+     * @author daixian
+     * @date 2021/3/22
+     *
+     * @param  acceptID TCPClient::AcceptID().
+     *
+     * @returns 这个连接已经被删除了返回null.
+     */
+    TCPClient* GetLiveClient(int acceptID)
+    {
+        TCPClient** client = mLiveClients.Get(acceptID);
+        if (client != nullptr) {
+            return *client;
+        }
+        return nullptr;
+    }
+
     /**
      * 得到一个客户端.
      *
@@ -72,8 +174,9 @@ class ClientManager
      */
     TCPClient* GetClient(int tcpID)
     {
-        if (mClients.find(tcpID) != mClients.end()) {
-            return mClients[tcpID];
+        TCPClient** client = mClients.Get(tcpID);
+        if (client != nullptr) {
+            return *client;
         }
         return nullptr;
     }
@@ -88,18 +191,9 @@ class ClientManager
      */
     void RemoveClient(int tcpID)
     {
-        if (mClients.find(tcpID) != mClients.end()) {
-            TCPClient* ptr = mClients[tcpID];
-            for (auto itr = mAcceptClients.begin(); itr != mAcceptClients.end();) {
-                if (itr->second == ptr) {
-                    itr = mAcceptClients.erase(itr);
-                }
-                else {
-                    itr++;
-                }
-            }
-            mClients.erase(tcpID);
-            delete ptr;
+        TCPClient* ptr = Erase(tcpID);
+        if (ptr != nullptr) {
+            DeleteClient(ptr);
         }
     }
 
@@ -116,29 +210,32 @@ class ClientManager
      */
     int RegisterClientWithUUID(const std::string& uuid, int tempTcpID)
     {
-        TCPClient* client = mClients[tempTcpID];
-        if (mAcceptClients.find(uuid) != mAcceptClients.end()) {
+        TCPClient* client = GetClient(tempTcpID);
+        TCPClient** record = mAcceptClients.Find(uuid);
+        if (record != nullptr) {
 
-            TCPClient* oldclient = mAcceptClients[uuid]; //原先断线的tcp client
+            TCPClient* oldclient = *record; //原先断线的tcp client
             int tcpID = oldclient->TcpID();
 
             client->CopyKCPClient(oldclient); //复制也就是继承kcp部分
 
-            mAcceptClients[uuid] = client;
+            *record = client;
 
-            mClients[tcpID] = client;        //写到原先的位置
-            mClients.erase(client->TcpID()); //移除新的tcpID记录
-            client->SetTcpID(tcpID);
+            if (mClients.Set(tcpID, client)) { //写到原先的位置
+                mClients.Remove(client->TcpID()); //移除新的tcpID记录
+                groups.LeaveAll(client->TcpID()); //新的tcpID不再使用了,分组继承旧的tcpID的
+                client->SetTcpID(tcpID);
+            }
 
-            delete oldclient;
+            DeleteClient(oldclient);
             LogI("ClientManager.RegisterClientWithUUID():找到了之前的记录,断线重连~");
         }
         else {
             //如果找不到以前的记录
-            mAcceptClients[uuid] = client;
+            mAcceptClients.Set(uuid, client);
         }
 
-        LogI("ClientManager.RegisterClientWithUUID():当前的连接的客户端个数%d,其中通过Accept的个数%d", mClients.size(), mAcceptClients.size());
+        LogI("ClientManager.RegisterClientWithUUID():当前的连接的客户端个数%d,其中通过Accept的个数%d", (int)mClients.Size(), (int)mAcceptClients.Size());
 
         //发出事件
         if (eventAccept != nullptr) {
@@ -161,8 +258,9 @@ class ClientManager
      */
     TCPClient* FindClientWithUUID(const std::string& uuid)
     {
-        if (mAcceptClients.find(uuid) != mAcceptClients.end()) {
-            return mAcceptClients[uuid];
+        TCPClient** record = mAcceptClients.Find(uuid);
+        if (record != nullptr) {
+            return *record;
         }
         return nullptr;
     }
@@ -175,19 +273,35 @@ class ClientManager
      *
      * @param  tcpID Identifier for the TCP.
      *
-     * @returns Null if it fails, else a pointer to a TCPClient.
+     * @returns 找不到返回null,否则返回被移除记录的客户端(它还没有被delete).
      */
     TCPClient* Erase(int tcpID)
     {
-        if (mClients.find(tcpID) != mClients.end()) {
-            TCPClient* client = mClients[tcpID];
-            if (client->AcceptData() != nullptr) {
-                std::string uuid = client->AcceptData()->uuidC;
-                if (mAcceptClients.find(uuid) != mAcceptClients.end()) {
-                    mAcceptClients.erase(uuid);
-                }
+        TCPClient* client = GetClient(tcpID);
+        if (client == nullptr) {
+            return nullptr;
+        }
+        EraseAcceptRecord(client);
+        mClients.Remove(tcpID);
+        groups.LeaveAll(tcpID);
+        return client;
+    }
+
+    /**
+     * 如果这个客户端有uuid的记录,那么删除它.
+     *
+     * @author daixian
+     * @date 2021/3/26
+     *
+     * @param [in] client 客户端.
+     */
+    void EraseAcceptRecord(TCPClient* client)
+    {
+        if (client->AcceptData() != nullptr) {
+            TCPClient** record = mAcceptClients.Find(client->AcceptData()->uuidC);
+            if (record != nullptr && *record == client) {
+                mAcceptClients.Erase(client->AcceptData()->uuidC);
             }
-            mClients.erase(tcpID);
         }
     }
 
@@ -201,19 +315,98 @@ class ClientManager
     {
         acceptUDPSocket = nullptr;
 
-        for (auto& kvp : mClients) {
-            delete kvp.second;
+        for (size_t i = 0; i < mClients.Size(); i++) {
+            DeleteClient(mClients.ValueAt(i));
         }
-        mClients.clear();
-        _clientCount = 1;
+        mClients.Clear();
+        mLiveClients.Clear();
 
         //原则上mClients的项应该包含了所有的mAcceptClients里的项,这里就不去再检查了.
-        mAcceptClients.clear();
+        mAcceptClients.Clear();
+        groups.Clear();
+
+        {
+            std::lock_guard<std::mutex> lock(errorMut);
+            mErrorIDs.clear();
+        }
+
+        ClearPool();
+    }
+
+    /**
+     * 回收一个客户端对象,它应该已经从mClients和mAcceptClients中移除了.
+     * 对象会马上关闭并且重置,但是要等两次RecycleClients()之后才重新使用,
+     * 这样IO线程里还在使用这个指针的代码不会碰到新的连接.
+     *
+     * @author daixian
+     * @date 2021/3/22
+     *
+     * @param [in] client 客户端.
+     */
+    void DeleteClient(TCPClient* client)
+    {
+        if (onDeleteClient) {
+            onDeleteClient(client);
+        }
+        mLiveClients.Remove(client->AcceptID());
+        client->Reset();
+        mDeletedClients.push_back(client);
+    }
+
+    /**
+     * 把之前删除的客户端对象放进对象池里,TCPServer大约每秒调用一次.
+     *
+     * @author daixian
+     * @date 2021/3/27
+     */
+    void RecycleClients()
+    {
+        for (TCPClient* client : mCoolingClients) {
+            if (mClientPool.size() < DNET_CLIENT_POOL_MAX_SIZE) {
+                mClientPool.push_back(client);
+            }
+            else {
+                delete client;
+            }
+        }
+        mCoolingClients.clear();
+        mCoolingClients.swap(mDeletedClients);
+    }
+
+    /**
+     * delete所有回收了的客户端对象.
+     *
+     * @author daixian
+     * @date 2021/3/27
+     */
+    void ClearPool()
+    {
+        for (TCPClient* client : mClientPool) {
+            delete client;
+        }
+        for (TCPClient* client : mCoolingClients) {
+            delete client;
+        }
+        for (TCPClient* client : mDeletedClients) {
+            delete client;
+        }
+        mClientPool.clear();
+        mCoolingClients.clear();
+        mDeletedClients.clear();
     }
 
   private:
-    // 用于分配tcpID,id从1开始,0保留
-    int _clientCount = 1;
+    // 刚删除的客户端对象
+    std::vector<TCPClient*> mDeletedClients;
+
+    // 删除了超过一次RecycleClients()的客户端对象,下一次RecycleClients()放进对象池
+    std::vector<TCPClient*> mCoolingClients;
+
+    // 出错了还没有被TCPServer取走的客户端的tcpID
+    std::vector<int> mErrorIDs;
+
+    // mErrorIDs的锁
+    std::mutex errorMut;
 };
 
 } // namespace dxlib
@@ -62,14 +62,12 @@ int kcpc_udp_output(const char* buf, int len, ikcpcb* kcp, void* user)
 
 KCPChannel::KCPChannel()
 {
-    lastReceMsgTime = clock();
-    kcpReceBuf.resize(4 * 1024, 0);
+    lastReceMsgTime = MonotonicClock::Refresh();
 }
 
 KCPChannel::KCPChannel(Poco::Net::DatagramSocket* udpSocket, int conv) : udpSocket(udpSocket)
 {
-    lastReceMsgTime = clock();
-    kcpReceBuf.resize(4 * 1024, 0);
+    lastReceMsgTime = MonotonicClock::Refresh();
     Create(conv);
 }
 
@@ -80,6 +78,39 @@ KCPChannel::~KCPChannel()
     }
 }
 
+void KCPChannel::Reset()
+{
+    if (kcp != nullptr) {
+        ikcp_release(kcp);
+        kcp = nullptr;
+    }
+    delete remote;
+    remote = nullptr;
+    udpSocket = nullptr;
+    sharedReceBuf = nullptr;
+    isServer = false;
+    isCompactPacket = false;
+    kcpViewOffsets.clear();
+    receMsgCount = 0;
+    sendMsgCount = 0;
+    lastReceMsgTime = MonotonicClock::Refresh();
+}
+
+size_t KCPChannel::MemoryUsage()
+{
+    size_t size = sizeof(KCPChannel) + kcpReceBuf.capacity() + kcpViewOffsets.capacity() * sizeof(size_t);
+    if (remote != nullptr) {
+        size += sizeof(Poco::Net::SocketAddress);
+    }
+    if (kcp != nullptr) {
+        // kcp自己的输出buffer是(mtu+24)*3,队列里的每个segment最多一个mss
+        size += sizeof(ikcpcb) + (kcp->mtu + 24) * 3;
+        size += (size_t)(kcp->nsnd_que + kcp->nsnd_buf + kcp->nrcv_que + kcp->nrcv_buf) * (sizeof(IKCPSEG) + kcp->mss);
+        size += (size_t)kcp->ackblock * sizeof(IUINT32) * 2;
+    }
+    return size;
+}
+
 void KCPChannel::Create(int conv)
 {
     if (kcp != nullptr) {
@@ -109,18 +140,35 @@ int KCPChannel::Send(const char* data, size_t len, int type)
         return -1;
     }
 
-    // 数据打包
-    std::vector<char> package;
-    packet.Pack(data, (int)len, package, type);
+    // 只打包协议头,协议头和数据由kcp直接拷贝进segment
+    char head[DNET_PACKET_MAX_HEAD_LEN];
+    int headLen = isCompactPacket ? compactPacket.PackHead((int)len, type, head, sizeof(head))
+                                  : packet.PackHead((int)len, type, head, sizeof(head));
     sendMsgCount++;
 
-    int res = ikcp_send(kcp, package.data(), (int)package.size());
+    int res = ikcp_sendv(kcp, head, headLen, data, (int)len);
     if (res < 0) {
         LogE("KCPChannel.Send():发送异常返回 res=%d", res);
     }
     // ikcp_flush(kcp); // 尝试暴力flush
 
-    ikcp_update(kcp, iclock());
+    ikcp_update(kcp, MonotonicClock::NowMs32());
+    return res;
+}
+
+int KCPChannel::SendFrame(const std::vector<char>& frame)
+{
+    if (udpSocket == nullptr || kcp == nullptr) {
+        LogE("KCPChannel.SendFrame():还没有初始化,不能发送!");
+        return -1;
+    }
+    sendMsgCount++;
+
+    int res = ikcp_send(kcp, frame.data(), (int)frame.size());
+    if (res < 0) {
+        LogE("KCPChannel.SendFrame():发送异常返回 res=%d", res);
+    }
+    ikcp_update(kcp, MonotonicClock::NowMs32());
     return res;
 }
 
@@ -146,16 +194,23 @@ int KCPChannel::IKCPRecv(const char* buff, size_t len, std::vector<TextMessage>&
         else {
             // ikcp_flush(kcp); //尝试暴力flush
 
+            std::vector<char>& receBuf = ReceBuf();
             while (rece >= 0) {
-                rece = ikcp_recv(kcp, kcpReceBuf.data(), (int)kcpReceBuf.size());
+                // 接收缓存放不下一条消息的时候ikcp_recv会返回-3,消息会一直卡在kcp里,所以先扩大缓存
+                // (kcp的分片数上限已经限制了一条消息的长度)
+                int peekSize = ikcp_peeksize(kcp);
+                if (peekSize > (int)receBuf.size()) {
+                    receBuf.resize(peekSize);
+                }
+                rece = ikcp_recv(kcp, receBuf.data(), (int)receBuf.size());
                 if (rece == -3) {
                     LogI("KCPChannel.IKCPRecv():ikcp_recv返回了-3");
                 }
                 if (rece > 0) {
                     // 这里实际上应该只能找到1条消息
                     std::vector<TextMessage> msg1;
-                    receMsgCount += packet.Unpack(kcpReceBuf.data(), rece, msg1);
-                    lastReceMsgTime = clock(); // 记录这个时间
+                    receMsgCount += compactPacket.Unpack(receBuf.data(), rece, msg1);
+                    lastReceMsgTime = MonotonicClock::NowMs(); // 记录这个时间
                     for (size_t i = 0; i < msg1.size(); i++) {
                         msgs.push_back(msg1[i]);
                     }
@@ -166,4 +221,50 @@ int KCPChannel::IKCPRecv(const char* buff, size_t len, std::vector<TextMessage>&
     }
     return msgs.size();
 }
+
+int KCPChannel::IKCPRecv(const char* buff, size_t len, std::vector<MessageView>& msgs)
+{
+    if (kcp == nullptr) {
+        LogE("KCPChannel.IKCPRecv():还没有初始化,不能接收!");
+        return -2;
+    }
+    msgs.clear();
+
+    if (len == -1) {
+        return 0;
+    }
+    if (ikcp_input(kcp, buff, (long)len) != 0) {
+        return -1; // conv不对应或者其它错误
+    }
+
+    // 所有消息依次接收到receBuf里,中途receBuf可能扩大,所以先记录位置,最后再让视图指向它
+    std::vector<char>& receBuf = ReceBuf();
+    size_t used = 0;
+    kcpViewOffsets.clear();
+    while (true) {
+        int peekSize = ikcp_peeksize(kcp);
+        if (peekSize <= 0) {
+            break;
+        }
+        if (used + peekSize > receBuf.size()) {
+            receBuf.resize(used + peekSize);
+        }
+        int rece = ikcp_recv(kcp, receBuf.data() + used, peekSize);
+        if (rece <= 0) {
+            break;
+        }
+        size_t first = msgs.size();
+        compactPacket.UnpackView(receBuf.data() + used, rece, msgs);
+        for (size_t i = first; i < msgs.size(); i++) {
+            kcpViewOffsets.push_back(msgs[i].data - receBuf.data());
+        }
+        receMsgCount += (int)(msgs.size() - first);
+        lastReceMsgTime = MonotonicClock::NowMs(); // 记录这个时间
+        used += rece;
+    }
+    for (size_t i = 0; i < msgs.size(); i++) {
+        msgs[i].data = receBuf.data() + kcpViewOffsets[i];
+    }
+    return (int)msgs.size();
+}
 } // namespace dnet
\ No newline at end of file
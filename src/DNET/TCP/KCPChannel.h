@@ -9,9 +9,10 @@
 #include "Poco/Net/NetException.h"
 
 #include "../kcp/ikcp.h"
-#include "../kcp/clock.hpp"
+#include "MonotonicClock.h"
 
 #include "Protocol/FastPacket.h"
+#include "Protocol/CompactPacket.h"
 #include "dlog/dlog.h"
 
 namespace dnet {
@@ -51,9 +52,15 @@ class KCPChannel
     // kcp对象.一个kcp就是一个信道.
     ikcpcb* kcp = nullptr;
 
-    // kcp协议接收数据buffer.
+    // kcp协议接收数据buffer,第一次接收的时候才分配.
     std::vector<char> kcpReceBuf;
 
+    // 共用的接收buffer,服务器端的所有kcp都在应用线程里接收,共用ClientManager里的一个.为null的时候使用kcpReceBuf.
+    std::vector<char>* sharedReceBuf = nullptr;
+
+    // 接收消息视图的时候每条消息在kcpReceBuf里的位置
+    std::vector<size_t> kcpViewOffsets;
+
     // 接收到的待处理的数据.
     // std::vector<std::string> receData;
 
@@ -63,12 +70,18 @@ class KCPChannel
     // 所有发送的消息的总条数
     int sendMsgCount = 0;
 
-    // 上一次收到消息的时间
-    clock_t lastReceMsgTime;
+    // 上一次收到消息的时间(MonotonicClock的毫秒数)
+    int64_t lastReceMsgTime;
 
     // TCP通信协议(这里先临时也使用这个,主要是要打进去一个msg type,好和tcp端一致)
     FastPacket packet;
 
+    // 紧凑的通信协议,接收时总是使用它来解包(它兼容FastPacket的帧)
+    CompactPacket compactPacket;
+
+    // TCP握手协商之后发送是否使用紧凑的协议
+    bool isCompactPacket = false;
+
     /**
      * kcp的id.
      *
@@ -93,6 +106,26 @@ class KCPChannel
      */
     void Create(int conv);
 
+    /**
+     * 这个kcp当前占用的内存(估计值).
+     */
+    size_t MemoryUsage();
+
+    // 得到接收用的buffer
+    std::vector<char>& ReceBuf()
+    {
+        std::vector<char>& buf = sharedReceBuf != nullptr ? *sharedReceBuf : kcpReceBuf;
+        if (buf.empty()) {
+            buf.resize(4 * 1024, 0);
+        }
+        return buf;
+    }
+
+    /**
+     * 释放kcp协议并且重置状态,保留接收buffer(回收TCPClient的时候使用).
+     */
+    void Reset();
+
     /**
      * 绑定一个和TCP一致的UDP端口，当tcp断线重连之后需要重新绑定这个UDP端口.因此这个对象不做UDP端口生命周期的管理.
      *
@@ -132,6 +165,18 @@ class KCPChannel
      */
     int IKCPRecv(const char* buff, size_t len, std::vector<TextMessage>& msgs);
 
+    /**
+     * (内部调用)和上面的一样,但是得到的是消息视图,不为每条消息分配内存.
+     * 消息视图指向接收buffer,在这个信道下一次接收之前有效(使用共用的buffer的时候是在任意一个共用它的信道下一次接收之前).
+     *
+     * @param       buff Socket接收的结果.
+     * @param       len  Socket接收到的数据长度.
+     * @param [out] msgs 消息视图.
+     *
+     * @returns 返回大于0的实际接收到的消息条数.
+     */
+    int IKCPRecv(const char* buff, size_t len, std::vector<MessageView>& msgs);
+
     /**
      * 使用UDPSocket非阻塞的发送一段数据.正常发送成功返回0.
      *
@@ -145,6 +190,18 @@ class KCPChannel
      */
     int Send(const char* data, size_t len, int type = -1);
 
+    /**
+     * 发送一条已经打包好了协议头的帧(广播的时候所有信道共用一个帧,不需要每个信道都打包一次).
+     *
+     * @author daixian
+     * @date 2021/3/31
+     *
+     * @param  frame 打包好的帧.
+     *
+     * @returns 成功返回0,失败返回负数.
+     */
+    int SendFrame(const std::vector<char>& frame);
+
     /**
      * 提供出来让他们可以无脑Update
      *
@@ -157,7 +214,7 @@ class KCPChannel
             LogE("KCPChannel.Update():还没有初始化,不能发送!");
             return;
         }
-        ikcp_update(kcp, iclock());
+        ikcp_update(kcp, MonotonicClock::NowMs32());
     }
 
     /**
@@ -198,7 +255,7 @@ class KCPChannel
      */
     float LastReceMessageTimeToNow()
     {
-        return (clock() - lastReceMsgTime) / (float)(CLOCKS_PER_SEC);
+        return (MonotonicClock::NowMs() - lastReceMsgTime) / 1000.0f;
     }
 
   private:
@@ -0,0 +1,33 @@
+﻿#pragma once
+
+namespace dnet {
+
+/**
+ * KCPServer的UDP socket的选项.
+ *
+ * @author daixian
+ * @date 2021/3/29
+ */
+class KCPOptions
+{
+  public:
+    KCPOptions() {}
+    ~KCPOptions() {}
+
+    // udp socket的内核接收缓存大小(SO_RCVBUF).为0表示不设置,使用系统的默认值.信道很多的时候应该调大它,防止突发的包被丢弃.
+    int socketReceiveBufferSize = 0;
+
+    // udp socket的内核发送缓存大小(SO_SNDBUF).为0表示不设置,使用系统的默认值.
+    int socketSendBufferSize = 0;
+
+    // 用户态的接收缓存大小,要能放下一个udp包.
+    int receiveBufferSize = 4 * 1024;
+
+    // udp socket的接收超时毫秒数(SO_RCVTIMEO),只对阻塞的操作有效.
+    int receiveTimeoutMs = 3;
+
+    // udp socket的发送超时毫秒数(SO_SNDTIMEO),只对阻塞的操作有效.
+    int sendTimeoutMs = 3;
+};
+
+} // namespace dnet
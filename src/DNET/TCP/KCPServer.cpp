@@ -4,7 +4,7 @@ namespace dnet {
 
 KCPServer::KCPServer(const std::string& name) : name(name)
 {
-    socketRecebuff.resize(4 * 1024, 0);
+    socketRecebuff.resize(options.receiveBufferSize, 0);
 }
 
 KCPServer::~KCPServer()
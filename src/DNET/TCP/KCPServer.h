@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include "KCPChannel.h"
+#include "KCPOptions.h"
 #include <deque>
 namespace dnet {
 
@@ -32,8 +33,7 @@ class KCPServer
         try {
             Poco::Net::SocketAddress sa(Poco::Net::IPAddress("0.0.0.0"), port);
             udpSocket = new Poco::Net::DatagramSocket(sa);
-            udpSocket->setReceiveTimeout(Poco::Timespan(3000));
-            udpSocket->setSendTimeout(Poco::Timespan(3000));
+            ApplyOptions();
             udpSocket->setBlocking(false);
 
             // 重新赋值
@@ -124,6 +124,7 @@ class KCPServer
     int ReceMessage(bool update = true)
     {
         int receCount = 0;
+        MonotonicClock::Refresh(); // 这一轮的update和接收时间都使用这个时间
         try {
             if (update) {
                 Update();
@@ -220,12 +221,66 @@ class KCPServer
         }
     }
 
+    /**
+     * 设置选项,如果已经启动了那么立即应用到socket上.
+     *
+     * @author daixian
+     * @date 2021/3/29
+     *
+     * @param  options 选项.
+     */
+    void SetOptions(const KCPOptions& options)
+    {
+        this->options = options;
+        socketRecebuff.resize(options.receiveBufferSize > 0 ? options.receiveBufferSize : 4 * 1024, 0);
+        if (udpSocket != nullptr) {
+            ApplyOptions();
+        }
+    }
+
+    /**
+     * 当前的选项.
+     *
+     * @author daixian
+     * @date 2021/3/29
+     *
+     * @returns 选项.
+     */
+    const KCPOptions& Options()
+    {
+        return options;
+    }
+
   private:
     // 自己的UDPSocket,所有的client都用的是这个
     Poco::Net::DatagramSocket* udpSocket = nullptr;
 
     // Socket接收用的buffer
     std::vector<char> socketRecebuff;
+
+    // 选项
+    KCPOptions options;
+
+    // 把选项应用到udpSocket上
+    void ApplyOptions()
+    {
+        try {
+            if (options.socketReceiveBufferSize > 0) {
+                udpSocket->setReceiveBufferSize(options.socketReceiveBufferSize);
+            }
+            if (options.socketSendBufferSize > 0) {
+                udpSocket->setSendBufferSize(options.socketSendBufferSize);
+            }
+            udpSocket->setReceiveTimeout(Poco::Timespan(options.receiveTimeoutMs / 1000, (options.receiveTimeoutMs % 1000) * 1000));
+            udpSocket->setSendTimeout(Poco::Timespan(options.sendTimeoutMs / 1000, (options.sendTimeoutMs % 1000) * 1000));
+        }
+        catch (const Poco::Exception& e) {
+            LogE("KCPServer.ApplyOptions():异常e=%s,%s", e.what(), e.message().c_str());
+        }
+        catch (const std::exception& e) {
+            LogE("KCPServer.ApplyOptions():异常e=%s", e.what());
+        }
+    }
 };
 
 } // namespace dnet
\ No newline at end of file
@@ -0,0 +1,145 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace dnet {
+
+/**
+ * 无锁的多生产者单消费者队列(Vyukov的侵入式链表队列).
+ * 任意线程都可以Push(),入队只是一次原子交换,不会等待其它线程(wait-free).
+ * 但是每次Push()都要new一个节点,所以生产者实际上只和内存分配器一样不用等待,分配器加锁的时候也会等.
+ * 只能有一个线程Pop(),一个生产者正在Push()的中间的时候它后面的数据暂时取不出来,下一次Pop()再取.
+ *
+ * @author daixian
+ * @date 2021/4/2
+ *
+ * @tparam T 值的类型,需要可以默认构造.
+ */
+template <class T>
+class MPSCQueue
+{
+  public:
+    MPSCQueue()
+        : head(&stub), tail(&stub)
+    {
+        stub.next.store(nullptr, std::memory_order_relaxed);
+    }
+
+    // 析构的时候不能再有生产者
+    ~MPSCQueue()
+    {
+        Clear();
+        Node* node = tail;
+        while (node != nullptr) {
+            Node* next = node->next.load(std::memory_order_relaxed);
+            if (node != &stub) {
+                delete node;
+            }
+            node = next;
+        }
+    }
+
+    /**
+     * 添加一个值,任意线程都可以调用.
+     *
+     * @param  value 值.
+     *
+     * @returns 添加之前队列里的个数(估计值),为0说明消费者可能需要唤醒.
+     */
+    size_t Push(T&& value)
+    {
+        Node* node = new Node();
+        node->value = std::move(value);
+        size_t prevCount = count.fetch_add(1, std::memory_order_relaxed);
+        PushNode(node);
+        return prevCount;
+    }
+
+    /**
+     * 取出一个值,只能在消费者线程里调用.
+     *
+     * @param [out] value 取出的值.
+     *
+     * @returns 队列为空(或者生产者还没有添加完)返回false.
+     */
+    bool Pop(T& value)
+    {
+        Node* first = tail;
+        Node* next = first->next.load(std::memory_order_acquire);
+        if (first == &stub) {
+            if (next == nullptr) {
+                return false;
+            }
+            // 跳过占位的节点
+            tail = next;
+            first = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next == nullptr) {
+            if (first != head.load(std::memory_order_acquire)) {
+                return false; // 有生产者正在添加
+            }
+            // first是最后一个节点,放回占位的节点之后才能取走它
+            PushNode(&stub);
+            next = first->next.load(std::memory_order_acquire);
+            if (next == nullptr) {
+                return false;
+            }
+        }
+        tail = next;
+        value = std::move(first->value);
+        delete first;
+        count.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * 队列里的个数(估计值),任意线程都可以调用,用于监控.
+     *
+     * @returns 个数.
+     */
+    size_t Size() const
+    {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * 丢弃队列里所有的值,只能在消费者线程里调用.
+     */
+    void Clear()
+    {
+        T value;
+        while (Pop(value)) {
+        }
+    }
+
+  private:
+    struct Node
+    {
+        std::atomic<Node*> next{nullptr};
+        T value;
+    };
+
+    // 最后添加的节点,生产者在这里添加
+    std::atomic<Node*> head;
+
+    // 第一个节点,消费者从这里取
+    Node* tail;
+
+    // 占位的节点,队列里总有一个节点
+    Node stub;
+
+    // 队列里的个数
+    std::atomic<size_t> count{0};
+
+    void PushNode(Node* node)
+    {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node* prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+};
+
+} // namespace dnet
@@ -0,0 +1,152 @@
+﻿#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+#include "Protocol/Message.hpp"
+
+// 内部命令(认证等)的消息类型,用户不能使用
+#define XUEXUE_TCP_CLIENT_INTERNAL_CMD_TYPE -1024
+
+// 使用数组直接索引的消息类型范围是[0,DNET_DISPATCH_FLAT_SIZE),其它的类型使用hash表
+#define DNET_DISPATCH_FLAT_SIZE 256
+
+namespace dnet {
+
+/**
+ * 消息处理函数.
+ * 参数为消息来自的tcpID和消息视图,消息视图只在这次调用中有效.
+ */
+typedef std::function<void(int tcpID, const MessageView& msg)> MessageHandler;
+
+/**
+ * 按消息类型分发消息的处理函数表.
+ * 小的非负的类型直接使用数组索引,其它的类型使用hash表,查找都是O(1)的.
+ *
+ * @author daixian
+ * @date 2021/3/20
+ */
+class MessageDispatcher
+{
+  public:
+    MessageDispatcher() {}
+    ~MessageDispatcher() {}
+
+    /**
+     * 注册一个消息类型的处理函数,已经有的会被替换.不能在处理函数里面修改处理函数表.
+     *
+     * @author daixian
+     * @date 2021/3/20
+     *
+     * @param  type    消息类型.
+     * @param  handler 处理函数.
+     */
+    void Register(int type, const MessageHandler& handler)
+    {
+        if (!handler) {
+            Unregister(type);
+            return;
+        }
+        if (type >= 0 && type < DNET_DISPATCH_FLAT_SIZE) {
+            if (flatHandlers.empty()) {
+                flatHandlers.resize(DNET_DISPATCH_FLAT_SIZE);
+            }
+            if (!flatHandlers[type]) {
+                count++;
+            }
+            flatHandlers[type] = handler;
+        }
+        else {
+            if (hashHandlers.find(type) == hashHandlers.end()) {
+                count++;
+            }
+            hashHandlers[type] = handler;
+        }
+    }
+
+    /**
+     * 移除一个消息类型的处理函数.
+     *
+     * @author daixian
+     * @date 2021/3/20
+     *
+     * @param  type 消息类型.
+     */
+    void Unregister(int type)
+    {
+        if (type >= 0 && type < DNET_DISPATCH_FLAT_SIZE) {
+            if (!flatHandlers.empty() && flatHandlers[type]) {
+                flatHandlers[type] = nullptr;
+                count--;
+            }
+        }
+        else {
+            count -= (int)hashHandlers.erase(type);
+        }
+    }
+
+    /**
+     * 如果这条消息的类型有处理函数,那么调用它.
+     *
+     * @author daixian
+     * @date 2021/3/20
+     *
+     * @param  tcpID 消息来自的tcpID.
+     * @param  msg   消息.
+     *
+     * @returns 有处理函数处理了这条消息返回true.
+     */
+    bool Dispatch(int tcpID, const MessageView& msg)
+    {
+        if (count == 0) {
+            return false;
+        }
+        const MessageHandler* handler = Find(msg.type);
+        if (handler == nullptr) {
+            return false;
+        }
+        (*handler)(tcpID, msg);
+        return true;
+    }
+
+    /**
+     * 当前注册的处理函数个数.
+     *
+     * @author daixian
+     * @date 2021/3/20
+     *
+     * @returns 个数.
+     */
+    int Count()
+    {
+        return count;
+    }
+
+  private:
+    // 小的非负类型的处理函数,使用类型直接索引
+    std::vector<MessageHandler> flatHandlers;
+
+    // 其它类型的处理函数
+    std::unordered_map<int, MessageHandler> hashHandlers;
+
+    // 注册的处理函数个数
+    int count = 0;
+
+    const MessageHandler* Find(int type)
+    {
+        if (type >= 0 && type < DNET_DISPATCH_FLAT_SIZE) {
+            if (flatHandlers.empty() || !flatHandlers[type]) {
+                return nullptr;
+            }
+            return &flatHandlers[type];
+        }
+        auto itr = hashHandlers.find(type);
+        if (itr == hashHandlers.end()) {
+            return nullptr;
+        }
+        return &itr->second;
+    }
+};
+
+} // namespace dnet
@@ -0,0 +1,83 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#if !defined(_WIN32)
+#    include <time.h>
+#endif
+
+namespace dnet {
+
+/**
+ * 缓存的单调时钟,单位毫秒.每一轮循环开始的时候Refresh()一次读取系统的单调时钟(CLOCK_MONOTONIC),
+ * 这一轮里的接收时间,错误时间,心跳和kcp的update都只读缓存的值,不需要每条消息都调用一次系统时钟.
+ * 多个线程都可以Refresh(),缓存的值只会增加.
+ *
+ * @author daixian
+ * @date 2021/3/31
+ */
+class MonotonicClock
+{
+  public:
+    /**
+     * 读取系统的单调时钟并且更新缓存.
+     *
+     * @returns 当前的毫秒数.
+     */
+    static int64_t Refresh()
+    {
+        int64_t now = ReadMs();
+        std::atomic<int64_t>& cached = Cached();
+        int64_t old = cached.load(std::memory_order_relaxed);
+        while (old < now && !cached.compare_exchange_weak(old, now, std::memory_order_relaxed)) {
+        }
+        return old > now ? old : now;
+    }
+
+    /**
+     * 缓存的毫秒数,是最近一次Refresh()的时间.
+     *
+     * @returns 毫秒数.
+     */
+    static int64_t NowMs()
+    {
+        return Cached().load(std::memory_order_relaxed);
+    }
+
+    /**
+     * 缓存的毫秒数的低32位,给ikcp_update()使用.
+     *
+     * @returns 毫秒数.
+     */
+    static uint32_t NowMs32()
+    {
+        return (uint32_t)(NowMs() & 0xfffffffful);
+    }
+
+    /**
+     * 直接读取系统的单调时钟,不更新缓存.
+     *
+     * @returns 毫秒数.
+     */
+    static int64_t ReadMs()
+    {
+#if defined(_WIN32)
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+    }
+
+  private:
+    static std::atomic<int64_t>& Cached()
+    {
+        static std::atomic<int64_t> cached(ReadMs());
+        return cached;
+    }
+};
+
+} // namespace dnet
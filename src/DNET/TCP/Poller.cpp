@@ -0,0 +1,164 @@
+﻿#include "Poller.h"
+
+#include "Poco/Net/SocketImpl.h"
+#include "dlog/dlog.h"
+
+#if defined(__linux__)
+#    include <sys/epoll.h>
+#    include <sys/eventfd.h>
+#    include <unistd.h>
+#    include <errno.h>
+#endif
+
+// 一次Wait()初始最多取得的就绪socket个数,取满了会自动扩大
+#define DNET_POLLER_EVENTS_SIZE 256
+
+// Wakeup()使用的eventfd的key
+#define DNET_POLLER_WAKEUP_KEY UINT64_MAX
+
+namespace dnet {
+
+class Poller::Impl
+{
+  public:
+    Impl()
+    {
+#if defined(__linux__)
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd < 0) {
+            LogE("Poller.Impl():epoll_create1失败,errno=%d", errno);
+        }
+        events.resize(DNET_POLLER_EVENTS_SIZE);
+
+        // 用于Wakeup()的eventfd
+        wakeupfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epfd >= 0 && wakeupfd >= 0) {
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.u64 = DNET_POLLER_WAKEUP_KEY;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, wakeupfd, &ev);
+        }
+#endif
+    }
+
+    ~Impl()
+    {
+#if defined(__linux__)
+        if (epfd >= 0) {
+            close(epfd);
+            epfd = -1;
+        }
+        if (wakeupfd >= 0) {
+            close(wakeupfd);
+            wakeupfd = -1;
+        }
+#endif
+    }
+
+#if defined(__linux__)
+    // epoll的文件描述符
+    int epfd = -1;
+
+    // 唤醒用的eventfd
+    int wakeupfd = -1;
+
+    // epoll_wait的结果
+    std::vector<struct epoll_event> events;
+#endif
+};
+
+Poller::Poller()
+{
+    _impl = std::shared_ptr<Impl>(new Impl());
+}
+
+Poller::~Poller()
+{
+}
+
+bool Poller::IsValid()
+{
+#if defined(__linux__)
+    return _impl->epfd >= 0;
+#else
+    return false;
+#endif
+}
+
+bool Poller::Add(const Poco::Net::Socket& socket, uint64_t key)
+{
+#if defined(__linux__)
+    if (_impl->epfd < 0) {
+        return false;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP; // EPOLLERR和EPOLLHUP总是会通知
+    ev.data.u64 = key;
+    if (epoll_ctl(_impl->epfd, EPOLL_CTL_ADD, socket.impl()->sockfd(), &ev) != 0) {
+        LogE("Poller.Add():epoll_ctl失败,errno=%d", errno);
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Poller::Remove(const Poco::Net::Socket& socket)
+{
+#if defined(__linux__)
+    if (_impl->epfd < 0) {
+        return;
+    }
+    struct epoll_event ev; // 老的内核要求不为null
+    epoll_ctl(_impl->epfd, EPOLL_CTL_DEL, socket.impl()->sockfd(), &ev);
+#endif
+}
+
+int Poller::Wait(std::vector<uint64_t>& readyKeys, int timeoutMs)
+{
+    readyKeys.clear();
+#if defined(__linux__)
+    if (_impl->epfd < 0) {
+        return -1;
+    }
+    int n = epoll_wait(_impl->epfd, _impl->events.data(), (int)_impl->events.size(), timeoutMs);
+    if (n < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        LogE("Poller.Wait():epoll_wait失败,errno=%d", errno);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        uint64_t key = _impl->events[i].data.u64;
+        if (key == DNET_POLLER_WAKEUP_KEY) {
+            uint64_t value;
+            if (read(_impl->wakeupfd, &value, sizeof(value)) < 0) { // 清掉唤醒的计数
+            }
+            continue;
+        }
+        readyKeys.push_back(key);
+    }
+    if (n == (int)_impl->events.size()) {
+        _impl->events.resize(_impl->events.size() * 2); // 取满了,下次多取一些
+    }
+    return (int)readyKeys.size();
+#else
+    return -1;
+#endif
+}
+
+void Poller::Wakeup()
+{
+#if defined(__linux__)
+    if (_impl->wakeupfd < 0) {
+        return;
+    }
+    uint64_t value = 1;
+    if (write(_impl->wakeupfd, &value, sizeof(value)) < 0) { // 计数溢出的时候也已经是可读的了
+    }
+#endif
+}
+
+} // namespace dnet
@@ -0,0 +1,85 @@
+﻿#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "Poco/Net/Socket.h"
+
+namespace dnet {
+
+/**
+ * socket的就绪通知.linux上使用epoll(水平触发),只返回有数据可读或者出错了的socket,
+ * 其它平台上IsValid()返回false,使用者需要自己轮询所有的socket.
+ *
+ * @author daixian
+ * @date 2021/3/21
+ */
+class Poller
+{
+  public:
+    Poller();
+    ~Poller();
+
+    /**
+     * 当前平台是否支持就绪通知.
+     *
+     * @author daixian
+     * @date 2021/3/21
+     *
+     * @returns 支持返回true.
+     */
+    bool IsValid();
+
+    /**
+     * 添加一个socket,它可读或者出错的时候Wait()会返回key.
+     * socket关闭之后会自动从里面移除.key使用一个不会被重新使用的id(比如带版本号的tcpID),
+     * 这样在Wait()返回之后这个socket被移除了的时候,key不会被当成是另外一个socket的.
+     *
+     * @author daixian
+     * @date 2021/3/21
+     *
+     * @param  socket The socket.
+     * @param  key    Wait()返回的这个socket的标识,不能是UINT64_MAX(Wakeup()使用).
+     *
+     * @returns 成功返回true.
+     */
+    bool Add(const Poco::Net::Socket& socket, uint64_t key);
+
+    /**
+     * 移除一个socket.
+     *
+     * @author daixian
+     * @date 2021/3/21
+     *
+     * @param  socket The socket.
+     */
+    void Remove(const Poco::Net::Socket& socket);
+
+    /**
+     * 等待socket就绪.
+     *
+     * @author daixian
+     * @date 2021/3/21
+     *
+     * @param [out] readyKeys 就绪了的socket的key.
+     * @param       timeoutMs 最多等待的毫秒数,为0则立即返回,为-1则一直等待.
+     *
+     * @returns 就绪了的socket个数,出错返回-1.
+     */
+    int Wait(std::vector<uint64_t>& readyKeys, int timeoutMs);
+
+    /**
+     * 从其它线程唤醒正在Wait()的线程,Wait()会立即返回(可能不带任何key).
+     *
+     * @author daixian
+     * @date 2021/3/22
+     */
+    void Wakeup();
+
+  private:
+    class Impl;
+    std::shared_ptr<Impl> _impl;
+};
+
+} // namespace dnet
@@ -0,0 +1,42 @@
+﻿#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "MPSCQueue.h"
+
+namespace dnet {
+
+/**
+ * 其它线程投递过来等待网络线程发送的一条消息.
+ * 投递的时候要拷贝一次数据,和队列节点一样都要分配内存,所以投递的开销主要是内存分配.
+ *
+ * @author daixian
+ * @date 2021/4/2
+ */
+struct PostedMessage
+{
+    PostedMessage() {}
+
+    PostedMessage(int tcpID, const char* data, size_t len, int type, bool isKCP)
+        : tcpID(tcpID), type(type), isKCP(isKCP), data(data, data + len)
+    {
+    }
+
+    // 发送给的客户端,TCPClient自己的队列里不使用.
+    int tcpID = -1;
+
+    // 消息类型.
+    int type = -1;
+
+    // 是否走kcp通道.
+    bool isKCP = false;
+
+    // 数据(拷贝).
+    std::vector<char> data;
+};
+
+// 投递消息的队列,任意线程投递,网络线程取出来发送.
+typedef MPSCQueue<PostedMessage> PostQueue;
+
+} // namespace dnet
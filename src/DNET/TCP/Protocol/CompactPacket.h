@@ -0,0 +1,157 @@
+﻿#pragma once
+
+#include <cstring>
+#include <cstdint>
+#include "Packet.hpp"
+#include "FastPacket.h"
+
+// 紧凑协议头的标记字节
+#define DNET_COMPACT_PACKET_TAG 'z'
+
+// 紧凑协议头的最大长度:标记 + varint数据长度(最多5字节) + varint数据类型(最多5字节)
+#define DNET_COMPACT_PACKET_MAX_HEAD_LEN 11
+
+namespace dnet {
+
+/**
+ * 紧凑的协议头,为一个标记字节 + varint的数据长度 + zigzag的varint数据类型.
+ * 小消息的协议头只有3个字节(FastPacket是9个字节),所有字段都是按字节小端写入的.
+ * 解包时同时兼容FastPacket的帧,所以握手协商之后在连接中途切换协议不会丢失数据.
+ *
+ * @author daixian
+ * @date 2021/3/18
+ */
+class CompactPacketFormat
+{
+  public:
+    // 协议头的最大长度
+    static const int MAX_HEAD_LEN = DNET_COMPACT_PACKET_MAX_HEAD_LEN;
+
+    // 协议头的长度
+    static int HeadLength(int len, int type)
+    {
+        return 1 + VarintLength((uint32_t)len) + VarintLength(ZigZag(type));
+    }
+
+    // 写协议头,buffer的长度至少为HeadLength()
+    static int WriteHead(int len, int type, char* buffer)
+    {
+        int headLen = 0;
+        buffer[headLen++] = DNET_COMPACT_PACKET_TAG;
+        headLen += WriteVarint((uint32_t)len, buffer + headLen);
+        headLen += WriteVarint(ZigZag(type), buffer + headLen);
+        return headLen;
+    }
+
+    /**
+     * 解析一个协议头,'x'开头的按FastPacket的协议头解析.
+     *
+     * @author daixian
+     * @date 2021/3/18
+     *
+     * @param       buff  协议头开始的位置.
+     * @param       count 数据长度.
+     * @param [out] len   数据长度.
+     * @param [out] type  数据类型.
+     *
+     * @returns 协议头的长度,协议头还不完整返回0,不是合法的协议头返回-1.
+     */
+    static int DecodeHead(const char* buff, int count, int& len, int& type)
+    {
+        if (count < 1) {
+            return 0;
+        }
+        if (buff[0] == 'x') {
+            return FastPacketFormat::DecodeHead(buff, count, len, type);
+        }
+        if (buff[0] != DNET_COMPACT_PACKET_TAG) {
+            return -1;
+        }
+        uint32_t ulen;
+        uint32_t utype;
+        int lenBytes = ReadVarint(buff + 1, count - 1, ulen);
+        if (lenBytes <= 0) {
+            return lenBytes;
+        }
+        int typeBytes = ReadVarint(buff + 1 + lenBytes, count - 1 - lenBytes, utype);
+        if (typeBytes <= 0) {
+            return typeBytes;
+        }
+        if (ulen > (uint32_t)INT32_MAX) {
+            return -1;
+        }
+        len = (int)ulen;
+        type = UnZigZag(utype);
+        return 1 + lenBytes + typeBytes;
+    }
+
+    // 找到下一个可能是协议头的位置(兼容FastPacket的'x')
+    static const char* FindHead(const char* begin, const char* end)
+    {
+        for (const char* p = begin; p < end; p++) {
+            if (*p == DNET_COMPACT_PACKET_TAG || *p == 'x') {
+                return p;
+            }
+        }
+        return nullptr;
+    }
+
+  private:
+    // 有符号的类型映射成无符号数,让小的负数也只占很少的字节
+    static uint32_t ZigZag(int value)
+    {
+        return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    }
+
+    static int UnZigZag(uint32_t value)
+    {
+        return (int)(value >> 1) ^ -(int)(value & 1);
+    }
+
+    static int VarintLength(uint32_t value)
+    {
+        int n = 1;
+        while (value >= 0x80) {
+            value >>= 7;
+            n++;
+        }
+        return n;
+    }
+
+    // 每个字节低7位是数据,最高位表示后面还有字节.返回写入的字节数
+    static int WriteVarint(uint32_t value, char* buffer)
+    {
+        int n = 0;
+        while (value >= 0x80) {
+            buffer[n++] = (char)(value | 0x80);
+            value >>= 7;
+        }
+        buffer[n++] = (char)value;
+        return n;
+    }
+
+    // 返回读取的字节数,数据不完整返回0,非法返回-1
+    static int ReadVarint(const char* buffer, int count, uint32_t& value)
+    {
+        value = 0;
+        for (int i = 0; i < 5; i++) {
+            if (i >= count) {
+                return 0;
+            }
+            uint8_t b = (uint8_t)buffer[i];
+            if (i == 4 && b > 0x0f) {
+                return -1; // 超过了32位
+            }
+            value |= (uint32_t)(b & 0x7f) << (7 * i);
+            if ((b & 0x80) == 0) {
+                return i + 1;
+            }
+        }
+        return -1;
+    }
+};
+
+// 紧凑协议头的协议.
+typedef Packet<CompactPacketFormat> CompactPacket;
+
+} // namespace dnet
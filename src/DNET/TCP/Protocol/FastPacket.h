@@ -1,6 +1,10 @@
 ﻿#pragma once
 
-#include "IPacket.h"
+#include <cstring>
+#include "Packet.hpp"
+
+// 协议头的长度:'x' + int数据长度 + int数据类型
+#define DNET_FAST_PACKET_HEAD_LEN 9
 
 namespace dnet {
 
@@ -10,352 +14,67 @@ namespace dnet {
  * @author daixian
  * @date 2020/12/21
  */
-class FastPacket : public IPacket
+class FastPacketFormat
 {
   public:
-    FastPacket() {}
-    virtual ~FastPacket() {}
+    // 协议头的最大长度
+    static const int MAX_HEAD_LEN = DNET_FAST_PACKET_HEAD_LEN;
 
-    /**
-     * Packs
-     *
-     * @author daixian
-     * @date 2020/12/21
-     *
-     * @param       data   要打包的原始数据.
-     * @param       len    The length.
-     * @param [out] result The result.
-     * @param       type   (Optional) 数据类型(如可以分成命令和用户数据两种).
-     *
-     * @returns 打包结果长度.
-     */
-    virtual int Pack(const char* data, int len, std::vector<char>& result, int type) override
+    // 协议头的长度,是固定的(参数只是为了和CompactPacketFormat的接口一致)
+    static int HeadLength(int /*len*/, int /*type*/)
     {
-        result.resize(sizeof(int) + sizeof(int) + 1 + (size_t)len);
-        //协议头
-        result[0] = 'x';
-        //协议数据长
-        int* ptr = (int*)(&result[1]);
-        *ptr = len; //写数据长度
-        ptr++;
-        *ptr = type; //写数据类型
-        ptr++;
-        //数据内容
-        memcpy(ptr, data, len);
-        return (int)result.size();
+        return DNET_FAST_PACKET_HEAD_LEN;
     }
 
-    /**
-     * Packs
-     *
-     * @author daixian
-     * @date 2020/12/21
-     *
-     * @param       data   要打包的原始数据.
-     * @param       len    原始数据长度.
-     * @param [out] result The result.
-     * @param       type   (Optional) The type.
-     *
-     * @returns 打包结果长度.
-     */
-    virtual int Pack(const char* data, int len, std::string& result, int type) override
+    // 写协议头,buffer的长度至少为DNET_FAST_PACKET_HEAD_LEN
+    static int WriteHead(int len, int type, char* buffer)
     {
-        result.resize(sizeof(int) + sizeof(int) + 1 + (size_t)len);
-        //协议头
-        result[0] = 'x';
-        //协议数据长
-        int* ptr = (int*)(&result[1]);
-        *ptr = len; //写数据长度
-        ptr++;
-        *ptr = type; //写数据类型
-        ptr++;
-        //数据内容
-        memcpy(ptr, data, len);
-        return (int)result.size();
+        buffer[0] = 'x';
+        memcpy(buffer + 1, &len, sizeof(int));                //写数据长度
+        memcpy(buffer + 1 + sizeof(int), &type, sizeof(int)); //写数据类型
+        return DNET_FAST_PACKET_HEAD_LEN;
     }
 
     /**
-     * Packs
+     * 解析一个协议头.
      *
      * @author daixian
-     * @date 2020/12/21
+     * @date 2021/3/18
      *
-     * @param       data      要打包的原始数据.
-     * @param       len       原始数据长度.
-     * @param [out] buffer    The buffer.
-     * @param       bufferLen Length of the buffer.
-     * @param       type      (Optional) The type.
+     * @param       buff  协议头开始的位置.
+     * @param       count 数据长度.
+     * @param [out] len   数据长度.
+     * @param [out] type  数据类型.
      *
-     * @returns 如果成功,返回打包后的数据长度.
+     * @returns 协议头的长度,协议头还不完整返回0,不是合法的协议头返回-1.
      */
-    virtual int Pack(const char* data, int len, char* buffer, int bufferLen, int type) override
+    static int DecodeHead(const char* buff, int count, int& len, int& type)
     {
-        int packLen = sizeof(int) + sizeof(int) + 1 + len;
-
-        if (bufferLen < packLen) {
+        if (count < 1) {
+            return 0;
+        }
+        if (buff[0] != 'x') {
             return -1;
         }
-        buffer[0] = 'x';
-        //协议数据长
-        int* ptr = (int*)(&buffer[1]);
-        *ptr = len; //写数据长度
-        ptr++;
-        *ptr = type; //写数据类型
-        ptr++;
-        //数据内容
-        memcpy(ptr, data, len);
-        return packLen;
-    }
-
-    /**
-     * Unpacks
-     *
-     * @author daixian
-     * @date 2020/12/21
-     *
-     * @param       receBuff Buffer for rece data.
-     * @param       len      Number of.
-     * @param [out] result   解包数据.
-     * @param [out] type     解包数据类型.
-     *
-     * @returns 如果解析到了完整数据包,返回解析到的结果个数.
-     */
-    virtual int Unpack(const char* receBuff, int count, std::vector<BinMessage>& result) override
-    {
-        //result.clear();
-        int msgCount = 0;
-
-        int curIndex = 0;
-        while (curIndex < count) {
-            if (!isHasHead) {
-                for (int i = curIndex; i < count; i++) {
-                    if (receBuff[i] == 'x') {
-                        isHasHead = true;
-                        _unpackLenBuff.clear();
-                        _unpackTypeBuff.clear();
-                        _unpackDataBuff.clear();
-                        curIndex = i + 1; //从下一个位置开始看长度
-                        break;
-                    }
-                    else {
-                        curIndex = i + 1; //从下一个位置开始
-                    }
-                }
-            }
-
-            //如果整个遍历都找不到一个协议头
-            if (!isHasHead) {
-                return 0;
-            }
-
-            //如果还没有读取完长度
-            if (_unpackLenBuff.size() < 4) {
-                for (int i = curIndex; i < count; i++) {
-                    _unpackLenBuff.push_back(receBuff[i]);
-                    if (_unpackLenBuff.size() == 4) {
-                        //当前需要去检察结果了
-                        int* ptr = (int*)(&_unpackLenBuff[0]);
-                        curMsgLen = *ptr;
-                        curIndex = i + 1; //从下一个位置开始看数据类型数据
-                        break;
-                    }
-                    else {
-                        curIndex = i + 1; //从下一个位置开始
-                    }
-                }
-            }
-            else {
-                //如果长度已经有了
-                if (_unpackTypeBuff.size() < 4) {
-                    //如果还没有Type
-                    for (int i = curIndex; i < count; i++) {
-                        _unpackTypeBuff.push_back(receBuff[i]);
-                        if (_unpackTypeBuff.size() == 4) {
-                            //当前需要去检察结果了
-                            int* ptr = (int*)(&_unpackTypeBuff[0]);
-                            curMsgType = *ptr;
-                            curIndex = i + 1; //从下一个位置开始拷贝数据
-                            break;
-                        }
-                        else {
-                            curIndex = i + 1; //从下一个位置开始
-                        }
-                    }
-                }
-                else {
-                    //如果Type也有了
-                    for (int i = curIndex; i < count; i++) {
-                        _unpackDataBuff.push_back(receBuff[i]);
-                        if (_unpackDataBuff.size() == curMsgLen) {
-                            //当前解析到了一条完整消息
-                            msgCount++;
-                            BinMessage message;
-                            message.type = curMsgType;
-                            message.data = _unpackDataBuff;
-                            result.push_back(message);
-
-                            //清空记录状态
-                            isHasHead = false;
-                            _unpackLenBuff.clear();
-                            curMsgLen = 0;
-                            _unpackTypeBuff.clear();
-                            curMsgType = 0;
-                            _unpackDataBuff.clear();
-
-                            curIndex = i + 1; //从下一个位置开始
-                            break;
-                        }
-                        else {
-                            curIndex = i + 1; //从下一个位置开始
-                        }
-                    }
-                }
-            }
+        if (count < DNET_FAST_PACKET_HEAD_LEN) {
+            return 0;
         }
-
-        return msgCount;
-    }
-
-    /**
-     * Unpacks
-     *
-     * @author daixian
-     * @date 2020/12/21
-     *
-     * @param       receBuff Buffer for rece data.
-     * @param       count    Number of.
-     * @param [out] result   解包数据.
-     * @param [out] types    解包数据类型.
-     *
-     * @returns 如果解析到了完整数据包,返回解析到的结果个数.
-     */
-    virtual int Unpack(const char* receBuff, int count, std::vector<TextMessage>& result) override
-    {
-        //result.clear();
-
-        int msgCount = 0;
-        int curIndex = 0;
-        while (curIndex < count) {
-            if (!isHasHead) {
-                for (int i = curIndex; i < count; i++) {
-                    if (receBuff[i] == 'x') {
-                        isHasHead = true;
-                        _unpackLenBuff.clear();
-                        _unpackTypeBuff.clear();
-                        _unpackDataBuff.clear();
-                        curIndex = i + 1; //从下一个位置开始看长度
-                        break;
-                    }
-                    else {
-                        curIndex = i + 1; //从下一个位置开始
-                    }
-                }
-            }
-
-            //如果整个遍历都找不到一个协议头
-            if (!isHasHead) {
-                return 0;
-            }
-
-            //如果还没有读取完长度
-            if (_unpackLenBuff.size() < 4) {
-                for (int i = curIndex; i < count; i++) {
-                    _unpackLenBuff.push_back(receBuff[i]);
-                    if (_unpackLenBuff.size() == 4) {
-                        //当前需要去检察结果了
-                        int* ptr = (int*)(&_unpackLenBuff[0]);
-                        curMsgLen = *ptr;
-                        curIndex = i + 1; //从下一个位置开始看数据类型数据
-                        break;
-                    }
-                    else {
-                        curIndex = i + 1; //从下一个位置开始
-                    }
-                }
-            }
-            else {
-                //如果长度已经有了
-                if (_unpackTypeBuff.size() < 4) {
-                    //如果还没有Type
-                    for (int i = curIndex; i < count; i++) {
-                        _unpackTypeBuff.push_back(receBuff[i]);
-                        if (_unpackTypeBuff.size() == 4) {
-                            //当前需要去检察结果了
-                            int* ptr = (int*)(&_unpackTypeBuff[0]);
-                            curMsgType = *ptr;
-                            curIndex = i + 1; //从下一个位置开始拷贝数据
-                            break;
-                        }
-                        else {
-                            curIndex = i + 1; //从下一个位置开始
-                        }
-                    }
-                }
-                else {
-                    //如果Type也有了
-                    for (int i = curIndex; i < count; i++) {
-                        _unpackDataBuff.push_back(receBuff[i]);
-                        if (_unpackDataBuff.size() == curMsgLen) {
-                            //当前解析到了一条完整消息
-                            msgCount++;
-
-                            TextMessage message;
-                            message.type = curMsgType;
-                            message.data = std::string(_unpackDataBuff.data(), _unpackDataBuff.size());
-                            result.push_back(message);
-
-                            //清空记录状态
-                            isHasHead = false;
-                            _unpackLenBuff.clear();
-                            curMsgLen = 0;
-                            _unpackTypeBuff.clear();
-                            curMsgType = 0;
-                            _unpackDataBuff.clear();
-
-                            curIndex = i + 1; //从下一个位置开始
-                            break;
-                        }
-                        else {
-                            curIndex = i + 1; //从下一个位置开始
-                        }
-                    }
-                }
-            }
+        memcpy(&len, buff + 1, sizeof(int));
+        if (len < 0) {
+            return -1;
         }
-
-        return msgCount;
+        memcpy(&type, buff + 1 + sizeof(int), sizeof(int));
+        return DNET_FAST_PACKET_HEAD_LEN;
     }
 
-    /**
-     * 当前是否有不完整的解析的数据还在缓存里面.
-     *
-     * @author daixian
-     * @date 2020/12/21
-     *
-     * @returns 当前所有数据都刚好处理完了则返回true.
-     */
-    virtual bool isUnpackCached() override
+    // 找到下一个协议头
+    static const char* FindHead(const char* begin, const char* end)
     {
-        return isHasHead;
+        return (const char*)memchr(begin, 'x', (size_t)(end - begin));
     }
-
-  private:
-    bool isHasHead = false;
-
-    // 来缓存unpack未完成的'数据长度'字段的缓存,它最多应该只有4个长度
-    std::vector<char> _unpackLenBuff;
-
-    // 它能得出的数据长度
-    int curMsgLen = 0;
-
-    // 来缓存unpack未完成的'数据类型'字段的缓存,它最多应该只有4个长度
-    std::vector<char> _unpackTypeBuff;
-
-    // 当前这一条消息的数据类型
-    int curMsgType = 0;
-
-    // 用来缓存unpack未完成的数据的buff
-    std::vector<char> _unpackDataBuff;
 };
 
-} // namespace dnet
\ No newline at end of file
+// 在消息的头使用一个int来标记消息长度的协议.
+typedef Packet<FastPacketFormat> FastPacket;
+
+} // namespace dnet
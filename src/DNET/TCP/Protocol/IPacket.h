@@ -5,6 +5,15 @@
 #include <map>
 #include "Message.hpp"
 
+// 所有协议的协议头的最大长度
+#define DNET_PACKET_MAX_HEAD_LEN 16
+
+// 默认的一条消息的最大长度
+#define DNET_PACKET_MAX_MESSAGE_SIZE (64 * 1024 * 1024)
+
+// 缓存不完整的消息时最多预先分配的长度,更长的消息按实际收到的数据增长,协议头里的长度是对方给的不可信
+#define DNET_PACKET_UNPACK_RESERVE_SIZE (64 * 1024)
+
 namespace dnet {
 
 /**
@@ -65,6 +74,21 @@ class IPacket
      */
     virtual int Pack(const char* data, int len, char* buffer, int bufferLen, int type) = 0;
 
+    /**
+     * 只打包协议头,协议头和原始数据可以分开发送(不需要把数据拷贝到一起).
+     *
+     * @author daixian
+     * @date 2021/3/15
+     *
+     * @param       len       原始数据长度.
+     * @param       type      数据类型.
+     * @param [out] buffer    The buffer,长度至少为DNET_PACKET_MAX_HEAD_LEN.
+     * @param       bufferLen Length of the buffer.
+     *
+     * @returns 如果成功,返回协议头的长度.
+     */
+    virtual int PackHead(int len, int type, char* buffer, int bufferLen) = 0;
+
     /**
      * Unpacks
      *
@@ -93,6 +117,49 @@ class IPacket
      */
     virtual int Unpack(const char* receBuff, int len, std::vector<TextMessage>& result) = 0;
 
+    /**
+     * 不缓存数据的解包,只解析receBuff里完整的消息,消息视图直接指向receBuff.
+     * 最后不完整的消息不会被消费,需要调用者保留下来和后面接收的数据一起再次解包.
+     *
+     * @author daixian
+     * @date 2021/3/12
+     *
+     * @param       receBuff Buffer for rece data.
+     * @param       count    数据长度.
+     * @param [out] result   解包得到的消息视图.
+     *
+     * @returns 消费了的数据长度.
+     */
+    virtual int UnpackView(const char* receBuff, int count, std::vector<MessageView>& result) = 0;
+
+    /**
+     * 如果receBuff开头的消息头已经完整,返回这条消息的总长度(包含消息头).
+     *
+     * @author daixian
+     * @date 2021/3/12
+     *
+     * @param  receBuff Buffer for rece data.
+     * @param  count    数据长度.
+     *
+     * @returns 消息的总长度,消息头还不完整则返回-1.
+     */
+    virtual int PeekFrameLength(const char* receBuff, int count) = 0;
+
+    /**
+     * 解析receBuff开头的消息头.
+     *
+     * @author daixian
+     * @date 2021/3/19
+     *
+     * @param       receBuff Buffer for rece data.
+     * @param       count    数据长度.
+     * @param [out] len      消息的数据长度.
+     * @param [out] type     消息的数据类型.
+     *
+     * @returns 消息头的长度,消息头还不完整返回0,不是合法的消息头(包括长度超过了MaxMessageSize())返回-1.
+     */
+    virtual int PeekHead(const char* receBuff, int count, int& len, int& type) = 0;
+
     /**
      * 当前是否有不完整的解析的数据还在缓存里面.
      *
@@ -103,7 +170,36 @@ class IPacket
      */
     virtual bool isUnpackCached() = 0;
 
-  private:
+    /**
+     * 设置一条消息的最大长度.协议头里的长度超过它的时候当作非法数据丢弃,
+     * 这样一个错误的或者恶意的协议头不能让解包的缓存无限增长.
+     *
+     * @author daixian
+     * @date 2021/3/19
+     *
+     * @param  size 最大长度.
+     */
+    void SetMaxMessageSize(int size)
+    {
+        maxMessageSize = size;
+    }
+
+    /**
+     * 一条消息的最大长度.
+     *
+     * @author daixian
+     * @date 2021/3/19
+     *
+     * @returns 最大长度.
+     */
+    int MaxMessageSize()
+    {
+        return maxMessageSize;
+    }
+
+  protected:
+    // 一条消息的最大长度
+    int maxMessageSize = DNET_PACKET_MAX_MESSAGE_SIZE;
 };
 
 } // namespace dnet
\ No newline at end of file
@@ -3,6 +3,18 @@
 #include <string>
 #include <vector>
 
+// 消息分块的标记:完整的消息
+#define DNET_MESSAGE_CHUNK_NONE 0
+
+// 消息分块的标记:一条大消息的第一块
+#define DNET_MESSAGE_CHUNK_FIRST 1
+
+// 消息分块的标记:一条大消息中间的块
+#define DNET_MESSAGE_CHUNK_MIDDLE 2
+
+// 消息分块的标记:一条大消息的最后一块
+#define DNET_MESSAGE_CHUNK_LAST 3
+
 namespace dnet {
 
 /**
@@ -23,6 +35,9 @@ class Message
     // 这条消息的数据内容.
     T data;
 
+    // 分块接收的大消息的分块标记,完整的消息为DNET_MESSAGE_CHUNK_NONE.
+    int chunk = DNET_MESSAGE_CHUNK_NONE;
+
     std::string to_string()
     {
         return std::string(data.data(), data.size());
@@ -35,4 +50,32 @@ typedef Message<std::vector<char>> BinMessage;
 //文本消息
 typedef Message<std::string> TextMessage;
 
+/**
+ * 一条消息的视图,它不持有数据,数据直接指向连接的接收缓存.
+ * 只在这个连接下一次Receive之前有效.
+ *
+ * @author daixian
+ * @date 2021/3/12
+ */
+class MessageView
+{
+  public:
+    // 这条消息的类型id.
+    int type = 0;
+
+    // 这条消息的数据内容.
+    const char* data = nullptr;
+
+    // 这条消息的数据长度.
+    int len = 0;
+
+    // 分块接收的大消息的分块标记,完整的消息为DNET_MESSAGE_CHUNK_NONE.
+    int chunk = DNET_MESSAGE_CHUNK_NONE;
+
+    std::string to_string() const
+    {
+        return std::string(data, len);
+    }
+};
+
 } // namespace dnet
\ No newline at end of file
@@ -0,0 +1,137 @@
+﻿#pragma once
+
+#include <vector>
+#include <cstring>
+
+#include "Message.hpp"
+
+namespace dnet {
+
+/**
+ * 一批来自多个连接的消息,所有消息的数据依次拷贝到一块连续的内存(arena)里.
+ * 调用者重复使用同一个对象来接收,Clear()不释放内存,所以预热之后接收不再分配内存.
+ *
+ * @author daixian
+ * @date 2021/3/25
+ */
+class MessageBatch
+{
+  public:
+    MessageBatch() {}
+    ~MessageBatch() {}
+
+    /**
+     * 一条消息的记录.
+     */
+    struct Entry
+    {
+        // 消息来自的tcpID.
+        int tcpID;
+
+        // 消息类型.
+        int type;
+
+        // 分块标记.
+        int chunk;
+
+        // 数据在arena里的位置.
+        size_t offset;
+
+        // 数据长度.
+        int len;
+    };
+
+    /**
+     * 清空所有消息,保留已经分配的内存.
+     *
+     * @author daixian
+     * @date 2021/3/25
+     */
+    void Clear()
+    {
+        entries.clear();
+        arena.clear();
+    }
+
+    /**
+     * 添加一条消息,数据会拷贝到arena里.
+     *
+     * @author daixian
+     * @date 2021/3/25
+     *
+     * @param  tcpID 消息来自的tcpID.
+     * @param  msg   消息.
+     */
+    void Add(int tcpID, const MessageView& msg)
+    {
+        Entry entry;
+        entry.tcpID = tcpID;
+        entry.type = msg.type;
+        entry.chunk = msg.chunk;
+        entry.offset = arena.size();
+        entry.len = msg.len;
+        if (msg.len > 0) {
+            arena.resize(arena.size() + msg.len);
+            memcpy(arena.data() + entry.offset, msg.data, msg.len);
+        }
+        entries.push_back(entry);
+    }
+
+    /**
+     * 消息条数.
+     *
+     * @author daixian
+     * @date 2021/3/25
+     *
+     * @returns 条数.
+     */
+    size_t Size() const
+    {
+        return entries.size();
+    }
+
+    /**
+     * 第index条消息来自的tcpID.
+     *
+     * @author daixian
+     * @date 2021/3/25
+     *
+     * @param  index 消息的序号.
+     *
+     * @returns tcpID.
+     */
+    int TcpID(size_t index) const
+    {
+        return entries[index].tcpID;
+    }
+
+    /**
+     * 第index条消息的视图,在下一次Clear()或者Add()之前有效.
+     *
+     * @author daixian
+     * @date 2021/3/25
+     *
+     * @param  index 消息的序号.
+     *
+     * @returns 消息视图.
+     */
+    MessageView View(size_t index) const
+    {
+        const Entry& entry = entries[index];
+        MessageView view;
+        view.type = entry.type;
+        view.chunk = entry.chunk;
+        view.data = arena.data() + entry.offset;
+        view.len = entry.len;
+        return view;
+    }
+
+  private:
+    // 所有消息的记录
+    std::vector<Entry> entries;
+
+    // 所有消息的数据
+    std::vector<char> arena;
+};
+
+} // namespace dnet
@@ -0,0 +1,460 @@
+﻿#pragma once
+
+#include <cstring>
+#include <algorithm>
+#include "IPacket.h"
+
+namespace dnet {
+
+/**
+ * 协议的打包和解包实现,协议头的格式由模板参数TFormat决定.
+ * TFormat是一个只有静态函数的类,需要提供:
+ *   MAX_HEAD_LEN 协议头的最大长度(不超过DNET_PACKET_MAX_HEAD_LEN).
+ *   HeadLength(len, type) 协议头的长度.
+ *   WriteHead(len, type, buffer) 写协议头,返回协议头的长度.
+ *   DecodeHead(buff, count, len, type) 解析协议头,返回协议头的长度,不完整返回0,非法返回-1.
+ *   FindHead(begin, end) 找到下一个可能是协议头的位置.
+ * 这些函数都是静态调用的,编译器可以把它们内联到收发的循环里面.
+ *
+ * @author daixian
+ * @date 2021/3/20
+ *
+ * @tparam TFormat 协议头的格式.
+ */
+template <class TFormat>
+class Packet final : public IPacket
+{
+  public:
+    Packet() {}
+    virtual ~Packet() {}
+
+    /**
+     * Packs
+     *
+     * @author daixian
+     * @date 2020/12/21
+     *
+     * @param       data   要打包的原始数据.
+     * @param       len    The length.
+     * @param [out] result The result.
+     * @param       type   (Optional) 数据类型(如可以分成命令和用户数据两种).
+     *
+     * @returns 打包结果长度.
+     */
+    virtual int Pack(const char* data, int len, std::vector<char>& result, int type) override
+    {
+        return PackTo(data, len, result, type);
+    }
+
+    /**
+     * Packs
+     *
+     * @author daixian
+     * @date 2020/12/21
+     *
+     * @param       data   要打包的原始数据.
+     * @param       len    原始数据长度.
+     * @param [out] result The result.
+     * @param       type   (Optional) The type.
+     *
+     * @returns 打包结果长度.
+     */
+    virtual int Pack(const char* data, int len, std::string& result, int type) override
+    {
+        return PackTo(data, len, result, type);
+    }
+
+    /**
+     * Packs
+     *
+     * @author daixian
+     * @date 2020/12/21
+     *
+     * @param       data      要打包的原始数据.
+     * @param       len       原始数据长度.
+     * @param [out] buffer    The buffer.
+     * @param       bufferLen Length of the buffer.
+     * @param       type      (Optional) The type.
+     *
+     * @returns 如果成功,返回打包后的数据长度.
+     */
+    virtual int Pack(const char* data, int len, char* buffer, int bufferLen, int type) override
+    {
+        int headLen = PackHead(len, type, buffer, bufferLen - len);
+        if (headLen < 0) {
+            return -1;
+        }
+        if (len > 0) {
+            memcpy(buffer + headLen, data, len);
+        }
+        return headLen + len;
+    }
+
+    /**
+     * 只打包协议头.
+     *
+     * @author daixian
+     * @date 2021/3/15
+     *
+     * @param       len       原始数据长度.
+     * @param       type      数据类型.
+     * @param [out] buffer    The buffer.
+     * @param       bufferLen Length of the buffer.
+     *
+     * @returns 如果成功,返回协议头的长度.
+     */
+    virtual int PackHead(int len, int type, char* buffer, int bufferLen) override
+    {
+        if (len < 0 || bufferLen < TFormat::HeadLength(len, type)) {
+            return -1;
+        }
+        return TFormat::WriteHead(len, type, buffer);
+    }
+
+    /**
+     * Unpacks
+     *
+     * @author daixian
+     * @date 2020/12/21
+     *
+     * @param       receBuff Buffer for rece data.
+     * @param       count    Number of.
+     * @param [out] result   解包数据.
+     *
+     * @returns 如果解析到了完整数据包,返回解析到的结果个数.
+     */
+    virtual int Unpack(const char* receBuff, int count, std::vector<BinMessage>& result) override
+    {
+        return UnpackMessages(receBuff, count, result);
+    }
+
+    /**
+     * Unpacks
+     *
+     * @author daixian
+     * @date 2020/12/21
+     *
+     * @param       receBuff Buffer for rece data.
+     * @param       count    Number of.
+     * @param [out] result   解包数据.
+     *
+     * @returns 如果解析到了完整数据包,返回解析到的结果个数.
+     */
+    virtual int Unpack(const char* receBuff, int count, std::vector<TextMessage>& result) override
+    {
+        return UnpackMessages(receBuff, count, result);
+    }
+
+    /**
+     * 不缓存数据的解包,只解析receBuff里完整的消息,消息视图直接指向receBuff.
+     *
+     * @author daixian
+     * @date 2021/3/12
+     *
+     * @param       receBuff Buffer for rece data.
+     * @param       count    数据长度.
+     * @param [out] result   解包得到的消息视图.
+     *
+     * @returns 消费了的数据长度.
+     */
+    virtual int UnpackView(const char* receBuff, int count, std::vector<MessageView>& result) override
+    {
+        int curIndex = 0;
+        while (curIndex < count) {
+            // 找到下一个协议头
+            const char* head = TFormat::FindHead(receBuff + curIndex, receBuff + count);
+            if (head == nullptr) {
+                // 剩下的都是无效数据
+                return count;
+            }
+            curIndex = (int)(head - receBuff);
+
+            int len;
+            int type;
+            int headLen = PeekHead(head, count - curIndex, len, type);
+            if (headLen < 0) {
+                // 非法的协议头,跳过这个标记重新寻找协议头
+                curIndex++;
+                continue;
+            }
+            if (headLen == 0 || count - curIndex - headLen < len) {
+                break; // 消息头或者数据不完整
+            }
+
+            result.emplace_back();
+            MessageView& view = result.back();
+            view.type = type;
+            view.data = head + headLen;
+            view.len = len;
+            curIndex += headLen + len;
+        }
+        return curIndex;
+    }
+
+    /**
+     * 如果receBuff开头的消息头已经完整,返回这条消息的总长度(包含消息头).
+     *
+     * @author daixian
+     * @date 2021/3/12
+     *
+     * @param  receBuff Buffer for rece data.
+     * @param  count    数据长度.
+     *
+     * @returns 消息的总长度,消息头还不完整则返回-1.
+     */
+    virtual int PeekFrameLength(const char* receBuff, int count) override
+    {
+        int len;
+        int type;
+        int headLen = PeekHead(receBuff, count, len, type);
+        if (headLen <= 0) {
+            return -1;
+        }
+        return headLen + len;
+    }
+
+    /**
+     * 解析receBuff开头的消息头.
+     *
+     * @author daixian
+     * @date 2021/3/19
+     *
+     * @param       receBuff Buffer for rece data.
+     * @param       count    数据长度.
+     * @param [out] len      消息的数据长度.
+     * @param [out] type     消息的数据类型.
+     *
+     * @returns 消息头的长度,消息头还不完整返回0,不是合法的消息头返回-1.
+     */
+    virtual int PeekHead(const char* receBuff, int count, int& len, int& type) override
+    {
+        int headLen = TFormat::DecodeHead(receBuff, count, len, type);
+        if (headLen > 0 && (len < 0 || len > maxMessageSize)) {
+            return -1;
+        }
+        return headLen;
+    }
+
+    /**
+     * 当前是否有不完整的解析的数据还在缓存里面.
+     *
+     * @author daixian
+     * @date 2020/12/21
+     *
+     * @returns 当前所有数据都刚好处理完了则返回true.
+     */
+    virtual bool isUnpackCached() override
+    {
+        return isHasHead;
+    }
+
+    /**
+     * 一条消息打包之后的协议头长度.
+     *
+     * @author daixian
+     * @date 2021/3/18
+     *
+     * @param  len  原始数据长度.
+     * @param  type 数据类型.
+     *
+     * @returns 协议头的长度.
+     */
+    static int HeadLength(int len, int type)
+    {
+        return TFormat::HeadLength(len, type);
+    }
+
+    /**
+     * 缓存不完整的消息的内存容量,用于统计内存.
+     *
+     * @returns 字节数.
+     */
+    size_t UnpackCacheCapacity() const
+    {
+        return _unpackDataBuff.capacity();
+    }
+
+  private:
+    bool isHasHead = false;
+
+    // 协议头是否已经解析完了
+    bool isHeadDone = false;
+
+    // 来缓存unpack未完成的协议头
+    char _unpackHeadBuff[DNET_PACKET_MAX_HEAD_LEN];
+
+    // _unpackHeadBuff中已经有的长度
+    int _unpackHeadLen = 0;
+
+    // 它能得出的数据长度
+    int curMsgLen = 0;
+
+    // 当前这一条消息的数据类型
+    int curMsgType = 0;
+
+    // 用来缓存unpack未完成的数据的buff
+    std::vector<char> _unpackDataBuff;
+
+    /**
+     * 打包到std::string或者std::vector<char>.
+     *
+     * @tparam T std::string或者std::vector<char>.
+     * @param       data   要打包的原始数据.
+     * @param       len    原始数据长度.
+     * @param [out] result The result.
+     * @param       type   数据类型.
+     *
+     * @returns 打包结果长度.
+     */
+    template <typename T>
+    int PackTo(const char* data, int len, T& result, int type)
+    {
+        int headLen = TFormat::HeadLength(len, type);
+        result.resize((size_t)headLen + len);
+        TFormat::WriteHead(len, type, &result[0]);
+        if (len > 0) {
+            memcpy(&result[headLen], data, len);
+        }
+        return (int)result.size();
+    }
+
+    /**
+     * 两种消息类型的解包实现.
+     * 如果一条完整的消息都在receBuff里,那么直接从receBuff拷贝出消息内容(快速路径),
+     * 只有跨越了多次接收的消息才会走缓存的路径.
+     *
+     * @tparam T 一条消息的类型为std::string或者std::vector<char>.
+     * @param       receBuff Buffer for rece data.
+     * @param       count    Number of.
+     * @param [out] result   解包数据.
+     *
+     * @returns 解析到的结果个数.
+     */
+    template <typename T>
+    int UnpackMessages(const char* receBuff, int count, std::vector<Message<T>>& result)
+    {
+        int msgCount = 0;
+        int curIndex = 0;
+        while (curIndex < count) {
+            if (!isHasHead) {
+                // 找到下一个协议头
+                const char* head = TFormat::FindHead(receBuff + curIndex, receBuff + count);
+                if (head == nullptr) {
+                    // 如果整个遍历都找不到一个协议头
+                    return msgCount;
+                }
+                curIndex = (int)(head - receBuff);
+
+                int remain = count - curIndex;
+                int len;
+                int type;
+                int headLen = PeekHead(head, remain, len, type);
+                if (headLen < 0) {
+                    // 非法的协议头,跳过这个标记重新寻找协议头
+                    curIndex++;
+                    continue;
+                }
+                if (headLen > 0 && remain - headLen >= len) {
+                    // 快速路径:整条消息都在receBuff里
+                    const char* data = head + headLen;
+                    result.emplace_back();
+                    Message<T>& message = result.back();
+                    message.type = type;
+                    message.data.assign(data, data + len);
+                    msgCount++;
+                    curIndex += headLen + len;
+                    continue;
+                }
+
+                // 这条消息不完整,开始缓存
+                isHasHead = true;
+                _unpackDataBuff.clear();
+                if (headLen == 0) {
+                    // 协议头也不完整,剩下的数据一定比最大的协议头短
+                    memcpy(_unpackHeadBuff, head, (size_t)remain);
+                    _unpackHeadLen = remain;
+                    break;
+                }
+                isHeadDone = true;
+                curMsgLen = len;
+                curMsgType = type;
+                ReserveUnpackData();
+                curIndex += headLen;
+                continue;
+            }
+
+            //如果还没有读取完协议头
+            if (!isHeadDone) {
+                int copyLen = std::min(TFormat::MAX_HEAD_LEN - _unpackHeadLen, count - curIndex);
+                memcpy(_unpackHeadBuff + _unpackHeadLen, receBuff + curIndex, (size_t)copyLen);
+                int headLen = PeekHead(_unpackHeadBuff, _unpackHeadLen + copyLen, curMsgLen, curMsgType);
+                if (headLen < 0) {
+                    // 非法的协议头,丢弃它
+                    ResetUnpack();
+                    continue;
+                }
+                if (headLen == 0) {
+                    _unpackHeadLen += copyLen;
+                    curIndex += copyLen;
+                    continue;
+                }
+                curIndex += headLen - _unpackHeadLen;
+                isHeadDone = true;
+                ReserveUnpackData();
+            }
+
+            //协议头完整了,那么拷贝剩余的数据
+            int copyLen = std::min(curMsgLen - (int)_unpackDataBuff.size(), count - curIndex);
+            _unpackDataBuff.insert(_unpackDataBuff.end(), receBuff + curIndex, receBuff + curIndex + copyLen);
+            curIndex += copyLen;
+
+            if ((int)_unpackDataBuff.size() == curMsgLen) {
+                //当前解析到了一条完整消息
+                result.emplace_back();
+                Message<T>& message = result.back();
+                message.type = curMsgType;
+                TakeData(message.data, _unpackDataBuff);
+                msgCount++;
+
+                //清空记录状态
+                ResetUnpack();
+            }
+        }
+
+        return msgCount;
+    }
+
+    // 开始缓存一条消息的数据.curMsgLen已经由PeekHead()检察过不超过maxMessageSize,
+    // 但是仍然只预留一部分,剩下的按实际收到的数据增长,一个伪造的协议头不能导致一次巨大的分配
+    void ReserveUnpackData()
+    {
+        _unpackDataBuff.reserve((size_t)std::min(curMsgLen, DNET_PACKET_UNPACK_RESERVE_SIZE));
+    }
+
+    // 清空解包的记录状态
+    void ResetUnpack()
+    {
+        isHasHead = false;
+        isHeadDone = false;
+        _unpackHeadLen = 0;
+        curMsgLen = 0;
+        curMsgType = 0;
+        _unpackDataBuff.clear();
+    }
+
+    // 把缓存的数据交给消息
+    static void TakeData(std::vector<char>& data, std::vector<char>& buff)
+    {
+        data.swap(buff);
+        buff.clear();
+    }
+
+    // 把缓存的数据交给消息
+    static void TakeData(std::string& data, std::vector<char>& buff)
+    {
+        data.assign(buff.data(), buff.size());
+        buff.clear();
+    }
+};
+
+} // namespace dnet
@@ -0,0 +1,115 @@
+﻿#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "ReceiveBuffer.h"
+
+// 共用接收缓存每一块内存的大小
+#define DNET_RECEIVE_ARENA_BLOCK_SIZE (64 * 1024)
+
+// 共用接收缓存最多保留的空闲的连接接收缓存个数
+#define DNET_RECEIVE_ARENA_MAX_SPARE 64
+
+namespace dnet {
+
+/**
+ * 一个接收线程里所有服务器端连接共用的接收缓存.socket的数据直接接收到这里,解包得到的消息视图指向这里,
+ * 在下一次Reset()之前都有效,所以同一批接收的多个连接的消息视图可以同时使用.
+ * 连接只有在剩下了不完整的消息的时候才需要自己的ReceiveBuffer,它也从这里借出,接收完整之后还回来,
+ * 这样空闲的连接不占用接收缓存.只能在一个线程里使用.
+ *
+ * @author daixian
+ * @date 2021/3/28
+ */
+class ReceiveArena
+{
+  public:
+    ReceiveArena() {}
+    ~ReceiveArena() {}
+
+    /**
+     * 开始新的一批接收,之前得到的消息视图全部失效.已经分配的内存保留.
+     */
+    void Reset()
+    {
+        blockIndex = 0;
+        offset = 0;
+    }
+
+    /**
+     * 得到一段连续的可以写入的内存,写入之后用Commit()标记实际使用了的长度.
+     *
+     * @param  len 需要的长度,不能超过DNET_RECEIVE_ARENA_BLOCK_SIZE.
+     *
+     * @returns 写入位置的指针.
+     */
+    char* Prepare(size_t len)
+    {
+        if (offset + len > DNET_RECEIVE_ARENA_BLOCK_SIZE) {
+            blockIndex++; // 当前这一块放不下了,使用下一块,前面的数据不移动
+            offset = 0;
+        }
+        if (blockIndex >= blocks.size()) {
+            blocks.push_back(std::unique_ptr<char[]>(new char[DNET_RECEIVE_ARENA_BLOCK_SIZE]));
+        }
+        return blocks[blockIndex].get() + offset;
+    }
+
+    /**
+     * 标记Prepare()得到的内存使用了一段,这一段在下一次Reset()之前不会被覆盖.
+     *
+     * @param  len 使用了的长度.
+     */
+    void Commit(size_t len)
+    {
+        offset += len;
+    }
+
+    /**
+     * 借出一个连接自己的接收缓存,用来保存不完整的消息.
+     *
+     * @param  capacity 新创建的时候的容量.
+     *
+     * @returns 一个空的接收缓存.
+     */
+    std::unique_ptr<ReceiveBuffer> AcquireBuffer(size_t capacity)
+    {
+        if (spares.empty()) {
+            return std::unique_ptr<ReceiveBuffer>(new ReceiveBuffer(capacity));
+        }
+        std::unique_ptr<ReceiveBuffer> buff = std::move(spares.back());
+        spares.pop_back();
+        return buff;
+    }
+
+    /**
+     * 还回一个连接的接收缓存,之后buff为空.
+     *
+     * @param [in,out] buff 接收缓存.
+     */
+    void ReleaseBuffer(std::unique_ptr<ReceiveBuffer>& buff)
+    {
+        // 接收过大消息扩大过的缓存不保留
+        if (spares.size() < DNET_RECEIVE_ARENA_MAX_SPARE && buff->Capacity() <= DNET_RECEIVE_ARENA_BLOCK_SIZE) {
+            buff->Clear();
+            spares.push_back(std::move(buff));
+        }
+        buff.reset();
+    }
+
+  private:
+    // 所有的内存块
+    std::vector<std::unique_ptr<char[]>> blocks;
+
+    // 当前使用的内存块
+    size_t blockIndex = 0;
+
+    // 当前内存块已经使用了的长度
+    size_t offset = 0;
+
+    // 还回来的空闲的连接接收缓存
+    std::vector<std::unique_ptr<ReceiveBuffer>> spares;
+};
+
+} // namespace dnet
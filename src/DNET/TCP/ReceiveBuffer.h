@@ -0,0 +1,148 @@
+﻿#pragma once
+
+#include <vector>
+#include <cstring>
+
+namespace dnet {
+
+/**
+ * 一个连接的接收缓存.socket的数据直接接收到这里,解包时消息视图直接指向这里的数据.
+ * 已经解析过的数据在下一次接收之前才会被丢弃,剩下的未完整的消息会被移动到缓存的开头,
+ * 所以缓存里的每一条消息都是连续的,不需要再拷贝.
+ *
+ * @author daixian
+ * @date 2021/3/12
+ */
+class ReceiveBuffer
+{
+  public:
+    ReceiveBuffer(size_t capacity = 8 * 1024)
+    {
+        buff.resize(capacity);
+    }
+
+    ~ReceiveBuffer() {}
+
+    /**
+     * 可以写入数据的位置.
+     *
+     * @returns 写入位置的指针.
+     */
+    char* WritePtr()
+    {
+        return buff.data() + writeIndex;
+    }
+
+    /**
+     * 当前还能写入的长度.
+     *
+     * @returns 可写入的长度.
+     */
+    int WritableSize()
+    {
+        return (int)buff.size() - writeIndex;
+    }
+
+    /**
+     * 标记写入了一段数据.
+     *
+     * @param  len 写入的长度.
+     */
+    void Commit(int len)
+    {
+        writeIndex += len;
+    }
+
+    /**
+     * 未读取的数据的位置.
+     *
+     * @returns 读取位置的指针.
+     */
+    const char* ReadPtr()
+    {
+        return buff.data() + readIndex;
+    }
+
+    /**
+     * 当前未读取的数据长度.
+     *
+     * @returns 未读取的数据长度.
+     */
+    int ReadableSize()
+    {
+        return writeIndex - readIndex;
+    }
+
+    /**
+     * 标记读取(消费)了一段数据,这段数据在下一次Compact()之前仍然有效.
+     *
+     * @param  len 读取的长度.
+     */
+    void Consume(int len)
+    {
+        readIndex += len;
+        if (readIndex == writeIndex) {
+            readIndex = 0;
+            writeIndex = 0;
+        }
+    }
+
+    /**
+     * 丢弃已经读取的数据,把未读取的数据移动到缓存开头.调用之后之前ReadPtr()得到的指针都会失效.
+     */
+    void Compact()
+    {
+        if (readIndex > 0) {
+            int len = ReadableSize();
+            if (len > 0) {
+                memmove(buff.data(), buff.data() + readIndex, (size_t)len);
+            }
+            readIndex = 0;
+            writeIndex = len;
+        }
+    }
+
+    /**
+     * 确保缓存的总容量至少为capacity,会调用Compact().
+     *
+     * @param  capacity 需要的容量.
+     */
+    void Reserve(size_t capacity)
+    {
+        Compact();
+        if (buff.size() < capacity) {
+            buff.resize(capacity);
+        }
+    }
+
+    /**
+     * 缓存的总容量.
+     *
+     * @returns 总容量.
+     */
+    size_t Capacity()
+    {
+        return buff.size();
+    }
+
+    /**
+     * 清空所有数据.
+     */
+    void Clear()
+    {
+        readIndex = 0;
+        writeIndex = 0;
+    }
+
+  private:
+    // 缓存
+    std::vector<char> buff;
+
+    // 未读取数据的起始位置
+    int readIndex = 0;
+
+    // 可写入数据的起始位置
+    int writeIndex = 0;
+};
+
+} // namespace dnet
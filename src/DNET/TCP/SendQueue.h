@@ -0,0 +1,317 @@
+﻿#pragma once
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <cstring>
+
+#include "SocketUtil.h"
+#include "TCPOptions.h"
+
+// 每一段缓存的大小,超过了这个大小就新开一段
+#define DNET_SEND_QUEUE_SEGMENT_SIZE (64 * 1024)
+
+// 一次发送最多合并的段数
+#define DNET_SEND_QUEUE_GATHER_COUNT 8
+
+namespace dnet {
+
+/**
+ * 一个连接的待发送数据队列.socket发送缓存满了的时候没有发送出去的数据都追加到这里,
+ * 等到socket可写的时候再非阻塞的发送,这样发送永远不会阻塞调用者.
+ * 广播的帧是多个连接共享的,追加的时候只引用不拷贝.
+ * 每个优先级一个队列(DNET_SEND_PRIORITY_COUNT个),同一个优先级的帧按追加的顺序发送,
+ * 发送的时候先发优先级高的.只在帧的边界上切换队列,一帧开始发送了就一定要发送完,所以对方收到的还是完整的帧.
+ *
+ * @author daixian
+ * @date 2021/3/17
+ */
+class SendQueue
+{
+  public:
+    SendQueue() {}
+    ~SendQueue() {}
+
+    /**
+     * 追加几段数据(通常是一条消息的协议头和内容)作为一帧到一个优先级的队尾.
+     * offset大于0表示这一帧前面的部分已经直接发送到socket了,只能在整个队列为空的时候这样追加,之后会先发送完它.
+     *
+     * @param  bufs     要追加的几段数据.
+     * @param  count    数据的段数.
+     * @param  offset   从所有数据拼接起来的第几个字节开始追加(前面的已经发送过了).
+     * @param  priority 优先级.
+     */
+    void Append(const SendBuf* bufs, int count, int offset = 0, int priority = DNET_SEND_PRIORITY_NORMAL)
+    {
+        int index = LaneIndex(priority);
+        Lane& lane = lanes[index];
+        bool isStarted = offset > 0;
+        size_t frameLen = 0;
+        for (int i = 0; i < count; i++) {
+            if (offset >= bufs[i].len) {
+                offset -= bufs[i].len;
+                continue;
+            }
+            AppendData(lane, bufs[i].data + offset, bufs[i].len - offset);
+            frameLen += bufs[i].len - offset;
+            offset = 0;
+        }
+        if (isStarted && frameLen > 0) {
+            activeLane = index;
+        }
+        AddFrame(lane, frameLen);
+    }
+
+    /**
+     * 追加一个共享的打包好的帧到一个优先级的队尾,只引用不拷贝.
+     *
+     * @param  frame    打包好的帧,之后不能再修改.
+     * @param  offset   从第几个字节开始追加(前面的已经发送过了),同上只能在整个队列为空的时候大于0.
+     * @param  priority 优先级.
+     */
+    void Append(const std::shared_ptr<const std::vector<char>>& frame, int offset = 0, int priority = DNET_SEND_PRIORITY_NORMAL)
+    {
+        if (offset >= (int)frame->size()) {
+            return;
+        }
+        int index = LaneIndex(priority);
+        Lane& lane = lanes[index];
+        lane.segments.emplace_back();
+        lane.segments.back().shared = frame;
+        lane.segments.back().begin = offset;
+        if (offset > 0) {
+            activeLane = index;
+        }
+        AddFrame(lane, frame->size() - offset);
+    }
+
+    /**
+     * 非阻塞的尽可能多的发送队列里的数据,优先级高的先发送.
+     *
+     * @param [in] socket The socket.
+     *
+     * @returns 发送了的字节数,出错返回-1.
+     */
+    int Flush(Poco::Net::StreamSocket& socket)
+    {
+        int sendCount = 0;
+        while (size > 0) {
+            // 有发送了一半的帧就先发送完它,否则从优先级最高的队列发送
+            int index = activeLane >= 0 ? activeLane : FrontLane();
+            Lane& lane = lanes[index];
+
+            // 有优先级更高的数据在等待的时候只发送到这一帧的结尾
+            size_t limit = FrontLane() < index ? lane.frontOffset + lane.frames.front() : lane.frontOffset + lane.size;
+            SendBuf bufs[DNET_SEND_QUEUE_GATHER_COUNT];
+            int count = 0;
+            for (auto itr = lane.segments.begin(); itr != lane.segments.end() && count < DNET_SEND_QUEUE_GATHER_COUNT && limit > 0; itr++) {
+                bufs[count].data = itr->Data();
+                bufs[count].len = (int)(itr->Size() < limit ? itr->Size() : limit);
+                limit -= bufs[count].len;
+                count++;
+            }
+
+            int res = SendGather(socket, bufs, count, (int)lane.frontOffset);
+            if (res < 0) {
+                return -1;
+            }
+            if (res == 0) {
+                break; // socket的发送缓存满了
+            }
+            Consume(index, (size_t)res);
+            sendCount += res;
+        }
+        return sendCount;
+    }
+
+    /**
+     * 队列里等待发送的字节数.
+     *
+     * @returns 字节数.
+     */
+    size_t Size()
+    {
+        return size;
+    }
+
+    /**
+     * 一个优先级的队列里等待发送的字节数.
+     *
+     * @param  priority 优先级.
+     *
+     * @returns 字节数.
+     */
+    size_t Size(int priority)
+    {
+        return lanes[LaneIndex(priority)].size;
+    }
+
+    /**
+     * 队列是否为空.
+     *
+     * @returns True if empty, false if not.
+     */
+    bool Empty()
+    {
+        return size == 0;
+    }
+
+    /**
+     * 清空队列.
+     */
+    void Clear()
+    {
+        for (Lane& lane : lanes) {
+            while (!lane.segments.empty()) {
+                PopFront(lane);
+            }
+            lane.frames.clear();
+            lane.frontOffset = 0;
+            lane.size = 0;
+        }
+        activeLane = -1;
+        size = 0;
+    }
+
+  private:
+    /**
+     * 一段待发送的数据,是自己的缓存或者共享的帧.
+     */
+    struct Segment
+    {
+        // 自己的缓存,shared为空的时候使用
+        std::vector<char> buff;
+
+        // 共享的帧
+        std::shared_ptr<const std::vector<char>> shared;
+
+        // 共享的帧从第几个字节开始是这一段
+        size_t begin = 0;
+
+        const char* Data() const
+        {
+            return shared != nullptr ? shared->data() + begin : buff.data();
+        }
+
+        size_t Size() const
+        {
+            return shared != nullptr ? shared->size() - begin : buff.size();
+        }
+    };
+
+    /**
+     * 一个优先级的待发送数据.
+     */
+    struct Lane
+    {
+        // 待发送的数据
+        std::deque<Segment> segments;
+
+        // 每一帧还没有发送的长度,用来找到帧的边界
+        std::deque<size_t> frames;
+
+        // 第一段中已经发送了的长度
+        size_t frontOffset = 0;
+
+        // 等待发送的字节数
+        size_t size = 0;
+    };
+
+    // 每个优先级的队列
+    Lane lanes[DNET_SEND_PRIORITY_COUNT];
+
+    // 第一帧发送了一半的队列,没有为-1
+    int activeLane = -1;
+
+    // 等待发送的总字节数
+    size_t size = 0;
+
+    // 发送完了的缓存留下来重复使用
+    std::vector<std::vector<char>> spareBuffs;
+
+    static int LaneIndex(int priority)
+    {
+        if (priority < 0) {
+            return 0;
+        }
+        return priority < DNET_SEND_PRIORITY_COUNT ? priority : DNET_SEND_PRIORITY_COUNT - 1;
+    }
+
+    // 有数据的优先级最高的队列
+    int FrontLane()
+    {
+        for (int i = 0; i < DNET_SEND_PRIORITY_COUNT; i++) {
+            if (lanes[i].size > 0) {
+                return i;
+            }
+        }
+        return 0;
+    }
+
+    // 追加一段数据到一个队列,小的数据尽量合并到最后一段里
+    void AppendData(Lane& lane, const char* data, int len)
+    {
+        if (lane.segments.empty() || lane.segments.back().shared != nullptr || lane.segments.back().buff.size() >= DNET_SEND_QUEUE_SEGMENT_SIZE) {
+            lane.segments.emplace_back();
+            if (!spareBuffs.empty()) {
+                lane.segments.back().buff.swap(spareBuffs.back());
+                spareBuffs.pop_back();
+            }
+        }
+        std::vector<char>& buff = lane.segments.back().buff;
+        buff.insert(buff.end(), data, data + len);
+    }
+
+    // 记录追加了的一帧
+    void AddFrame(Lane& lane, size_t len)
+    {
+        if (len == 0) {
+            return;
+        }
+        lane.frames.push_back(len);
+        lane.size += len;
+        size += len;
+    }
+
+    // 移除一个队列里已经发送了的数据
+    void Consume(int index, size_t len)
+    {
+        Lane& lane = lanes[index];
+        lane.size -= len;
+        size -= len;
+
+        // 停在了一帧的中间就要先发送完这个队列的这一帧
+        size_t remain = len;
+        activeLane = -1;
+        while (remain > 0 && !lane.frames.empty()) {
+            if (remain < lane.frames.front()) {
+                lane.frames.front() -= remain;
+                activeLane = index;
+                break;
+            }
+            remain -= lane.frames.front();
+            lane.frames.pop_front();
+        }
+
+        len += lane.frontOffset;
+        while (!lane.segments.empty() && len >= lane.segments.front().Size()) {
+            len -= lane.segments.front().Size();
+            PopFront(lane);
+        }
+        lane.frontOffset = len;
+    }
+
+    // 移除一个队列的第一段,自己的缓存留下来重复使用
+    void PopFront(Lane& lane)
+    {
+        std::vector<char>& buff = lane.segments.front().buff;
+        if (lane.segments.front().shared == nullptr && spareBuffs.size() < 2 && buff.capacity() <= DNET_SEND_QUEUE_SEGMENT_SIZE * 2) {
+            buff.clear();
+            spareBuffs.emplace_back();
+            spareBuffs.back().swap(buff);
+        }
+        lane.segments.pop_front();
+    }
+};
+
+} // namespace dnet
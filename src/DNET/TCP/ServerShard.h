@@ -0,0 +1,281 @@
+﻿#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include "TCPClient.h"
+#include "Poller.h"
+#include "ReceiveArena.h"
+#include "MonotonicClock.h"
+#include "Protocol/MessageBatch.hpp"
+
+#include "Poco/Net/StreamSocket.h"
+#include "dlog/dlog.h"
+
+// IO线程没有socket就绪的时候最多等待的毫秒数
+#define DNET_SERVER_SHARD_WAIT_MS 100
+
+namespace dnet {
+
+/**
+ * IO线程接收到的一批消息.消息的数据都拷贝在一个MessageBatch里(MessageBatch::TcpID()是客户端的TCPClient::AcceptID()),
+ * 同一个客户端的消息是连续的一段.IO线程和应用线程交换着使用这样的对象,Clear()不释放内存,
+ * 所以预热之后接收不再分配内存.
+ *
+ * @author daixian
+ * @date 2021/3/22
+ */
+struct ShardReceived
+{
+    // 一个客户端的消息在batch里的范围[begin,end),没有消息的是只有连接断开了的客户端
+    struct Range
+    {
+        int acceptID;
+        size_t begin;
+        size_t end;
+    };
+
+    // 所有消息
+    MessageBatch batch;
+
+    // 每个客户端的消息的范围
+    std::vector<Range> ranges;
+
+    // 添加一个客户端的消息
+    void Add(int acceptID, const std::vector<MessageView>& msgs)
+    {
+        Range range;
+        range.acceptID = acceptID;
+        range.begin = batch.Size();
+        for (size_t i = 0; i < msgs.size(); i++) {
+            batch.Add(acceptID, msgs[i]);
+        }
+        range.end = batch.Size();
+        ranges.push_back(range);
+    }
+
+    // 把other的消息追加到后面
+    void Append(const ShardReceived& other)
+    {
+        size_t base = batch.Size();
+        for (size_t i = 0; i < other.batch.Size(); i++) {
+            batch.Add(other.batch.TcpID(i), other.batch.View(i));
+        }
+        for (const Range& range : other.ranges) {
+            ranges.push_back(Range{range.acceptID, base + range.begin, base + range.end});
+        }
+    }
+
+    void Clear()
+    {
+        batch.Clear();
+        ranges.clear();
+    }
+
+    bool Empty() const
+    {
+        return ranges.empty();
+    }
+};
+
+/**
+ * TCPServer的一个IO线程.连接进来的客户端按tcpID固定的分配到一个分片,
+ * 分片的线程等待自己的客户端就绪,从socket接收并且解包,消息放到队列里等应用线程取走.
+ * 握手,心跳,发送和ClientManager的修改都还是在应用线程里,应用线程访问一个客户端的时候要先锁它的分片.
+ * 这个线程只在接收一个客户端的时候加锁,所以应用线程最多等待一个客户端的接收.
+ * 连接断开也只是作为一条(可能没有消息的)记录交给应用线程,关闭的事件都在应用线程里发出.
+ * KCP不分片:所有客户端的KCP数据都从服务器的同一个UDP socket收到,要先按conv找到客户端,
+ * 所以KCP的接收和发送都在调用TCPServer::KCPReceive()的线程里执行.
+ *
+ * @author daixian
+ * @date 2021/3/22
+ */
+class ServerShard
+{
+  public:
+    ServerShard() {}
+    ~ServerShard()
+    {
+        Stop();
+    }
+
+    // 锁,这个分片的线程和应用线程访问这个分片的客户端的时候都要加锁.
+    // 应用线程的握手处理中可能会删除同一个分片的客户端,所以是可重入的.
+    std::recursive_mutex mut;
+
+    /**
+     * 启动这个分片的线程.
+     *
+     * @author daixian
+     * @date 2021/3/22
+     *
+     * @param [in] notifyPoller 接收到消息之后唤醒它(应用线程在等待的Poller).
+     *
+     * @returns 成功返回true.
+     */
+    bool Start(Poller* notifyPoller)
+    {
+        if (!poller.IsValid()) {
+            return false;
+        }
+        this->notifyPoller = notifyPoller;
+        isRunning = true;
+        thread = std::thread(&ServerShard::Run, this);
+        return true;
+    }
+
+    /**
+     * 停止这个分片的线程.
+     *
+     * @author daixian
+     * @date 2021/3/22
+     */
+    void Stop()
+    {
+        isRunning = false;
+        if (thread.joinable()) {
+            poller.Wakeup();
+            thread.join();
+        }
+        std::lock_guard<std::recursive_mutex> lock(mut);
+        clients.clear();
+        std::lock_guard<std::mutex> receivedLock(receivedMut);
+        received.Clear();
+        hasReceived.store(false);
+    }
+
+    /**
+     * 添加一个客户端到这个分片.
+     *
+     * @author daixian
+     * @date 2021/3/22
+     *
+     * @param [in] client 客户端.
+     */
+    void Add(TCPClient* client)
+    {
+        std::lock_guard<std::recursive_mutex> lock(mut);
+        clients[client->AcceptID()] = client;
+        client->SetReceiveArena(&receArena);
+        poller.Add(*(Poco::Net::StreamSocket*)client->Socket(), (uint64_t)client->AcceptID());
+    }
+
+    /**
+     * 从这个分片移除一个客户端,在delete客户端之前调用.
+     *
+     * @author daixian
+     * @date 2021/3/22
+     *
+     * @param [in] client 客户端.
+     */
+    void Remove(TCPClient* client)
+    {
+        std::lock_guard<std::recursive_mutex> lock(mut);
+        if (clients.erase(client->AcceptID()) > 0) {
+            poller.Remove(*(Poco::Net::StreamSocket*)client->Socket()); // 已经关闭了的socket会自动移除,这里会失败,没有关系
+        }
+    }
+
+    /**
+     * 取走接收到的所有消息.msgs里原来的消息会被清空,它的内存交给这个线程继续使用.
+     *
+     * @author daixian
+     * @date 2021/3/22
+     *
+     * @param [in,out] msgs 接收到的消息.
+     *
+     * @returns 取到了消息返回true.
+     */
+    bool TakeReceived(ShardReceived& msgs)
+    {
+        msgs.Clear();
+        if (!hasReceived.load()) {
+            return false; // 没有消息的时候不加锁
+        }
+        std::lock_guard<std::mutex> lock(receivedMut);
+        hasReceived.store(false);
+        std::swap(msgs, received);
+        return !msgs.Empty();
+    }
+
+  private:
+    // 这个分片的客户端的就绪通知
+    Poller poller;
+
+    // 接收到消息之后唤醒应用线程
+    Poller* notifyPoller = nullptr;
+
+    std::thread thread;
+
+    std::atomic<bool> isRunning{false};
+
+    // 这个分片的客户端,以TCPClient::AcceptID()为key
+    std::unordered_map<int, TCPClient*> clients;
+
+    // 接收到的还没有被取走的消息,使用自己的锁,应用线程取消息的时候不会等待这个线程的接收
+    ShardReceived received;
+    std::mutex receivedMut;
+
+    // received是否不为空
+    std::atomic<bool> hasReceived{false};
+
+    // 这个线程的所有客户端共用的接收缓存
+    ReceiveArena receArena;
+
+    void Run()
+    {
+        std::vector<uint64_t> readyKeys;
+        std::vector<MessageView> views;
+        ShardReceived reading; // 这一批接收到的消息
+        while (isRunning) {
+            if (poller.Wait(readyKeys, DNET_SERVER_SHARD_WAIT_MS) <= 0) {
+                continue;
+            }
+            MonotonicClock::Refresh(); // 这一批接收的时间
+
+            {
+                std::lock_guard<std::recursive_mutex> lock(mut);
+                receArena.Reset(); // 上一批的消息都已经拷贝出去了
+            }
+            for (size_t i = 0; i < readyKeys.size(); i++) {
+                // 每个客户端单独加锁,应用线程不用等待整批的接收
+                std::lock_guard<std::recursive_mutex> lock(mut);
+                auto itr = clients.find((int)readyKeys[i]);
+                if (itr == clients.end()) {
+                    continue; // 已经被移除了
+                }
+                int res = itr->second->ReadMessages(views);
+                if (res < 0) {
+                    // 断开了的连接不再等待就绪,由应用线程在ProcMessages()里处理错误
+                    poller.Remove(*(Poco::Net::StreamSocket*)itr->second->Socket());
+                }
+                if (res != 0) {
+                    reading.Add(itr->first, views); // 视图在这个客户端的下一次接收之前有效,这里拷贝出来
+                }
+            }
+            if (reading.Empty()) {
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(receivedMut);
+                if (received.Empty()) {
+                    std::swap(received, reading); // 应用线程已经取走了上一批,直接交换
+                }
+                else {
+                    received.Append(reading);
+                }
+                hasReceived.store(true);
+            }
+            reading.Clear();
+            if (notifyPoller != nullptr) {
+                notifyPoller->Wakeup();
+            }
+        }
+    }
+};
+
+} // namespace dnet
@@ -0,0 +1,222 @@
+﻿#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+// id中槽位序号的位数,最多(1<<DNET_SLOT_MAP_INDEX_BITS)个槽位
+#define DNET_SLOT_MAP_INDEX_BITS 20
+
+// 槽位版本号的最大值,id = 版本号 << DNET_SLOT_MAP_INDEX_BITS | 槽位序号,保证id总是正的int
+#define DNET_SLOT_MAP_MAX_GENERATION ((1 << (31 - DNET_SLOT_MAP_INDEX_BITS)) - 1)
+
+namespace dnet {
+
+/**
+ * 带版本号的槽位表.值连续的存放在一个数组里(删除的时候用最后一个填补),
+ * 通过id查找只需要两次数组索引.槽位被重新使用的时候版本号会增加,所以旧的id不会找到新的值.
+ * id总是大于0的.
+ *
+ * @author daixian
+ * @date 2021/3/26
+ *
+ * @tparam T 值的类型.
+ */
+template <class T>
+class SlotMap
+{
+  public:
+    SlotMap() {}
+    ~SlotMap() {}
+
+    /**
+     * 添加一个值.
+     *
+     * @author daixian
+     * @date 2021/3/26
+     *
+     * @param  value 值.
+     *
+     * @returns 分配的id,槽位用完了返回-1.
+     */
+    int Insert(const T& value)
+    {
+        uint32_t slotIndex;
+        if (!freeSlots.empty()) {
+            slotIndex = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else {
+            if (slots.size() >= ((size_t)1 << DNET_SLOT_MAP_INDEX_BITS)) {
+                return -1;
+            }
+            slotIndex = (uint32_t)slots.size();
+            slots.push_back(Slot());
+        }
+        Slot& slot = slots[slotIndex];
+        slot.denseIndex = (int)values.size();
+        int id = (int)((slot.generation << DNET_SLOT_MAP_INDEX_BITS) | slotIndex);
+        values.push_back(value);
+        ids.push_back(id);
+        return id;
+    }
+
+    /**
+     * 查找一个id的值.
+     *
+     * @author daixian
+     * @date 2021/3/26
+     *
+     * @param  id The identifier.
+     *
+     * @returns 找不到(或者id已经过期了)返回null.
+     */
+    T* Get(int id)
+    {
+        int denseIndex = DenseIndex(id);
+        if (denseIndex < 0) {
+            return nullptr;
+        }
+        return &values[denseIndex];
+    }
+
+    /**
+     * 设置一个已经存在的id的值.
+     *
+     * @author daixian
+     * @date 2021/3/26
+     *
+     * @param  id    The identifier.
+     * @param  value 值.
+     *
+     * @returns id不存在返回false.
+     */
+    bool Set(int id, const T& value)
+    {
+        T* ptr = Get(id);
+        if (ptr == nullptr) {
+            return false;
+        }
+        *ptr = value;
+        return true;
+    }
+
+    /**
+     * 删除一个id的值.
+     *
+     * @author daixian
+     * @date 2021/3/26
+     *
+     * @param  id The identifier.
+     *
+     * @returns id不存在返回false.
+     */
+    bool Remove(int id)
+    {
+        int denseIndex = DenseIndex(id);
+        if (denseIndex < 0) {
+            return false;
+        }
+        RemoveAt(denseIndex);
+        return true;
+    }
+
+    /**
+     * 删除连续数组里第denseIndex个值,最后一个值会移动到这个位置,
+     * 所以遍历的时候删除了之后不要增加序号.
+     *
+     * @author daixian
+     * @date 2021/3/26
+     *
+     * @param  denseIndex 在连续数组里的序号.
+     */
+    void RemoveAt(size_t denseIndex)
+    {
+        uint32_t slotIndex = SlotIndex(ids[denseIndex]);
+        size_t last = values.size() - 1;
+        if (denseIndex != last) {
+            values[denseIndex] = std::move(values[last]);
+            ids[denseIndex] = ids[last];
+            slots[SlotIndex(ids[denseIndex])].denseIndex = (int)denseIndex;
+        }
+        values.pop_back();
+        ids.pop_back();
+
+        Slot& slot = slots[slotIndex];
+        slot.denseIndex = -1;
+        slot.generation = slot.generation >= DNET_SLOT_MAP_MAX_GENERATION ? 1 : slot.generation + 1;
+        freeSlots.push_back(slotIndex);
+    }
+
+    // 值的个数.
+    size_t Size() const
+    {
+        return values.size();
+    }
+
+    // 连续数组里的第i个值.
+    T& ValueAt(size_t i)
+    {
+        return values[i];
+    }
+
+    // 连续数组里的第i个值的id.
+    int IdAt(size_t i) const
+    {
+        return ids[i];
+    }
+
+    // 清空,之前的id都会失效.
+    void Clear()
+    {
+        while (!values.empty()) {
+            RemoveAt(values.size() - 1);
+        }
+    }
+
+  private:
+    struct Slot
+    {
+        // 版本号,从1开始
+        uint32_t generation = 1;
+
+        // 值在连续数组里的位置,空的槽位为-1
+        int denseIndex = -1;
+    };
+
+    // 所有槽位
+    std::vector<Slot> slots;
+
+    // 空闲的槽位
+    std::vector<uint32_t> freeSlots;
+
+    // 连续存放的值
+    std::vector<T> values;
+
+    // 每个值的id
+    std::vector<int> ids;
+
+    static uint32_t SlotIndex(int id)
+    {
+        return (uint32_t)id & (((uint32_t)1 << DNET_SLOT_MAP_INDEX_BITS) - 1);
+    }
+
+    // id对应的值在连续数组里的位置,id无效返回-1
+    int DenseIndex(int id) const
+    {
+        if (id <= 0) {
+            return -1;
+        }
+        uint32_t slotIndex = SlotIndex(id);
+        if (slotIndex >= slots.size()) {
+            return -1;
+        }
+        const Slot& slot = slots[slotIndex];
+        if (slot.denseIndex < 0 || ids[slot.denseIndex] != id) {
+            return -1;
+        }
+        return slot.denseIndex;
+    }
+};
+
+} // namespace dnet
@@ -0,0 +1,188 @@
+﻿#include "SocketUtil.h"
+
+#include "Poco/Net/SocketImpl.h"
+#include "Poco/Timespan.h"
+#include "dlog/dlog.h"
+
+#include <algorithm>
+
+#if defined(_WIN32) || defined(_WIN64)
+#    include <winsock2.h>
+#else
+#    include <sys/types.h>
+#    include <sys/socket.h>
+#    include <sys/uio.h>
+#    include <netinet/in.h>
+#    include <netinet/tcp.h>
+#    include <errno.h>
+#endif
+
+// 一次系统调用最多发送的数据段数
+#define DNET_SEND_GATHER_MAX 16
+
+namespace dnet {
+
+int SendGather(Poco::Net::StreamSocket& socket, const SendBuf* bufs, int count, int offset)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    WSABUF vec[DNET_SEND_GATHER_MAX];
+#else
+    struct iovec vec[DNET_SEND_GATHER_MAX];
+#endif
+
+    // 跳过已经发送了的offset个字节
+    int vecCount = 0;
+    for (int i = 0; i < count && vecCount < DNET_SEND_GATHER_MAX; i++) {
+        if (offset >= bufs[i].len) {
+            offset -= bufs[i].len;
+            continue;
+        }
+#if defined(_WIN32) || defined(_WIN64)
+        vec[vecCount].buf = (char*)bufs[i].data + offset;
+        vec[vecCount].len = (ULONG)(bufs[i].len - offset);
+#else
+        vec[vecCount].iov_base = (void*)(bufs[i].data + offset);
+        vec[vecCount].iov_len = (size_t)(bufs[i].len - offset);
+#endif
+        offset = 0;
+        vecCount++;
+    }
+    if (vecCount == 0) {
+        return 0;
+    }
+
+    Poco::Net::poco_socket_t fd = socket.impl()->sockfd();
+
+#if defined(_WIN32) || defined(_WIN64)
+    DWORD sent = 0;
+    if (WSASend(fd, vec, (DWORD)vecCount, &sent, 0, NULL, NULL) == SOCKET_ERROR) {
+        int err = WSAGetLastError();
+        if (err == WSAEWOULDBLOCK) {
+            return 0;
+        }
+        LogE("SocketUtil.SendGather():WSASend错误 err=%d", err);
+        return -1;
+    }
+    return (int)sent;
+#else
+    struct msghdr msg = {};
+    msg.msg_iov = vec;
+    msg.msg_iovlen = vecCount;
+
+#    if defined(MSG_NOSIGNAL)
+    int flags = MSG_NOSIGNAL;
+#    else
+    int flags = 0;
+#    endif
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(fd, &msg, flags);
+    } while (sent < 0 && errno == EINTR);
+
+    if (sent < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        LogE("SocketUtil.SendGather():sendmsg错误 errno=%d", errno);
+        return -1;
+    }
+    return (int)sent;
+#endif
+}
+
+void ApplyTCPOptions(Poco::Net::StreamSocket& socket, const TCPOptions& options)
+{
+    try {
+        socket.setNoDelay(options.noDelay);
+        socket.setReceiveTimeout(Poco::Timespan(options.receiveTimeoutMs / 1000, (options.receiveTimeoutMs % 1000) * 1000));
+        socket.setSendTimeout(Poco::Timespan(options.sendTimeoutMs / 1000, (options.sendTimeoutMs % 1000) * 1000));
+
+#if defined(TCP_QUICKACK)
+        socket.setOption(IPPROTO_TCP, TCP_QUICKACK, options.quickAck ? 1 : 0);
+#endif
+
+#if defined(TCP_CORK)
+        socket.setOption(IPPROTO_TCP, TCP_CORK, options.cork ? 1 : 0);
+#elif defined(TCP_NOPUSH)
+        socket.setOption(IPPROTO_TCP, TCP_NOPUSH, options.cork ? 1 : 0);
+#endif
+    }
+    catch (const Poco::Exception& e) {
+        LogE("SocketUtil.ApplyTCPOptions():异常e=%s,%s", e.what(), e.message().c_str());
+    }
+    catch (const std::exception& e) {
+        LogE("SocketUtil.ApplyTCPOptions():异常e=%s", e.what());
+    }
+}
+
+void ApplyBufferOptions(Poco::Net::Socket& socket, const TCPOptions& options)
+{
+    try {
+        if (options.socketReceiveBufferSize > 0) {
+            socket.setReceiveBufferSize(options.socketReceiveBufferSize);
+        }
+        if (options.socketSendBufferSize > 0) {
+            socket.setSendBufferSize(options.socketSendBufferSize);
+        }
+    }
+    catch (const Poco::Exception& e) {
+        LogE("SocketUtil.ApplyBufferOptions():异常e=%s,%s", e.what(), e.message().c_str());
+    }
+    catch (const std::exception& e) {
+        LogE("SocketUtil.ApplyBufferOptions():异常e=%s", e.what());
+    }
+}
+
+void SetQuickAck(Poco::Net::StreamSocket& socket)
+{
+#if defined(TCP_QUICKACK)
+    int value = 1;
+    setsockopt(socket.impl()->sockfd(), IPPROTO_TCP, TCP_QUICKACK, (const char*)&value, sizeof(value));
+#endif
+}
+
+int ListenQueueLength(const Poco::Net::Socket& socket)
+{
+#if defined(__linux__) && defined(TCP_INFO)
+    // 对监听的socket,tcpi_unacked是当前队列里的连接数,tcpi_sacked是队列的长度
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(socket.impl()->sockfd(), IPPROTO_TCP, TCP_INFO, &info, &len) != 0) {
+        return -1;
+    }
+    return (int)info.tcpi_unacked;
+#else
+    return -1;
+#endif
+}
+
+int SocketRTT(const Poco::Net::Socket& socket)
+{
+#if defined(__linux__) && defined(TCP_INFO)
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(socket.impl()->sockfd(), IPPROTO_TCP, TCP_INFO, &info, &len) != 0) {
+        return -1;
+    }
+    return (int)info.tcpi_rtt;
+#else
+    return -1;
+#endif
+}
+
+int AutoTuneBufferSize(int current, size_t bytes, int64_t elapsedUs, int rttUs, int maxSize)
+{
+    if (current <= 0 || elapsedUs <= 0) {
+        return current;
+    }
+    double rttBytes = (double)bytes * rttUs / elapsedUs; // 一个RTT时间内的数据量
+    int target = current;
+    while (target < rttBytes * 2 && target < maxSize) {
+        target *= 2;
+    }
+    target = std::min(target, maxSize);
+    return std::max(target, current);
+}
+
+} // namespace dnet
@@ -0,0 +1,116 @@
+﻿#pragma once
+
+#include "Poco/Net/StreamSocket.h"
+#include "TCPOptions.h"
+
+#include <cstdint>
+
+namespace dnet {
+
+/**
+ * 一段要发送的数据.
+ *
+ * @author daixian
+ * @date 2021/3/15
+ */
+struct SendBuf
+{
+    // 数据.
+    const char* data;
+
+    // 数据长度.
+    int len;
+};
+
+/**
+ * 把几段数据(通常是协议头和消息内容)用一次系统调用发送出去(sendmsg/WSASend),不需要先把它们拷贝到一起.
+ * 非阻塞的socket可能只发送了一部分.
+ *
+ * @author daixian
+ * @date 2021/3/15
+ *
+ * @param [in] socket The socket.
+ * @param      bufs   要发送的几段数据.
+ * @param      count  数据的段数.
+ * @param      offset 从所有数据拼接起来的第几个字节开始发送.
+ *
+ * @returns 发送了的字节数,socket的发送缓存满了返回0,出错返回-1.
+ */
+int SendGather(Poco::Net::StreamSocket& socket, const SendBuf* bufs, int count, int offset = 0);
+
+/**
+ * 把TCP选项中的Nagle/QUICKACK/CORK策略和超时应用到socket上.socket缓存大小使用ApplyBufferOptions()设置.
+ *
+ * @author daixian
+ * @date 2021/3/16
+ *
+ * @param [in] socket  The socket.
+ * @param      options TCP选项.
+ */
+void ApplyTCPOptions(Poco::Net::StreamSocket& socket, const TCPOptions& options);
+
+/**
+ * 把TCP选项中的socket缓存大小(SO_RCVBUF/SO_SNDBUF)应用到socket上.
+ * TCP的窗口缩放是在握手的时候根据接收缓存决定的,所以要在connect()/listen()之前设置,
+ * 连接建立之后再缩小接收缓存会让吞吐量变得非常低.accept得到的socket继承监听socket的缓存大小.
+ *
+ * @author daixian
+ * @date 2021/3/29
+ *
+ * @param [in] socket  The socket.
+ * @param      options TCP选项.
+ */
+void ApplyBufferOptions(Poco::Net::Socket& socket, const TCPOptions& options);
+
+/**
+ * 重新开启TCP_QUICKACK,内核在一段时间之后会自动关闭它,所以接收之后需要重新设置(只在linux上有效).
+ *
+ * @author daixian
+ * @date 2021/3/16
+ *
+ * @param [in] socket The socket.
+ */
+void SetQuickAck(Poco::Net::StreamSocket& socket);
+
+/**
+ * 监听socket的队列里等待accept的连接数(linux上使用TCP_INFO).
+ *
+ * @author daixian
+ * @date 2021/3/23
+ *
+ * @param  socket 监听的socket.
+ *
+ * @returns 连接数,不支持的平台上返回-1.
+ */
+int ListenQueueLength(const Poco::Net::Socket& socket);
+
+/**
+ * 一个TCP连接的平滑RTT(linux上使用TCP_INFO).
+ *
+ * @author daixian
+ * @date 2021/3/29
+ *
+ * @param  socket 连接的socket.
+ *
+ * @returns RTT的微秒数,不支持的平台上返回-1.
+ */
+int SocketRTT(const Poco::Net::Socket& socket);
+
+/**
+ * 自动调整socket缓存的时候计算一个方向的缓存应该的大小:缓存要放得下两个RTT时间内的数据,
+ * 不够的时候每次翻倍,不超过上限,只扩大不缩小.
+ *
+ * @author daixian
+ * @date 2021/3/29
+ *
+ * @param  current   当前的缓存大小,小于等于0表示使用系统的默认值,不调整.
+ * @param  bytes     这段时间内收发的数据量.
+ * @param  elapsedUs 这段时间的微秒数.
+ * @param  rttUs     RTT的微秒数.
+ * @param  maxSize   缓存的上限.
+ *
+ * @returns 缓存应该的大小,不需要扩大返回current.
+ */
+int AutoTuneBufferSize(int current, size_t bytes, int64_t elapsedUs, int rttUs, int maxSize);
+
+} // namespace dnet
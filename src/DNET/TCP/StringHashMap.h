@@ -0,0 +1,230 @@
+﻿#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+// 哈希表的最小容量
+#define DNET_STRING_HASH_MAP_MIN_CAPACITY 16
+
+namespace dnet {
+
+/**
+ * 以字符串为key的开放寻址(线性探测)哈希表,所有项连续的存放在一个数组里,
+ * 查找时不需要像std::map那样在树的节点之间跳转.用于按uuid查找客户端.
+ *
+ * @author daixian
+ * @date 2021/3/26
+ *
+ * @tparam T 值的类型.
+ */
+template <class T>
+class StringHashMap
+{
+  public:
+    StringHashMap() {}
+    ~StringHashMap() {}
+
+    /**
+     * 查找一个key的值.
+     *
+     * @author daixian
+     * @date 2021/3/26
+     *
+     * @param  key The key.
+     *
+     * @returns 找不到返回null.
+     */
+    T* Find(const std::string& key)
+    {
+        int index = FindIndex(key);
+        if (index < 0) {
+            return nullptr;
+        }
+        return &table[index].value;
+    }
+
+    /**
+     * 设置一个key的值,没有的会添加.
+     *
+     * @author daixian
+     * @date 2021/3/26
+     *
+     * @param  key   The key.
+     * @param  value 值.
+     */
+    void Set(const std::string& key, const T& value)
+    {
+        if ((count + deleted + 1) * 2 > table.size()) {
+            Rehash(count + 1);
+        }
+        size_t hash = Hash(key);
+        size_t mask = table.size() - 1;
+        Entry* tombstone = nullptr;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            Entry& entry = table[i];
+            if (entry.state == STATE_EMPTY) {
+                Entry* target = &entry;
+                if (tombstone != nullptr) {
+                    target = tombstone;
+                    deleted--;
+                }
+                target->state = STATE_USED;
+                target->hash = hash;
+                target->key = key;
+                target->value = value;
+                count++;
+                return;
+            }
+            if (entry.state == STATE_DELETED) {
+                if (tombstone == nullptr) {
+                    tombstone = &entry;
+                }
+            }
+            else if (entry.hash == hash && entry.key == key) {
+                entry.value = value;
+                return;
+            }
+        }
+    }
+
+    /**
+     * 删除一个key.
+     *
+     * @author daixian
+     * @date 2021/3/26
+     *
+     * @param  key The key.
+     *
+     * @returns 删除了的个数.
+     */
+    size_t Erase(const std::string& key)
+    {
+        int index = FindIndex(key);
+        if (index < 0) {
+            return 0;
+        }
+        Entry& entry = table[index];
+        entry.state = STATE_DELETED;
+        entry.key.clear();
+        entry.value = T();
+        count--;
+        deleted++;
+        return 1;
+    }
+
+    // 项的个数.
+    size_t Size() const
+    {
+        return count;
+    }
+
+    // 清空.
+    void Clear()
+    {
+        table.clear();
+        count = 0;
+        deleted = 0;
+    }
+
+    /**
+     * 遍历所有的项,遍历的时候不能修改这个表.
+     *
+     * @author daixian
+     * @date 2021/3/26
+     *
+     * @param  func 对每一项调用func(key, value).
+     */
+    void ForEach(const std::function<void(const std::string&, T&)>& func)
+    {
+        for (Entry& entry : table) {
+            if (entry.state == STATE_USED) {
+                func(entry.key, entry.value);
+            }
+        }
+    }
+
+  private:
+    enum State : uint8_t
+    {
+        STATE_EMPTY = 0,
+        STATE_USED = 1,
+        STATE_DELETED = 2,
+    };
+
+    struct Entry
+    {
+        std::string key;
+        T value = T();
+        size_t hash = 0;
+        State state = STATE_EMPTY;
+    };
+
+    // 容量总是2的幂
+    std::vector<Entry> table;
+
+    // 使用中的项的个数
+    size_t count = 0;
+
+    // 删除了的项(墓碑)的个数
+    size_t deleted = 0;
+
+    static size_t Hash(const std::string& key)
+    {
+        return std::hash<std::string>()(key);
+    }
+
+    // key所在的项的位置,找不到返回-1
+    int FindIndex(const std::string& key) const
+    {
+        if (count == 0) {
+            return -1;
+        }
+        size_t hash = Hash(key);
+        size_t mask = table.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            const Entry& entry = table[i];
+            if (entry.state == STATE_EMPTY) {
+                return -1; // 负载因子不超过一半,总能遇到空位
+            }
+            if (entry.state == STATE_USED && entry.hash == hash && entry.key == key) {
+                return (int)i;
+            }
+        }
+    }
+
+    // 扩大容量(同时清理墓碑),保证放得下minCount个项的时候负载因子不超过一半
+    void Rehash(size_t minCount)
+    {
+        size_t capacity = DNET_STRING_HASH_MAP_MIN_CAPACITY;
+        while (capacity < minCount * 2) {
+            capacity *= 2;
+        }
+        if (capacity < table.size()) {
+            capacity = table.size(); // 只是清理墓碑
+        }
+        std::vector<Entry> oldTable;
+        oldTable.swap(table);
+        table.resize(capacity);
+        count = 0;
+        deleted = 0;
+        size_t mask = capacity - 1;
+        for (Entry& old : oldTable) {
+            if (old.state != STATE_USED) {
+                continue;
+            }
+            size_t i = old.hash & mask;
+            while (table[i].state != STATE_EMPTY) {
+                i = (i + 1) & mask;
+            }
+            table[i].state = STATE_USED;
+            table[i].hash = old.hash;
+            table[i].key.swap(old.key);
+            table[i].value = old.value;
+            count++;
+        }
+    }
+};
+
+} // namespace dnet
@@ -10,16 +10,30 @@
 #include "Poco/UUIDGenerator.h"
 
 #include "ClientManager.h"
+#include "ReceiveBuffer.h"
+#include "ReceiveArena.h"
+#include "SocketUtil.h"
+#include "MonotonicClock.h"
+#include "SendQueue.h"
+#include "BroadcastFrame.h"
+#include "PostedMessage.h"
+#include "MessageDispatcher.h"
 #include "Protocol/FastPacket.h"
+#include "Protocol/CompactPacket.h"
 #include "dlog/dlog.h"
 
 #include <thread>
+#include <chrono>
 
 #include "KCPChannel.h"
 
 #define XUEXUE_TCP_CLIENT_BUFFER_SIZE 8 * 1024
 
-#define XUEXUE_TCP_CLIENT_INTERNAL_CMD_TYPE -1024
+// 自动调整socket缓存的间隔毫秒数
+#define DNET_AUTO_TUNE_INTERVAL_MS 1000
+
+// 得不到RTT的平台上自动调整socket缓存时假定的RTT微秒数
+#define DNET_AUTO_TUNE_DEFAULT_RTT_US 100000
 
 namespace dnet {
 
@@ -28,16 +42,10 @@ class TCPClient::Impl
   public:
     Impl()
     {
-        receBuff.resize(XUEXUE_TCP_CLIENT_BUFFER_SIZE);
-
-        // 随机生成一个uuid
-        Poco::UUIDGenerator uuidGen;
-        uuid = uuidGen.createRandom().toString();
-
         kcpClient = std::shared_ptr<KCPChannel>(new KCPChannel());
 
-        lastTcpReceTime = clock();
-        lastKcpReceTime = clock();
+        lastTcpReceTime = MonotonicClock::Refresh();
+        lastKcpReceTime = lastTcpReceTime;
     }
 
     ~Impl()
@@ -58,7 +66,10 @@ class TCPClient::Impl
     // 一个tcp的ID.
     int tcpID = -1;
 
-    // 这个客户端的唯一标识符
+    // 服务器端accept这个连接时分配的tcpID,断线重连换成之前的tcpID的时候它不变.
+    int acceptID = -1;
+
+    // 这个客户端的唯一标识符,为空表示还没有生成,使用GetUUID()来得到
     std::string uuid;
 
     // 客户端的socket
@@ -70,11 +81,51 @@ class TCPClient::Impl
     // TCP通信协议
     FastPacket packet;
 
+    // 紧凑的TCP通信协议,接收时总是使用它来解包(它兼容FastPacket的帧)
+    CompactPacket compactPacket;
+
+    // 握手协商之后发送是否使用紧凑的协议
+    bool isCompactPacket = false;
+
     // 是否已经连接了
     std::atomic_bool isConnected{false};
 
-    // 接收用的buffer
-    std::vector<char> receBuff;
+    // 是否正在非阻塞的连接
+    bool isConnecting = false;
+
+    // 非阻塞的连接的超时时刻
+    std::chrono::steady_clock::time_point connectDeadline;
+
+    // 自己的接收缓存,Receive得到的消息视图指向这里.第一次接收的时候才创建,
+    // 服务器端的连接只有剩下了不完整的消息的时候才有,从receArena借出.
+    std::unique_ptr<ReceiveBuffer> receBuff;
+
+    // 服务器端接收线程里所有连接共用的接收缓存,为null的时候只使用自己的接收缓存
+    ReceiveArena* receArena = nullptr;
+
+    // 接收时解析得到的消息视图
+    std::vector<MessageView> receViews;
+
+    // 正在分块接收的大消息还剩下的长度
+    int streamRemain = 0;
+
+    // 正在分块接收的大消息的类型
+    int streamType = 0;
+
+    // 待发送的数据队列,Cork()之后发送的消息也都先打包到这里,Uncork()的时候一次发送
+    SendQueue sendQueue;
+
+    // 其它线程投递过来等待发送的消息(本地的客户端)
+    PostQueue postQueue;
+
+    // 当前是否Cork()了
+    bool isCorked = false;
+
+    // 当前发送队列是否超过了高水位
+    bool isBackpressure = false;
+
+    // TCP选项
+    TCPOptions options;
 
     // 接收用的buffer
     std::vector<char> receBuffUDP;
@@ -85,14 +136,20 @@ class TCPClient::Impl
     // 是否已经网络错误了
     bool isError = false;
 
-    // 网络错误的发生时间
-    clock_t errorTime;
+    // 是否正在TCPServer的IO线程里执行ReadMessages(),这时发生的错误推迟到应用线程的ProcMessages()里处理
+    bool isIOThreadRead = false;
+
+    // IO线程里发生了还没有处理的错误
+    bool isPendingError = false;
+
+    // 网络错误的发生时间(MonotonicClock的毫秒数,下同)
+    int64_t errorTime = 0;
 
     // 上一次的TCP消息接收时间
-    clock_t lastTcpReceTime;
+    int64_t lastTcpReceTime = 0;
 
     // 上一次的KCP消息接收时间
-    clock_t lastKcpReceTime;
+    int64_t lastKcpReceTime = 0;
 
     // 所有接受到的消息的总条数
     int receMsgCount = 0;
@@ -100,6 +157,21 @@ class TCPClient::Impl
     // 所有发送的消息的总条数
     int sendMsgCount = 0;
 
+    // 自动调整socket缓存:上一次调整之后接收的字节数
+    size_t tuneReceBytes = 0;
+
+    // 自动调整socket缓存:上一次调整之后发送的字节数
+    size_t tuneSendBytes = 0;
+
+    // 上一次自动调整socket缓存的时间(MonotonicClock的毫秒数)
+    int64_t lastTuneTime = 0;
+
+    // 当前设置的socket接收缓存大小
+    int socketReceBufSize = 0;
+
+    // 当前设置的socket发送缓存大小
+    int socketSendBufSize = 0;
+
     // 用户连接成功的事件.
     Poco::BasicEvent<TCPEventAccept> eventAccept;
 
@@ -109,9 +181,24 @@ class TCPClient::Impl
     // 远程端关闭的事件
     Poco::BasicEvent<TCPEventRemoteClose> eventRemoteClose;
 
+    // 发送队列积压的事件
+    Poco::BasicEvent<TCPEventBackpressure> eventBackpressure;
+
+    // 消息处理函数表(服务器端的客户端使用clientManager里的)
+    MessageDispatcher dispatcher;
+
     // 这个TCP可以附加绑定一个kcp
     std::shared_ptr<KCPChannel> kcpClient{nullptr};
 
+    // 得到uuid,还没有的话随机生成一个(服务器端的客户端一般用不到它)
+    const std::string& GetUUID()
+    {
+        if (uuid.empty()) {
+            uuid = Poco::UUIDGenerator::defaultGenerator().createRandom().toString();
+        }
+        return uuid;
+    }
+
     // 是否是服务端的client
     bool IsInServer()
     {
@@ -144,9 +231,12 @@ class TCPClient::Impl
         Close(); // 先试试无脑关闭
 
         try {
-            LogI("TCPClient.Connect():{%s}尝试连接远程%s:%d", uuid.c_str(), host.c_str(), port);
+            LogI("TCPClient.Connect():{%s}尝试连接远程%s:%d", GetUUID().c_str(), host.c_str(), port);
             Poco::Net::SocketAddress sa(Poco::Net::SocketAddress::Family::IPv4, host, port);
 
+            // socket缓存大小要在握手之前设置
+            socket = Poco::Net::StreamSocket(sa.family());
+            ApplyBufferOptions(socket, options);
             socket.connect(sa); // 这个是阻塞的连接
         }
         catch (Poco::Net::ConnectionRefusedException& e) {
@@ -166,24 +256,126 @@ class TCPClient::Impl
             return -1;
         }
         LogI("TCPClient.Connect():连接成功!");
-        isConnected = true;
+        OnConnected();
+        return 0;
+    }
+
+    /**
+     * 非阻塞的连接主机,连接的完成和握手在之后的Receive()里继续.
+     *
+     * @param  host      The host.
+     * @param  port      The port.
+     * @param  timeoutMs 连接的超时毫秒数.
+     *
+     * @returns 开始连接了返回0.
+     */
+    int ConnectAsync(const std::string& host, int port, int timeoutMs)
+    {
+        if (IsInServer()) {
+            LogE("TCPClient.ConnectAsync():服务器端的Client不应该调用这个函数!");
+            return -1;
+        }
+
+        Close(); // 先试试无脑关闭
+        isError = false;
+
+        try {
+            LogI("TCPClient.ConnectAsync():{%s}尝试连接远程%s:%d", GetUUID().c_str(), host.c_str(), port);
+            Poco::Net::SocketAddress sa(Poco::Net::SocketAddress::Family::IPv4, host, port);
+
+            // socket缓存大小要在握手之前设置
+            socket = Poco::Net::StreamSocket(sa.family());
+            ApplyBufferOptions(socket, options);
+            socket.connectNB(sa); // 非阻塞的连接,立即返回
+        }
+        catch (Poco::Exception& e) {
+            LogE("TCPClient.ConnectAsync():异常:%s,%s", e.what(), e.message().c_str());
+            OnConnectFailed();
+            return -1;
+        }
+        catch (std::exception& e) {
+            LogE("TCPClient.ConnectAsync():异常:%s", e.what());
+            OnConnectFailed();
+            return -1;
+        }
+        isConnecting = true;
+        connectDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        return 0;
+    }
+
+    /**
+     * 检察非阻塞的连接是否完成了,完成了就开始握手.
+     *
+     * @param  timeoutMs 等待连接完成最多的毫秒数.
+     *
+     * @returns 连接完成了返回1,还在连接中返回0,失败了返回-1.
+     */
+    int CheckConnecting(int timeoutMs)
+    {
+        if (!isConnecting) {
+            return isConnected ? 1 : -1;
+        }
 
-        // setopt timeout
-        Timespan timeout3(5000000);
-        socket.setReceiveTimeout(timeout3); // retn void
-        Timespan timeout4(5000000);
-        socket.setSendTimeout(timeout4); // retn void
+        try {
+            auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(connectDeadline - std::chrono::steady_clock::now()).count();
+            if (remain <= 0) {
+                LogE("TCPClient.CheckConnecting():连接超时!");
+                OnConnectFailed();
+                return -1;
+            }
+            int waitMs = (int)std::min((long long)timeoutMs, (long long)remain);
+            if (!socket.poll(Poco::Timespan(waitMs / 1000, (waitMs % 1000) * 1000),
+                             Poco::Net::Socket::SELECT_WRITE | Poco::Net::Socket::SELECT_ERROR)) {
+                return 0;
+            }
+            int err = socket.impl()->socketError();
+            if (err != 0) {
+                LogE("TCPClient.CheckConnecting():连接失败,err=%d", err);
+                OnConnectFailed();
+                return -1;
+            }
+        }
+        catch (Poco::Exception& e) {
+            LogE("TCPClient.CheckConnecting():异常:%s,%s", e.what(), e.message().c_str());
+            OnConnectFailed();
+            return -1;
+        }
+        catch (std::exception& e) {
+            LogE("TCPClient.CheckConnecting():异常:%s", e.what());
+            OnConnectFailed();
+            return -1;
+        }
+
+        LogI("TCPClient.CheckConnecting():连接成功!");
+        isConnecting = false;
+        OnConnected();
+        return 1;
+    }
+
+    // 非阻塞的连接失败了
+    void OnConnectFailed()
+    {
+        isConnecting = false;
+        isError = true;
+        errorTime = MonotonicClock::Refresh();
+        try {
+            socket.close();
+        }
+        catch (const std::exception&) {
+        }
+    }
 
-        // setopt bufsize
-        socket.setReceiveBufferSize(XUEXUE_TCP_CLIENT_BUFFER_SIZE); // buff大小
-        socket.setSendBufferSize(XUEXUE_TCP_CLIENT_BUFFER_SIZE);    // buff大小
+    // 连接成功之后设置socket并且发送认证
+    void OnConnected()
+    {
+        isConnected = true;
 
-        socket.setNoDelay(true);
+        // 超时等都在选项里,缓存大小在连接之前已经设置了
+        ApplyTCPOptions(socket, options);
+        ResetAutoTune();
         socket.setBlocking(false);
 
         SendAccept();
-
-        return 0;
     }
 
     /**
@@ -194,6 +386,14 @@ class TCPClient::Impl
      */
     void Close()
     {
+        if (isConnecting) {
+            isConnecting = false;
+            try {
+                socket.close();
+            }
+            catch (const std::exception&) {
+            }
+        }
         if (isConnected) {
             try {
                 socket.close();
@@ -215,43 +415,325 @@ class TCPClient::Impl
             }
 
             isConnected = false;
+            sendQueue.Clear();
+            isBackpressure = false;
+            if (receBuff != nullptr) {
+                receBuff->Clear();
+            }
+            streamRemain = 0;
+            isCompactPacket = false;
             TCPEventClose evArgs = TCPEventClose();
             eventClose.notify(this, evArgs);
         }
     }
 
     /**
-     * Send this message
+     * 非阻塞的发送一条消息.socket发送缓存满了的时候没有发送出去的部分会追加到发送队列里,
+     * 之后在Receive()或者下一次Send()的时候继续发送,所以这个函数永远不会阻塞.
      *
      * @author daixian
      * @date 2020/12/22
      *
-     * @param  data The data.
-     * @param  len  The length.
+     * @param  data     The data.
+     * @param  len      The length.
+     * @param  type     消息类型.
+     * @param  priority 发送优先级,小于0的时候由消息类型决定.
      *
-     * @returns An int.
+     * @returns 发送或者进入了发送队列的长度(打包后的),失败返回-1,发送队列超过了上限返回-2.
      */
-    int Send(const char* data, size_t len, int type)
+    int Send(const char* data, size_t len, int type, int priority = -1)
     {
         if (!isConnected) {
             return -1;
         }
-        // 数据打包
-        std::vector<char> package;
-        packet.Pack(data, (int)len, package, type);
+        if (options.sendQueueLimit > 0 && sendQueue.Size() >= options.sendQueueLimit) {
+            LogE("TCPClient.Send():tcpID=%d的发送队列已经超过上限%zu,不能再发送!", tcpID, options.sendQueueLimit);
+            return -2;
+        }
+
+        // 只打包协议头,协议头和数据一起发送,不拷贝数据
+        char head[DNET_PACKET_MAX_HEAD_LEN];
+        int headLen = isCompactPacket ? compactPacket.PackHead((int)len, type, head, sizeof(head))
+                                      : packet.PackHead((int)len, type, head, sizeof(head));
         sendMsgCount++; // 计数
 
-        int sendCount = 0;
-        for (size_t i = 0; i < 10; i++) {
-            int res = socket.sendBytes(package.data() + sendCount, (int)package.size() - sendCount); // 发送打包后的数据
-            sendCount += res;
-            if (sendCount == (int)package.size()) {
-                break;
+        SendBuf bufs[2] = {{head, headLen}, {data, (int)len}};
+        return SendBufs(bufs, 2, nullptr, priority < 0 ? TypePriority(type) : priority);
+    }
+
+    /**
+     * 非阻塞的发送一条广播的消息,帧是打包好的并且多个连接共享的,进入发送队列的时候只引用不拷贝.
+     *
+     * @param [in] frame 广播的帧.
+     *
+     * @returns 发送或者进入了发送队列的长度(打包后的),失败返回-1,发送队列超过了上限返回-2.
+     */
+    int SendFrame(BroadcastFrame& frame)
+    {
+        if (!isConnected) {
+            return -1;
+        }
+        if (options.sendQueueLimit > 0 && sendQueue.Size() >= options.sendQueueLimit) {
+            LogE("TCPClient.SendFrame():tcpID=%d的发送队列已经超过上限%zu,不能再发送!", tcpID, options.sendQueueLimit);
+            return -2;
+        }
+        const std::shared_ptr<const std::vector<char>>& packed = frame.Get(isCompactPacket);
+        if (packed == nullptr) {
+            return -1;
+        }
+        sendMsgCount++; // 计数
+
+        SendBuf buf = {packed->data(), (int)packed->size()};
+        return SendBufs(&buf, 1, &packed, TypePriority(frame.Type()));
+    }
+
+    /**
+     * 发送几段数据,发送不完的部分追加到发送队列.
+     *
+     * @param  bufs     几段数据.
+     * @param  count    数据的段数.
+     * @param  frame    不为null的时候数据就是这个共享的帧,追加到发送队列的时候只引用它.
+     * @param  priority 发送优先级.
+     *
+     * @returns 发送或者进入了发送队列的长度,失败返回-1.
+     */
+    int SendBufs(const SendBuf* bufs, int count, const std::shared_ptr<const std::vector<char>>* frame, int priority)
+    {
+        int packLen = 0;
+        for (int i = 0; i < count; i++) {
+            packLen += bufs[i].len;
+        }
+
+        if (isCorked || !sendQueue.Empty()) {
+            // Cork了或者前面还有没发送完的数据,为了保证顺序只能追加到这个优先级的队尾
+            if (frame != nullptr) {
+                sendQueue.Append(*frame, 0, priority);
+            }
+            else {
+                sendQueue.Append(bufs, count, 0, priority);
+            }
+            if (!isCorked || (int)sendQueue.Size() >= options.corkFlushSize) {
+                if (FlushSendQueue() < 0) {
+                    return -1;
+                }
+            }
+        }
+        else {
+            int res = SendGather(socket, bufs, count);
+            if (res < 0) {
+                LogE("TCPClient.Send():发送失败!");
+                OnError();
+                return -1;
+            }
+            tuneSendBytes += res;
+            if (res < packLen) {
+                // 没有发送完的部分追加到发送队列
+                if (frame != nullptr) {
+                    sendQueue.Append(*frame, res, priority);
+                }
+                else {
+                    sendQueue.Append(bufs, count, res, priority);
+                }
+            }
+        }
+
+        CheckBackpressure();
+        if (!isConnected) {
+            return -1; // 可能在事件处理中断开了
+        }
+        return packLen;
+    }
+
+    // 消息类型对应的发送优先级,握手和心跳等内部命令总是最优先的
+    int TypePriority(int type)
+    {
+        if (type == XUEXUE_TCP_CLIENT_INTERNAL_CMD_TYPE) {
+            return DNET_SEND_PRIORITY_HIGH;
+        }
+        if (options.typePriority.empty()) {
+            return DNET_SEND_PRIORITY_NORMAL;
+        }
+        auto itr = options.typePriority.find(type);
+        return itr != options.typePriority.end() ? itr->second : DNET_SEND_PRIORITY_NORMAL;
+    }
+
+    // 发送其它线程投递过来的消息,只发送开始的时候已经在队列里的,不会被投递的线程拖住
+    void SendPosted()
+    {
+        PostedMessage msg;
+        for (size_t count = postQueue.Size(); count > 0 && postQueue.Pop(msg); count--) {
+            if (msg.isKCP) {
+                if (kcpClient != nullptr) {
+                    kcpClient->Send(msg.data.data(), msg.data.size(), msg.type);
+                }
+            }
+            else {
+                Send(msg.data.data(), msg.data.size(), msg.type);
+            }
+        }
+    }
+
+    // 非阻塞的发送发送队列里的数据
+    int FlushSendQueue()
+    {
+        if (sendQueue.Empty()) {
+            return 0;
+        }
+        if (!isConnected) {
+            sendQueue.Clear();
+            return -1;
+        }
+        int res = sendQueue.Flush(socket);
+        if (res < 0) {
+            LogE("TCPClient.FlushSendQueue():发送失败!");
+            OnError();
+            return -1;
+        }
+        tuneSendBytes += res;
+        CheckBackpressure();
+        return res;
+    }
+
+    // 不接收数据的更新:检察心跳,继续发送发送队列里没有发送完的数据
+    int Update()
+    {
+        if (!IsInServer()) {
+            MonotonicClock::Refresh(); // 服务器端的时钟由TCPServer每一轮更新一次
+        }
+        if (isConnecting) {
+            return CheckConnecting(0) < 0 ? -1 : 0;
+        }
+        if (!isConnected) {
+            return -1;
+        }
+        if (!IsInServer() && CheckHeartbeat() < 0) {
+            return -1; // 服务器端的心跳由TCPServer的定时器检察
+        }
+        SendPosted();
+        if (!isCorked && FlushSendQueue() < 0) {
+            return -1;
+        }
+        AutoTune();
+        return 0;
+    }
+
+    // 重新开始自动调整socket缓存,socket缓存的大小是选项里的值
+    void ResetAutoTune()
+    {
+        tuneReceBytes = 0;
+        tuneSendBytes = 0;
+        lastTuneTime = MonotonicClock::Refresh();
+        socketReceBufSize = options.socketReceiveBufferSize;
+        socketSendBufSize = options.socketSendBufferSize;
+    }
+
+    // 根据观测到的吞吐量和RTT自动扩大socket缓存:缓存要放得下两个RTT时间内的数据,
+    // 否则吞吐量会被缓存大小限制住,这时候每次调整缓存都会翻倍.
+    void AutoTune()
+    {
+        if (!options.autoTuneBuffer || !isConnected) {
+            return;
+        }
+        int64_t now = MonotonicClock::NowMs();
+        int64_t elapsedUs = (now - lastTuneTime) * 1000;
+        if (elapsedUs < DNET_AUTO_TUNE_INTERVAL_MS * 1000) {
+            return;
+        }
+
+        int rttUs = SocketRTT(socket);
+        if (rttUs <= 0) {
+            rttUs = DNET_AUTO_TUNE_DEFAULT_RTT_US;
+        }
+        socketReceBufSize = TuneBufferSize(socketReceBufSize, tuneReceBytes, elapsedUs, rttUs, true);
+        socketSendBufSize = TuneBufferSize(socketSendBufSize, tuneSendBytes, elapsedUs, rttUs, false);
+        tuneReceBytes = 0;
+        tuneSendBytes = 0;
+        lastTuneTime = now;
+    }
+
+    // 计算一个方向的socket缓存应该的大小,比当前的大那么设置它,返回设置之后的大小
+    int TuneBufferSize(int current, size_t bytes, int64_t elapsedUs, int rttUs, bool isReceive)
+    {
+        int target = AutoTuneBufferSize(current, bytes, elapsedUs, rttUs, options.autoTuneMaxBufferSize);
+        if (target <= current) {
+            return current;
+        }
+        try {
+            if (isReceive) {
+                socket.setReceiveBufferSize(target);
+            }
+            else {
+                socket.setSendBufferSize(target);
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(100)); // 如果不能完整发送那么就休息100ms
+            LogI("TCPClient.AutoTune():tcpID=%d的socket%s缓存扩大到%d,RTT=%dus", tcpID, isReceive ? "接收" : "发送", target, rttUs);
+            return target;
+        }
+        catch (const Poco::Exception& e) {
+            LogE("TCPClient.AutoTune():异常e=%s,%s", e.what(), e.message().c_str());
+        }
+        catch (const std::exception& e) {
+            LogE("TCPClient.AutoTune():异常e=%s", e.what());
+        }
+        return current;
+    }
+
+    // 检察发送队列是否越过了高低水位
+    void CheckBackpressure()
+    {
+        size_t size = sendQueue.Size();
+        if (!isBackpressure && size > options.sendQueueHighWater) {
+            isBackpressure = true;
+            NotifyBackpressure(size, true);
+        }
+        else if (isBackpressure && size <= options.sendQueueLowWater) {
+            isBackpressure = false;
+            NotifyBackpressure(size, false);
+        }
+    }
+
+    // 发出发送队列积压的事件,事件处理中可以要求断开这个连接
+    void NotifyBackpressure(size_t size, bool isHigh)
+    {
+        TCPEventBackpressure evArgs = TCPEventBackpressure(tcpID, size, isHigh);
+        eventBackpressure.notify(this, evArgs);
+        if (clientManager != nullptr && clientManager->eventBackpressure != nullptr) {
+            clientManager->eventBackpressure->notify(this, evArgs);
+        }
+        if (evArgs.disconnect) {
+            LogW("TCPClient.NotifyBackpressure():tcpID=%d的发送队列积压%zu,断开连接!", tcpID, size);
+            OnError();
         }
+    }
+
+    // 开始攒发送数据
+    void Cork()
+    {
+        isCorked = true;
+    }
 
-        return sendCount;
+    // 停止攒发送数据,并且把攒下的数据一次发送出去
+    int Uncork()
+    {
+        isCorked = false;
+        return FlushSendQueue();
+    }
+
+    // 设置TCP选项,如果已经连接了那么立即应用到socket
+    void SetOptions(const TCPOptions& opt)
+    {
+        // 连接之后缩小socket缓存会让吞吐量变得很低,所以只在缓存大小改变了的时候才重新设置
+        bool isBufferChanged = opt.socketReceiveBufferSize != options.socketReceiveBufferSize ||
+                               opt.socketSendBufferSize != options.socketSendBufferSize;
+        options = opt;
+        packet.SetMaxMessageSize(options.maxMessageSize);
+        compactPacket.SetMaxMessageSize(options.maxMessageSize);
+        if (isConnected) {
+            ApplyTCPOptions(socket, options);
+            if (isBufferChanged) {
+                ApplyBufferOptions(socket, options);
+            }
+            ResetAutoTune();
+        }
     }
 
     // 发送认证
@@ -262,30 +744,90 @@ class TCPClient::Impl
         }
 
         acceptData = new Accept();
-        std::string acceptStr = acceptData->CreateAcceptString(uuid, name); // 创建一个认证的自字符串发给服务器
+        int supportPacket = options.compactPacket ? DNET_ACCEPT_PACKET_COMPACT : DNET_ACCEPT_PACKET_FAST;
+        std::string acceptStr = acceptData->CreateAcceptString(GetUUID(), name, supportPacket); // 创建一个认证的自字符串发给服务器
         return Send(acceptStr.c_str(), acceptStr.size(), XUEXUE_TCP_CLIENT_INTERNAL_CMD_TYPE);
     }
 
-    // 使用所有接受到的消息然后过滤其中的CMD消息执行,擦除CMD消息
-    template <typename T>
-    int ProcCMD(std::vector<Message<T>>& msgs)
+    // 当前使用的消息处理函数表,服务器端的客户端使用TCPServer的
+    MessageDispatcher& Dispatcher()
     {
-        // 遍历所有收到的消息
-        for (size_t msgIndex = 0; msgIndex < msgs.size();) {
-            if (msgs[msgIndex].type == XUEXUE_TCP_CLIENT_INTERNAL_CMD_TYPE) {
+        if (IsInServer()) {
+            return clientManager->dispatcher;
+        }
+        return dispatcher;
+    }
+
+    // 分发接收到的消息:CMD消息直接执行,注册了处理函数的消息交给处理函数,
+    // 剩下的消息原地前移保留在msgs里,整个过程只遍历一次.
+    int ProcCMD(std::vector<MessageView>& msgs)
+    {
+        MessageDispatcher& handlers = Dispatcher();
+        size_t remain = 0;
+        for (size_t msgIndex = 0; msgIndex < msgs.size(); msgIndex++) {
+            const MessageView& msg = msgs[msgIndex];
+            if (msg.type == XUEXUE_TCP_CLIENT_INTERNAL_CMD_TYPE) {
                 // 命令消息:0号命令
-                std::string acceptStr = msgs[msgIndex].to_string();
+                std::string acceptStr = msg.to_string();
                 ProcCMDAccept(acceptStr);
+                continue;
+            }
+            if (handlers.Dispatch(tcpID, msg)) {
+                continue;
+            }
+            if (remain != msgIndex) {
+                msgs[remain] = msg;
+            }
+            remain++;
+        }
+        msgs.resize(remain);
+        return (int)remain;
+    }
 
-                // 移除这个命令消息
-                msgs.erase(msgs.begin() + msgIndex);
+    // 分发KCP接收到的消息视图,没有处理函数的消息保留在msgs里
+    int ProcKCPMessages(std::vector<MessageView>& msgs)
+    {
+        MessageDispatcher& handlers = Dispatcher();
+        if (handlers.Count() == 0) {
+            return (int)msgs.size();
+        }
+        size_t remain = 0;
+        for (size_t msgIndex = 0; msgIndex < msgs.size(); msgIndex++) {
+            if (handlers.Dispatch(tcpID, msgs[msgIndex])) {
+                continue;
             }
-            else {
-                msgIndex++;
+            if (remain != msgIndex) {
+                msgs[remain] = msgs[msgIndex];
             }
+            remain++;
         }
+        msgs.resize(remain);
+        return (int)remain;
+    }
 
-        return (int)msgs.size();
+    // 分发KCP接收到的消息,没有处理函数的消息保留在msgs里
+    int ProcKCPMessages(std::vector<TextMessage>& msgs)
+    {
+        MessageDispatcher& handlers = Dispatcher();
+        if (handlers.Count() == 0) {
+            return (int)msgs.size();
+        }
+        size_t remain = 0;
+        for (size_t msgIndex = 0; msgIndex < msgs.size(); msgIndex++) {
+            MessageView view;
+            view.type = msgs[msgIndex].type;
+            view.data = msgs[msgIndex].data.data();
+            view.len = (int)msgs[msgIndex].data.size();
+            if (handlers.Dispatch(tcpID, view)) {
+                continue;
+            }
+            if (remain != msgIndex) {
+                msgs[remain] = std::move(msgs[msgIndex]);
+            }
+            remain++;
+        }
+        msgs.resize(remain);
+        return (int)remain;
     }
 
     // 处理accept字符串消息
@@ -302,10 +844,12 @@ class TCPClient::Impl
             else {
                 // 重新指向分配过的tcpID,这里clientManager会发出事件
                 clientManager->RegisterClientWithUUID(acceptData->uuidC, tcpID); // 这个函数会重新分配tcpID
-                std::string replyStr = acceptData->ReplyAcceptString(acceptStr, uuid, name, tcpID);
+                int supportPacket = options.compactPacket ? DNET_ACCEPT_PACKET_COMPACT : DNET_ACCEPT_PACKET_FAST;
+                std::string replyStr = acceptData->ReplyAcceptString(acceptStr, clientManager->uuid, name, tcpID, supportPacket);
                 poco_assert(!replyStr.empty());
-                // replyStr有内容,有效的认证信息,自己是服务器端
+                // replyStr有内容,有效的认证信息,自己是服务器端.回复还是用FastPacket发送,之后才切换协议
                 Send(replyStr.c_str(), replyStr.size(), XUEXUE_TCP_CLIENT_INTERNAL_CMD_TYPE);
+                isCompactPacket = acceptData->packet == DNET_ACCEPT_PACKET_COMPACT;
 
                 LogI("TCPClient.ProcAccept():添加了一个新客户端%s,Addr=%s:%d,分配conv=%d",
                      acceptData->uuidC.c_str(),
@@ -320,6 +864,8 @@ class TCPClient::Impl
 
                 poco_assert(clientManager != nullptr);
                 kcpClient->isServer = true;
+                kcpClient->isCompactPacket = isCompactPacket;
+                kcpClient->sharedReceBuf = &clientManager->kcpReceBuf;
                 kcpClient->Bind(clientManager->acceptUDPSocket, socket.peerAddress());
             }
         }
@@ -327,6 +873,7 @@ class TCPClient::Impl
             // 自己是客户端
             if (acceptData->VerifyReplyAccept(acceptStr.data())) {
                 tcpID = acceptData->conv;
+                isCompactPacket = acceptData->packet == DNET_ACCEPT_PACKET_COMPACT;
 
                 // 服务器返回的Accept验证成功
                 poco_assert(acceptData->conv >= 0);
@@ -337,6 +884,7 @@ class TCPClient::Impl
                 }
                 InitUDPSocket();
                 kcpClient->isServer = false;
+                kcpClient->isCompactPacket = isCompactPacket;
                 kcpClient->Bind(udpSocket, socket.peerAddress());
                 TCPEventAccept evArgs = TCPEventAccept(tcpID, acceptData);
                 eventAccept.notify(this, evArgs);
@@ -353,10 +901,12 @@ class TCPClient::Impl
             delete udpSocket;
         }
 
+        // 一次只接收一个数据报,所以UDP的用户态缓存只需要放得下一个KCP的数据包,不使用receiveBufferSize
         receBuffUDP.resize(XUEXUE_TCP_CLIENT_BUFFER_SIZE);
         try {
             udpSocket = new Poco::Net::DatagramSocket(socket.address());
             udpSocket->setBlocking(false);
+            ApplyBufferOptions(*udpSocket, options);
         }
         catch (const Poco::Exception& e) {
             LogE("TCPClient.InitUDPSocket():异常e=%s,%s", e.what(), e.message().c_str());
@@ -375,45 +925,173 @@ class TCPClient::Impl
         return socket.available();
     }
 
+    // 等待socket可读,有数据了立即返回
+    int WaitAvailable(int timeoutMs)
+    {
+        if (isConnecting) {
+            // 还在连接中,那么等待连接完成
+            return CheckConnecting(timeoutMs) < 0 ? -1 : 0;
+        }
+        if (!isConnected) {
+            return -1;
+        }
+        try {
+            int res = socket.available();
+            if (res > 0 || timeoutMs <= 0) {
+                return res;
+            }
+            socket.poll(Poco::Timespan(timeoutMs / 1000, (timeoutMs % 1000) * 1000), Poco::Net::Socket::SELECT_READ);
+            return socket.available();
+        }
+        catch (const Poco::Exception& e) {
+            LogE("TCPClient.WaitAvailable():异常e=%s,%s", e.what(), e.message().c_str());
+        }
+        catch (const std::exception& e) {
+            LogE("TCPClient.WaitAvailable():异常e=%s", e.what());
+        }
+        OnError();
+        return -1;
+    }
+
     /**
-     * Receives the given msgs
+     * 从socket接收数据到接收缓存,然后解析出所有完整消息的视图.
+     * 上一次Receive得到的消息视图在这里失效.
      *
-     * @tparam T 一条消息的类型为std::string或者std::vector<char>.
-     * @param [out] msgs  The msgs.
-     * @param [out] types 消息的类型.
+     * @param [out] msgs 消息视图,指向receBuff.
      *
      * @returns 接收到的数据条数.
      */
-    template <typename T>
-    int Receive(std::vector<Message<T>>& msgs)
+    int Receive(std::vector<MessageView>& msgs)
     {
         msgs.clear();
+        if (!IsInServer()) {
+            MonotonicClock::Refresh(); // 本地的客户端每一轮循环调用一次Receive(),在这里更新时钟
+        }
 
+        if (isConnecting && CheckConnecting(0) <= 0) {
+            return isConnecting ? 0 : -1; // 还在连接中没有数据
+        }
         if (!isConnected) {
             return -1;
         }
 
-        // 在这里检察一下心跳
-        CheckHeartbeat();
+        // 在这里检察一下心跳,服务器端的心跳由TCPServer的定时器检察
+        if (!IsInServer() && CheckHeartbeat() < 0) {
+            return -1;
+        }
+        SendPosted();
 
         if (socket.poll(Poco::Timespan(0), Poco::Net::Socket::SelectMode::SELECT_ERROR)) {
             LogE("TCPClient.Receive():poll到了异常!");
             OnError();
             return -1; // Close之后socket没了,不能往下执行了
         }
+
+        // 继续发送之前没有发送完的数据
+        if (!isCorked && FlushSendQueue() < 0) {
+            return -1;
+        }
+
+        ReadSocket(msgs);
+        AutoTune();
+        return ProcCMD(msgs);
+    }
+
+    // 从socket接收数据到接收缓存,然后解包,不处理CMD消息
+    void ReadSocket(std::vector<MessageView>& msgs)
+    {
+        msgs.clear();
+
+        if (receArena != nullptr && (receBuff == nullptr || receBuff->ReadableSize() == 0)) {
+            // 上一次没有剩下不完整的消息,自己的缓存还回去,直接接收到共用的缓存里
+            if (receBuff != nullptr) {
+                receArena->ReleaseBuffer(receBuff);
+            }
+            ReadSocketShared(msgs);
+            return;
+        }
+        if (receBuff == nullptr) {
+            receBuff.reset(new ReceiveBuffer(ReceiveSize()));
+        }
+
+        // 丢弃上一次已经解析过的数据,如果剩下的不完整消息比缓存还大那么扩大缓存(分块接收的大消息不扩大)
+        int frameLen = streamRemain > 0 ? -1 : compactPacket.PeekFrameLength(receBuff->ReadPtr(), receBuff->ReadableSize());
+        ReserveFrame(frameLen);
+
+        int res = ReceiveBytes(receBuff->WritePtr(), receBuff->WritableSize());
+        receBuff->Commit(res);
+
+        // 缓存满了没有读完的数据留到下一次Receive
+        int used = UnpackView(receBuff->ReadPtr(), receBuff->ReadableSize(), msgs);
+        receBuff->Consume(used);
+        receMsgCount += (int)msgs.size();
+    }
+
+    // 接收到共用的缓存里然后解包,剩下的不完整的消息拷贝到借来的自己的缓存里
+    void ReadSocketShared(std::vector<MessageView>& msgs)
+    {
+        int size = ReceiveSize();
+        char* buff = receArena->Prepare(size);
+        int count = ReceiveBytes(buff, size);
+        int used = UnpackView(buff, count, msgs);
+        receArena->Commit(used);
+        if (used < count) {
+            receBuff = receArena->AcquireBuffer(size);
+            ReserveFrame(compactPacket.PeekFrameLength(buff + used, count - used));
+            memcpy(receBuff->WritePtr(), buff + used, count - used);
+            receBuff->Commit(count - used);
+        }
+        receMsgCount += (int)msgs.size();
+    }
+
+    // 一次从socket接收的长度
+    int ReceiveSize()
+    {
+        if (options.receiveBufferSize <= 0) {
+            return XUEXUE_TCP_CLIENT_BUFFER_SIZE;
+        }
+        return std::min(options.receiveBufferSize, DNET_RECEIVE_ARENA_BLOCK_SIZE);
+    }
+
+    // 如果剩下的不完整消息比缓存还大那么扩大缓存(分块接收的大消息不扩大),同时丢弃已经解析过的数据.
+    // 消息头里的长度是对方给的不可信(只检查过不超过maxMessageSize),所以缓存只在快被实际收到的数据填满时成倍扩大,
+    // 不会只凭一个消息头就分配整条消息的长度
+    void ReserveFrame(int frameLen)
+    {
+        if (frameLen > 0 && (options.streamThreshold <= 0 || frameLen <= options.streamThreshold)) {
+            size_t grow = std::max(receBuff->Capacity(), (size_t)receBuff->ReadableSize() * 2);
+            receBuff->Reserve(std::min((size_t)frameLen, grow));
+        }
+        else {
+            receBuff->Compact();
+        }
+    }
+
+    // 从socket接收数据直到buff满了或者没有数据了,返回接收到的长度.
+    // 没有数据但是socket可读说明对方关闭了连接,这时recv()返回0,调用OnError()
+    int ReceiveBytes(char* buff, int len)
+    {
+        int count = 0;
         try {
-            while (true) {
-                if (socket.available() > 0) {
-                    int res = socket.receiveBytes(receBuff.data(), (int)receBuff.size());
-                    if (res <= 0) {
-                        break;
-                    }
-                    receMsgCount += packet.Unpack(receBuff.data(), res, msgs);
-                    lastTcpReceTime = clock();
+            while (count < len) {
+                if (socket.available() == 0 && (count > 0 || !socket.poll(Poco::Timespan(0), Poco::Net::Socket::SELECT_READ))) {
+                    break;
                 }
-                else {
+                int res = socket.receiveBytes(buff + count, len - count);
+                if (res == 0) {
+                    LogI("TCPClient.Receive():tcpID=%d的连接已经被对方关闭!", tcpID);
+                    OnError();
                     break;
                 }
+                if (res < 0) {
+                    break;
+                }
+                count += res;
+                tuneReceBytes += res;
+                lastTcpReceTime = MonotonicClock::NowMs();
+                if (options.quickAck) {
+                    SetQuickAck(socket); // 内核会自动关闭quickack,所以每次接收之后重新设置
+                }
             }
         }
         catch (const Poco::Exception& e) {
@@ -424,7 +1102,137 @@ class TCPClient::Impl
             LogE("TCPClient.Receive():异常e=%s", e.what());
             OnError();
         }
+        return count;
+    }
+
+    /**
+     * TCPServer的IO线程使用的接收:只从socket接收和解包,不检察心跳,不发送数据,
+     * 也不处理CMD消息(由ProcMessages()在应用线程处理).
+     * 这里发生的错误只是记录下来,由应用线程的ProcMessages()调用OnError()发出关闭的事件.
+     *
+     * @param [out] msgs 解包得到的消息视图,在这个客户端的下一次接收之前有效.
+     *
+     * @returns 接收到的数据条数,连接断开了返回-1(msgs里仍然可能有断开之前收到的消息).
+     */
+    int ReadMessages(std::vector<MessageView>& msgs)
+    {
+        msgs.clear();
+        if (!isConnected || isPendingError) {
+            return -1;
+        }
+
+        isIOThreadRead = true;
+        try {
+            if (socket.available() == 0) {
+                // 通知了可读但是没有数据,说明对方关闭了连接或者出错了
+                LogI("TCPClient.ReadMessages():tcpID=%d的连接已经断开!", tcpID);
+                OnError();
+            }
+        }
+        catch (const std::exception& e) {
+            LogE("TCPClient.ReadMessages():异常e=%s", e.what());
+            OnError();
+        }
+
+        if (!isPendingError) {
+            ReadSocket(msgs);
+        }
+        isIOThreadRead = false;
+        return isPendingError ? -1 : (int)msgs.size();
+    }
+
+    // 在应用线程处理ReadMessages()得到的消息,然后处理IO线程里发生的错误
+    int ProcMessages(std::vector<MessageView>& msgs)
+    {
+        int res = ProcCMD(msgs);
+        if (isPendingError) {
+            isPendingError = false;
+            if (!isError) {
+                OnError(); // 应用线程里的发送可能已经先发现了错误
+            }
+        }
+        return res;
+    }
+
+    /**
+     * 解包接收缓存里的数据.超过options.streamThreshold的不完整的消息会分块的交给用户,
+     * 这样不管消息多大,接收缓存都不需要扩大到整条消息的长度.
+     *
+     * @param       buff  接收缓存里的数据.
+     * @param       count 数据长度.
+     * @param [out] msgs  解包得到的消息视图.
+     *
+     * @returns 消费了的数据长度.
+     */
+    int UnpackView(const char* buff, int count, std::vector<MessageView>& msgs)
+    {
+        int used = 0;
+        while (used < count) {
+            if (streamRemain > 0) {
+                // 接着上一次的大消息继续分块
+                int len = std::min(streamRemain, count - used);
+                streamRemain -= len;
+                AddChunk(msgs, buff + used, len, streamRemain > 0 ? DNET_MESSAGE_CHUNK_MIDDLE : DNET_MESSAGE_CHUNK_LAST);
+                used += len;
+                continue;
+            }
+
+            used += compactPacket.UnpackView(buff + used, count - used, msgs);
+            if (used >= count || options.streamThreshold <= 0) {
+                break;
+            }
+
+            // 剩下的是一条不完整的消息,如果它足够大那么开始分块
+            int len;
+            int type;
+            int headLen = compactPacket.PeekHead(buff + used, count - used, len, type);
+            if (headLen <= 0 || headLen + len <= options.streamThreshold) {
+                break;
+            }
+            used += headLen;
+            streamType = type;
+            streamRemain = len - (count - used);
+            AddChunk(msgs, buff + used, count - used, DNET_MESSAGE_CHUNK_FIRST);
+            used = count;
+        }
+        return used;
+    }
+
+    // 添加一个大消息的分块
+    void AddChunk(std::vector<MessageView>& msgs, const char* data, int len, int chunk)
+    {
+        msgs.emplace_back();
+        MessageView& view = msgs.back();
+        view.type = streamType;
+        view.data = data;
+        view.len = len;
+        view.chunk = chunk;
+    }
 
+    /**
+     * Receives the given msgs
+     *
+     * @tparam T 一条消息的类型为std::string或者std::vector<char>.
+     * @param [out] msgs  The msgs.
+     *
+     * @returns 接收到的数据条数.
+     */
+    template <typename T>
+    int Receive(std::vector<Message<T>>& msgs)
+    {
+        msgs.clear();
+
+        int res = Receive(receViews);
+        if (res < 0) {
+            return res;
+        }
+
+        msgs.resize(receViews.size());
+        for (size_t i = 0; i < receViews.size(); i++) {
+            msgs[i].type = receViews[i].type;
+            msgs[i].chunk = receViews[i].chunk;
+            msgs[i].data.assign(receViews[i].data, receViews[i].data + receViews[i].len);
+        }
         return (int)msgs.size();
     }
 
@@ -436,13 +1244,15 @@ class TCPClient::Impl
 
         if (udpSocket != nullptr) {
             // 这是本地的client
+            MonotonicClock::Refresh();
             try {
                 // socket尝试接收
                 Poco::Net::SocketAddress remote(Poco::Net::AddressFamily::IPv4);
                 int n = udpSocket->receiveFrom(receBuffUDP.data(), (int)receBuffUDP.size(), remote);
                 int res = kcpClient->IKCPRecv(receBuffUDP.data(), n, msgs);
                 if (res > 0) {
-                    lastKcpReceTime = clock();
+                    lastKcpReceTime = MonotonicClock::NowMs();
+                    res = ProcKCPMessages(msgs);
                 }
                 return res;
             }
@@ -462,12 +1272,14 @@ class TCPClient::Impl
         return -1;
     }
 
-    int KCPReceive(const char* data, size_t len, std::vector<TextMessage>& msgs)
+    template <typename TMsg>
+    int KCPReceive(const char* data, size_t len, std::vector<TMsg>& msgs)
     {
         // 实际上此时如果是TCPServer那么已经由TCPServer的函数中调用了一次Socket接收,所以这里直接送数据.
         int res = kcpClient->IKCPRecv(data, len, msgs);
         if (res > 0) {
-            lastKcpReceTime = clock();
+            lastKcpReceTime = MonotonicClock::NowMs();
+            res = ProcKCPMessages(msgs);
         }
         return res;
     }
@@ -475,39 +1287,141 @@ class TCPClient::Impl
     // 发生错误之后执行这个
     void OnError()
     {
+        if (isIOThreadRead) {
+            // 关闭的事件要在应用线程里发出
+            isPendingError = true;
+            return;
+        }
         isError = true;
-        errorTime = clock();
+        errorTime = MonotonicClock::Refresh();
         TCPEventRemoteClose evArgs = TCPEventRemoteClose(tcpID);
         eventRemoteClose.notify(this, evArgs);
         Close();
+        if (clientManager != nullptr) {
+            clientManager->ReportError(tcpID); // TCPServer会在一段时间之后删除它
+        }
+    }
+
+    // 从time(MonotonicClock的毫秒数)到现在的秒数
+    static float SecondsToNow(int64_t time)
+    {
+        return (MonotonicClock::NowMs() - time) / 1000.0f;
     }
 
     // 上次发生错误到现在的时间
     float TimeFormErrorToNow()
     {
-        return (float)(clock() - errorTime) / CLOCKS_PER_SEC;
+        return SecondsToNow(errorTime);
     }
 
     // 上次接收到TCP消息的时间
     float TimeFormTCPReceToNow()
     {
-        return (float)(clock() - lastTcpReceTime) / CLOCKS_PER_SEC;
+        return SecondsToNow(lastTcpReceTime);
     }
 
     // 上次接收到KCP消息的时间
     float TimeFormKCPRecetoNow()
     {
-        return (float)(clock() - lastKcpReceTime) / CLOCKS_PER_SEC;
+        return SecondsToNow(lastKcpReceTime);
     }
 
-    // 检察心跳来看看是否已经长时间没有收到消息了
-    void CheckHeartbeat()
+    /**
+     * 关闭并且重置所有的状态,保留接收缓存和kcp对象(kcp对象也重置)以便重新使用.
+     *
+     * @author daixian
+     * @date 2021/3/27
+     */
+    void Reset()
     {
-        if (TimeFormTCPReceToNow() > 600 &&
-            TimeFormKCPRecetoNow() > 600) {
+        Close();
+
+        clientManager = nullptr;
+        tcpID = -1;
+        acceptID = -1;
+        uuid.clear();
+        isConnecting = false;
+
+        // 接收过大消息的缓存扩大过,回收的时候不保留那么多内存.
+        // 这里可能不在接收线程里,所以借来的缓存不还给receArena
+        if (receBuff != nullptr && (receArena != nullptr || receBuff->Capacity() > XUEXUE_TCP_CLIENT_BUFFER_SIZE)) {
+            receBuff.reset();
+        }
+        if (receBuff != nullptr) {
+            receBuff->Clear();
+        }
+        receArena = nullptr;
+        receViews.clear();
+        streamRemain = 0;
+        streamType = 0;
+        sendQueue.Clear();
+        postQueue.Clear();
+        isCorked = false;
+        isBackpressure = false;
+        isCompactPacket = false;
+
+        delete acceptData;
+        acceptData = nullptr;
+
+        isError = false;
+        isIOThreadRead = false;
+        isPendingError = false;
+        lastTcpReceTime = MonotonicClock::Refresh();
+        lastKcpReceTime = lastTcpReceTime;
+        receMsgCount = 0;
+        sendMsgCount = 0;
+
+        eventAccept.clear();
+        eventClose.clear();
+        eventRemoteClose.clear();
+        eventBackpressure.clear();
+        dispatcher = MessageDispatcher();
+
+        if (kcpClient == nullptr) {
+            kcpClient = std::shared_ptr<KCPChannel>(new KCPChannel());
+        }
+        else {
+            kcpClient->Reset();
+        }
+    }
+
+    // 这个连接当前占用的内存(估计值)
+    size_t MemoryUsage()
+    {
+        size_t size = sizeof(TCPClient) + sizeof(Impl);
+        if (receBuff != nullptr) {
+            size += sizeof(ReceiveBuffer) + receBuff->Capacity();
+        }
+        size += receViews.capacity() * sizeof(MessageView);
+        size += receBuffUDP.capacity();
+        size += sendQueue.Size();
+        if (acceptData != nullptr) {
+            size += sizeof(Accept);
+        }
+        if (kcpClient != nullptr) {
+            size += kcpClient->MemoryUsage();
+        }
+        return size;
+    }
+
+    /**
+     * 检察心跳来看看是否已经长时间没有收到消息了,超时了会当作网络错误关闭.
+     *
+     * @returns 距离超时还有多少毫秒,不检察心跳返回0,已经超时了返回-1.
+     */
+    int CheckHeartbeat()
+    {
+        if (options.heartbeatTimeoutMs <= 0 || !isConnected) {
+            return 0;
+        }
+        int64_t lastReceTime = lastTcpReceTime > lastKcpReceTime ? lastTcpReceTime : lastKcpReceTime;
+        int64_t idleMs = MonotonicClock::NowMs() - lastReceTime;
+        if (idleMs >= options.heartbeatTimeoutMs) {
             LogE("TCPClient.CheckHeartbeat():tcpID=%d的客户端长时间未收到消息...", tcpID);
             OnError();
+            return -1;
         }
+        return (int)(options.heartbeatTimeoutMs - idleMs);
     }
 };
 
@@ -521,33 +1435,31 @@ TCPClient::~TCPClient()
 {
 }
 
-void TCPClient::CreateWithServer(int tcpID, void* socket, void* clientManager,
+void TCPClient::CreateWithServer(int tcpID, int acceptID, void* socket, void* clientManager,
                                  TCPClient& obj)
 {
-    using Poco::Timespan;
-
     // TCPClient obj;
     obj._impl->tcpID = tcpID; // 这里有访问权限
+    obj._impl->acceptID = acceptID;
     obj._impl->clientManager = (ClientManager*)clientManager;
     obj._impl->socket = *(Poco::Net::StreamSocket*)socket; // 拷贝一次
 
-    // setopt timeout
-    Timespan timeout3(5000000);
-    obj._impl->socket.setReceiveTimeout(timeout3); // retn void
-    Timespan timeout4(5000000);
-    obj._impl->socket.setSendTimeout(timeout4); // retn void
-
-    // setopt bufsize
-    obj._impl->socket.setReceiveBufferSize(XUEXUE_TCP_CLIENT_BUFFER_SIZE); // buff大小
-    obj._impl->socket.setSendBufferSize(XUEXUE_TCP_CLIENT_BUFFER_SIZE);    // buff大小
-
-    obj._impl->socket.setNoDelay(true);
+    // 超时等都在选项里,缓存大小继承自监听的socket
+    obj._impl->SetOptions(obj._impl->clientManager->options);
+    ApplyTCPOptions(obj._impl->socket, obj._impl->options);
+    obj._impl->ResetAutoTune();
     obj._impl->socket.setBlocking(false);
 
     obj._impl->isConnected = true;
     return;
 }
 
+void TCPClient::Reset()
+{
+    user = nullptr;
+    _impl->Reset();
+}
+
 int TCPClient::TcpID()
 {
     return _impl->tcpID;
@@ -558,9 +1470,14 @@ void TCPClient::SetTcpID(int tcpID)
     _impl->tcpID = tcpID;
 }
 
+int TCPClient::AcceptID()
+{
+    return _impl->acceptID;
+}
+
 std::string TCPClient::UUID()
 {
-    return _impl->uuid;
+    return _impl->GetUUID();
 }
 
 std::string TCPClient::SetUUID(const std::string& uuid)
@@ -605,26 +1522,134 @@ float TCPClient::TimeFormErrorToNow()
     return _impl->TimeFormErrorToNow();
 }
 
+int TCPClient::CheckHeartbeat()
+{
+    return _impl->CheckHeartbeat();
+}
+
 int TCPClient::Connect(const std::string& host, int port)
 {
     return _impl->Connect(host, port);
 }
 
+int TCPClient::ConnectAsync(const std::string& host, int port, int timeoutMs)
+{
+    return _impl->ConnectAsync(host, port, timeoutMs);
+}
+
+bool TCPClient::IsConnecting()
+{
+    return _impl->isConnecting;
+}
+
 int TCPClient::Send(const char* data, size_t len, int type)
 {
     return _impl->Send(data, len, type); // 未规定用户数据类型为1
 }
 
+int TCPClient::Send(const char* data, size_t len, int type, int priority)
+{
+    return _impl->Send(data, len, type, priority);
+}
+
+void TCPClient::SetOptions(const TCPOptions& options)
+{
+    _impl->SetOptions(options);
+}
+
+const TCPOptions& TCPClient::Options()
+{
+    return _impl->options;
+}
+
+void TCPClient::Cork()
+{
+    _impl->Cork();
+}
+
+int TCPClient::Uncork()
+{
+    return _impl->Uncork();
+}
+
+bool TCPClient::IsCorked()
+{
+    return _impl->isCorked;
+}
+
+size_t TCPClient::SendQueueSize()
+{
+    return _impl->sendQueue.Size();
+}
+
+size_t TCPClient::Post(const char* data, size_t len, int type)
+{
+    // 这里是其它线程,不能读tcpID(它会在网络线程里被断线重连修改),自己的队列里也用不到它
+    return _impl->postQueue.Push(PostedMessage(-1, data, len, type, false)) + 1;
+}
+
+size_t TCPClient::KCPPost(const char* data, size_t len, int type)
+{
+    return _impl->postQueue.Push(PostedMessage(-1, data, len, type, true)) + 1;
+}
+
+size_t TCPClient::PostQueueSize()
+{
+    return _impl->postQueue.Size();
+}
+
+size_t TCPClient::MemoryUsage()
+{
+    return _impl->MemoryUsage();
+}
+
+void TCPClient::SetReceiveArena(ReceiveArena* arena)
+{
+    _impl->receArena = arena;
+}
+
+int TCPClient::Update()
+{
+    return _impl->Update();
+}
+
 int TCPClient::Receive(std::vector<BinMessage>& msgs)
 {
-    _impl->Receive(msgs);
-    return _impl->ProcCMD(msgs);
+    return _impl->Receive(msgs);
 }
 
 int TCPClient::Receive(std::vector<TextMessage>& msgs)
 {
-    _impl->Receive(msgs);
-    return _impl->ProcCMD(msgs);
+    return _impl->Receive(msgs);
+}
+
+int TCPClient::Receive(std::vector<MessageView>& msgs)
+{
+    return _impl->Receive(msgs);
+}
+
+int TCPClient::ReadMessages(std::vector<MessageView>& msgs)
+{
+    return _impl->ReadMessages(msgs);
+}
+
+int TCPClient::ProcMessages(std::vector<MessageView>& msgs)
+{
+    return _impl->ProcMessages(msgs);
+}
+
+void TCPClient::RegisterHandler(int type, const MessageHandler& handler)
+{
+    if (type == XUEXUE_TCP_CLIENT_INTERNAL_CMD_TYPE) {
+        LogE("TCPClient.RegisterHandler():%d是保留的命令类型,不能注册!", type);
+        return;
+    }
+    _impl->dispatcher.Register(type, handler);
+}
+
+void TCPClient::UnregisterHandler(int type)
+{
+    _impl->dispatcher.Unregister(type);
 }
 
 int TCPClient::Available()
@@ -632,35 +1657,42 @@ int TCPClient::Available()
     return _impl->Available();
 }
 
+int TCPClient::WaitAvailableFor(int timeoutMs)
+{
+    return _impl->WaitAvailable(timeoutMs);
+}
+
 int TCPClient::WaitAvailable(int waitCount)
 {
-    for (size_t i = 0; i < waitCount; i++) {
-        int res = _impl->Available();
-        if (res < 0) { // 这里应该是错误,就不用等了
-            return res;
-        }
-        if (_impl->Available() > 0) {
-            return res; // 如果等到了已经有了接收数据那么就直接返回.
-        }
-        // 等待100ms
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    }
-    return 0;
+    return WaitAvailableFor(waitCount * DNET_WAIT_COUNT_MS);
 }
 
 int TCPClient::WaitAccepted(int waitCount)
 {
-    for (size_t i = 0; i < waitCount; i++) {
-        std::vector<TextMessage> msgs;
-        Receive(msgs);
+    return WaitAcceptedFor(waitCount * DNET_WAIT_COUNT_MS);
+}
 
-        if (IsAccepted()) { // 这里应该是错误,就不用等了
+int TCPClient::WaitAcceptedFor(int timeoutMs)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (true) {
+        std::vector<TextMessage> msgs;
+        if (Receive(msgs) < 0 && !_impl->isConnected) {
+            return 0; // 连接断开了,就不用等了
+        }
+        if (IsAccepted()) {
             return 1;
         }
-        // 等待100ms
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        // 等待服务器的回复数据到达
+        auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remain <= 0) {
+            return 0;
+        }
+        if (_impl->WaitAvailable((int)remain) < 0) {
+            return 0;
+        }
     }
-    return 0;
 }
 
 void* TCPClient::Socket()
@@ -675,7 +1707,7 @@ void* TCPClient::GetKCPClient()
 
 void TCPClient::CopyKCPClient(TCPClient* src)
 {
-    _impl->kcpClient = src->_impl->kcpClient;
+    _impl->kcpClient.swap(src->_impl->kcpClient);
 }
 
 int TCPClient::KCPSend(const char* data, size_t len, int type)
@@ -686,6 +1718,23 @@ int TCPClient::KCPSend(const char* data, size_t len, int type)
     return _impl->kcpClient->Send(data, len, type);
 }
 
+int TCPClient::SendFrame(BroadcastFrame& frame)
+{
+    return _impl->SendFrame(frame);
+}
+
+int TCPClient::KCPSendFrame(BroadcastFrame& frame)
+{
+    if (_impl->kcpClient == nullptr) {
+        return -1;
+    }
+    const std::shared_ptr<const std::vector<char>>& packed = frame.Get(_impl->kcpClient->isCompactPacket);
+    if (packed == nullptr) {
+        return -1;
+    }
+    return _impl->kcpClient->SendFrame(*packed);
+}
+
 int TCPClient::KCPReceive(std::vector<TextMessage>& msgs)
 {
     return _impl->KCPReceive(msgs);
@@ -696,6 +1745,11 @@ int TCPClient::KCPReceive(const char* data, size_t len, std::vector<TextMessage>
     return _impl->KCPReceive(data, len, msgs);
 }
 
+int TCPClient::KCPReceive(const char* data, size_t len, std::vector<MessageView>& msgs)
+{
+    return _impl->KCPReceive(data, len, msgs);
+}
+
 int TCPClient::KCPWaitSendCount()
 {
     if (_impl->kcpClient == nullptr) {
@@ -719,4 +1773,9 @@ Poco::BasicEvent<TCPEventRemoteClose>& TCPClient::EventRemoteClose()
     return _impl->eventRemoteClose;
 }
 
+Poco::BasicEvent<TCPEventBackpressure>& TCPClient::EventBackpressure()
+{
+    return _impl->eventBackpressure;
+}
+
 } // namespace dnet
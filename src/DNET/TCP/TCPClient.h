@@ -6,14 +6,22 @@
 #include <memory>
 
 #include "TCPEvent.h"
+#include "TCPOptions.h"
 #include "Accept.h"
+#include "MessageDispatcher.h"
 
 #include "Poco/BasicEvent.h"
 #include "Poco/Delegate.h"
 #include "Protocol/FastPacket.h"
 
+// 已经弃用的WaitAvailable(),WaitAccepted()的一次等待的毫秒数
+#define DNET_WAIT_COUNT_MS 100
+
 namespace dnet {
 
+class ReceiveArena;
+class BroadcastFrame;
+
 /**
  * 一个TCP客户端.它同时指单纯的客户端和服务器端的客户端.
  *
@@ -37,13 +45,23 @@ class TCPClient
      * @date 2020/12/23
      *
      * @param       tcpID         tcpID.
+     * @param       acceptID      这个连接的id,见AcceptID().
      * @param [in]  socket        Accept线程产生的tcp socket.
      * @param [in]  clientManager 传递给这个TCPClient对象的一个clientManager数据指针.
      * @param [out] obj           返回的这个obj.
      */
-    static void CreateWithServer(int tcpID, void* socket, void* clientManager,
+    static void CreateWithServer(int tcpID, int acceptID, void* socket, void* clientManager,
                                  TCPClient& obj);
 
+    /**
+     * 关闭并且重置成刚创建时候的状态,保留已经分配的接收缓存和kcp对象.
+     * 服务器端回收客户端对象之后用CreateWithServer()重新使用它.
+     *
+     * @author daixian
+     * @date 2021/3/27
+     */
+    void Reset();
+
     /**
      * 如果有就是它的tcpID,没有则是-1.
      *
@@ -65,7 +83,18 @@ class TCPClient
     void SetTcpID(int tcpID);
 
     /**
-     * 返回这个客户端的UUID.
+     * 服务器端accept这个连接时在ClientManager::mLiveClients里分配的带版本号的id.断线重连的时候tcpID会换成之前的,
+     * 而它不会变,所以TCPServer用它来标识一个连接.客户端对象被回收重新使用之后它是新的值.本地的客户端是-1.
+     *
+     * @author daixian
+     * @date 2021/3/22
+     *
+     * @returns The accept id.
+     */
+    int AcceptID();
+
+    /**
+     * 返回这个客户端的UUID,第一次使用的时候才随机生成.
      *
      * @author daixian
      * @date 2020/12/23
@@ -114,15 +143,29 @@ class TCPClient
      */
     bool IsAccepted();
 
+    /**
+     * 等待Accepte完成.会调用Receive()函数,等待的时候阻塞在socket上,服务器的回复一到达就会返回.
+     *
+     * @author daixian
+     * @date 2021/3/25
+     *
+     * @param  timeoutMs (Optional) 最多等待的毫秒数.
+     *
+     * @returns 认证通过了返回1,超时或者连接断开了返回0.
+     */
+    int WaitAcceptedFor(int timeoutMs = 5000);
+
     /**
      * 等待Accepte完成.会调用Receive()函数.
      *
+     * @deprecated 使用WaitAcceptedFor(),它的参数是毫秒数.
+     *
      * @author daixian
      * @date 2021/1/11
      *
-     * @param  waitCount (Optional) Number of waits.
+     * @param  waitCount (Optional) 等待的次数,一次100ms,也就是最多等待waitCount*100毫秒.
      *
-     * @returns An int.
+     * @returns 认证通过了返回1,超时或者连接断开了返回0.
      */
     int WaitAccepted(int waitCount = 50);
 
@@ -154,6 +197,17 @@ class TCPClient
      */
     float TimeFormErrorToNow();
 
+    /**
+     * 检察心跳,超过TCPOptions::heartbeatTimeoutMs没有收到任何消息就当作网络错误关闭.
+     * 本地的客户端在Receive()和Update()里自动检察,服务器端的客户端由TCPServer的定时器调用它.
+     *
+     * @author daixian
+     * @date 2021/3/30
+     *
+     * @returns 距离超时还有多少毫秒,不检察心跳返回0,已经超时了返回-1.
+     */
+    int CheckHeartbeat();
+
     /**
      * 连接主机.
      *
@@ -168,7 +222,34 @@ class TCPClient
     int Connect(const std::string& host, int port);
 
     /**
-     * 非阻塞的发送一段数据.返回发送的字节数(打包后的),可能是少于指定的字节数。某些套接字实现也可能返回负数,表示特定条件的值。
+     * 非阻塞的连接主机,立即返回.连接的完成和握手在之后的Receive()(或者WaitAccepted())里继续,
+     * 所以一个线程可以同时建立很多个连接.握手完成之后IsAccepted()为true并且发出EventAccept事件,
+     * 连接失败或者超时了IsConnecting()为false并且isError()为true.
+     *
+     * @author daixian
+     * @date 2021/3/24
+     *
+     * @param  host      主机地址,目前在内部使用的是IPv4.
+     * @param  port      The port.
+     * @param  timeoutMs (Optional) 连接的超时毫秒数.
+     *
+     * @returns 开始连接了返回0,失败返回-1.
+     */
+    int ConnectAsync(const std::string& host, int port, int timeoutMs = 5000);
+
+    /**
+     * 是否正在进行ConnectAsync()的连接.
+     *
+     * @author daixian
+     * @date 2021/3/24
+     *
+     * @returns 正在连接中返回true.
+     */
+    bool IsConnecting();
+
+    /**
+     * 非阻塞的发送一段数据.socket发送缓存满了的时候没有发送出去的部分会进入发送队列,
+     * 在之后的Receive()或Send()中继续发送,所以这个函数永远不会阻塞.
      *
      * @author daixian
      * @date 2020/5/12
@@ -177,10 +258,172 @@ class TCPClient
      * @param  len  数据长度.
      * @param  type (Optional) 这个数据的类型,注意-1024是认证命令等保留类型,不能使用,应该使用非负的数作为类型.
      *
-     * @returns 返回发送成功的长度(打包后的).
+     * @returns 返回发送或者进入发送队列的长度(打包后的),失败返回-1,发送队列超过了TCPOptions::sendQueueLimit返回-2.
      */
     int Send(const char* data, size_t len, int type = -1);
 
+    /**
+     * 以指定的优先级非阻塞的发送一段数据.发送队列积压的时候,优先级高的消息在当前的帧发送完之后
+     * 插到优先级低的消息前面,同一个优先级的消息保持顺序.协议不变,对方不需要支持优先级.
+     * 一帧开始发送了就不会被打断,所以大的数据应该分成多条消息发送,控制消息才能在它们之间插进来.
+     *
+     * @author daixian
+     * @date 2021/4/3
+     *
+     * @param  data     要发送的数据.
+     * @param  len      数据长度.
+     * @param  type     这个数据的类型.
+     * @param  priority 发送优先级(DNET_SEND_PRIORITY_*),小于0表示由TCPOptions::typePriority决定.
+     *
+     * @returns 返回发送或者进入发送队列的长度(打包后的),失败返回-1,发送队列超过了TCPOptions::sendQueueLimit返回-2.
+     */
+    int Send(const char* data, size_t len, int type, int priority);
+
+    /**
+     * 非阻塞的发送一条广播的帧.帧只打包一次并且被多个连接共享,进入发送队列的时候只引用不拷贝.
+     * TCPServer::Broadcast()对每个客户端调用它.
+     *
+     * @author daixian
+     * @date 2021/3/31
+     *
+     * @param [in] frame 广播的帧.
+     *
+     * @returns 返回发送或者进入发送队列的长度(打包后的),失败返回-1,发送队列超过了TCPOptions::sendQueueLimit返回-2.
+     */
+    int SendFrame(BroadcastFrame& frame);
+
+    /**
+     * 从任意线程投递一条消息.数据拷贝进一个无锁的多生产者单消费者队列,不会阻塞也不加锁,
+     * 在调用Receive()或者Update()的线程里批量的取出来发送.只用于本地的客户端,服务器端使用TCPServer::Post().
+     *
+     * @author daixian
+     * @date 2021/4/2
+     *
+     * @param  data 要发送的数据.
+     * @param  len  数据长度.
+     * @param  type (Optional) 这个数据的类型.
+     *
+     * @returns 投递之后队列里等待发送的消息条数(估计值).
+     */
+    size_t Post(const char* data, size_t len, int type = -1);
+
+    /**
+     * 从任意线程投递一条走kcp通道的消息,和Post()一样在调用Receive()或者Update()的线程里发送.
+     *
+     * @author daixian
+     * @date 2021/4/2
+     *
+     * @param  data 要发送的数据.
+     * @param  len  数据长度.
+     * @param  type (Optional) 这个数据的类型.
+     *
+     * @returns 投递之后队列里等待发送的消息条数(估计值).
+     */
+    size_t KCPPost(const char* data, size_t len, int type = -1);
+
+    /**
+     * 投递了还没有发送的消息条数(估计值),任意线程都可以调用,用于监控.
+     *
+     * @author daixian
+     * @date 2021/4/2
+     *
+     * @returns 消息条数.
+     */
+    size_t PostQueueSize();
+
+    /**
+     * 设置TCP选项(Nagle/QUICKACK/CORK策略等),如果已经连接了那么立即生效.
+     * 需要在Connect()之前设置才能对连接过程生效.
+     *
+     * @author daixian
+     * @date 2021/3/16
+     *
+     * @param  options TCP选项.
+     */
+    void SetOptions(const TCPOptions& options);
+
+    /**
+     * 当前的TCP选项.
+     *
+     * @author daixian
+     * @date 2021/3/16
+     *
+     * @returns TCP选项.
+     */
+    const TCPOptions& Options();
+
+    /**
+     * 开始攒发送的数据.之后Send()的消息都只是打包追加到发送缓存里,直到调用Uncork()或者
+     * 缓存的数据达到了TCPOptions::corkFlushSize才一次发送出去.通常在一帧的开始调用.
+     *
+     * @author daixian
+     * @date 2021/3/16
+     */
+    void Cork();
+
+    /**
+     * 停止攒发送的数据,并且把Cork()之后攒下的所有消息一次发送出去.通常在一帧的结束调用.
+     *
+     * @author daixian
+     * @date 2021/3/16
+     *
+     * @returns 发送成功的长度,失败返回-1.
+     */
+    int Uncork();
+
+    /**
+     * 当前是否Cork()了.
+     *
+     * @author daixian
+     * @date 2021/3/16
+     *
+     * @returns True if corked, false if not.
+     */
+    bool IsCorked();
+
+    /**
+     * 发送队列里等待发送的字节数.如果这个数量太多,那么对端接收太慢已经拥塞.
+     *
+     * @author daixian
+     * @date 2021/3/17
+     *
+     * @returns 字节数.
+     */
+    size_t SendQueueSize();
+
+    /**
+     * 这个连接当前占用的内存字节数(估计值),包括接收缓存,发送队列和kcp.不包括接收线程共用的接收缓存.
+     *
+     * @author daixian
+     * @date 2021/3/28
+     *
+     * @returns 字节数.
+     */
+    size_t MemoryUsage();
+
+    /**
+     * 设置接收线程共用的接收缓存(由TCPServer来调用).设置了之后消息视图指向共用的缓存,
+     * 在这个线程的下一批接收之前有效.只有剩下了不完整的消息的时候才借一块自己的接收缓存,
+     * 消息完整了之后视图还指向它,所以在这个连接的下一次接收的时候才还回去.
+     *
+     * @author daixian
+     * @date 2021/3/28
+     *
+     * @param [in] arena 共用的接收缓存,为null则只使用自己的接收缓存.
+     */
+    void SetReceiveArena(ReceiveArena* arena);
+
+    /**
+     * 不接收数据的更新:检察心跳,继续发送发送队列里还没有发送完的数据.
+     * Receive()里面已经做了这些,TCPServer对没有数据可读的客户端调用它.
+     *
+     * @author daixian
+     * @date 2021/3/21
+     *
+     * @returns 正常返回0,连接断开了返回-1.
+     */
+    int Update();
+
     /**
      * 可读取(接收)的数据数.
      *
@@ -191,13 +434,27 @@ class TCPClient
      */
     int Available();
 
+    /**
+     * 等待,一直等到可接收有数据.阻塞在socket上,数据一到达就会返回.
+     *
+     * @author daixian
+     * @date 2021/3/25
+     *
+     * @param  timeoutMs (Optional) 最多等待的毫秒数.
+     *
+     * @returns 等于Available()函数的返回值.
+     */
+    int WaitAvailableFor(int timeoutMs = 5000);
+
     /**
      * 等待,一直等到可接收有数据.
      *
+     * @deprecated 使用WaitAvailableFor(),它的参数是毫秒数.
+     *
      * @author daixian
      * @date 2020/12/23
      *
-     * @param  waitCount (Optional) 等待的次数,一次100ms吧.
+     * @param  waitCount (Optional) 等待的次数,一次100ms,也就是最多等待waitCount*100毫秒.
      *
      * @returns 等于Available()函数的返回值.
      */
@@ -227,6 +484,69 @@ class TCPClient
      */
     int Receive(std::vector<TextMessage>& msgs);
 
+    /**
+     * 接收消息的视图,不拷贝消息数据.视图直接指向这个客户端的接收缓存,
+     * 只在下一次调用Receive之前有效.设置了TCPOptions::streamThreshold的时候,
+     * 超过它的大消息会按顺序分成FIRST,MIDDLE,LAST几块返回(MessageView::chunk).
+     *
+     * @author daixian
+     * @date 2021/3/12
+     *
+     * @param [out] msgs 消息视图.
+     *
+     * @returns 接收到的数据条数.
+     */
+    int Receive(std::vector<MessageView>& msgs);
+
+    /**
+     * 只从socket接收数据并且解包,不检察心跳,不发送数据,也不处理CMD消息.
+     * TCPServer的IO线程使用它,得到的消息拷贝出来之后再交给应用线程的ProcMessages()处理.
+     * 连接断开了不会在这里发出事件,而是等应用线程的ProcMessages()发出.
+     *
+     * @author daixian
+     * @date 2021/3/22
+     *
+     * @param [out] msgs 解包得到的消息视图,和Receive()的一样,在这个客户端的下一次接收之前有效.
+     *
+     * @returns 接收到的数据条数,连接断开了返回-1(msgs里仍然可能有断开之前收到的消息).
+     */
+    int ReadMessages(std::vector<MessageView>& msgs);
+
+    /**
+     * 处理ReadMessages()得到的消息:执行CMD消息,注册了处理函数的交给处理函数,
+     * 剩下的消息保留在msgs里.ReadMessages()的时候连接断开了的话在这里处理错误并且发出关闭的事件.
+     *
+     * @author daixian
+     * @date 2021/3/22
+     *
+     * @param [in,out] msgs 消息视图.
+     *
+     * @returns 剩下的消息条数.
+     */
+    int ProcMessages(std::vector<MessageView>& msgs);
+
+    /**
+     * 注册一个消息类型的处理函数.这个类型的消息在Receive()和KCPReceive()解包之后直接交给处理函数,
+     * 不会再出现在Receive()的结果里,没有处理函数的消息仍然通过Receive()返回.
+     *
+     * @author daixian
+     * @date 2021/3/20
+     *
+     * @param  type    消息类型,不能是-1024等保留类型.
+     * @param  handler 处理函数,为空则移除.
+     */
+    void RegisterHandler(int type, const MessageHandler& handler);
+
+    /**
+     * 移除一个消息类型的处理函数.
+     *
+     * @author daixian
+     * @date 2021/3/20
+     *
+     * @param  type 消息类型.
+     */
+    void UnregisterHandler(int type);
+
     /**
      * 得到这个客户端的Poco的Socket指针(Poco::Net::StreamSocket).
      *
@@ -248,7 +568,7 @@ class TCPClient
     void* GetKCPClient();
 
     /**
-     * 移动KCPClient的指针.
+     * 移动KCPClient的指针.自己原来的kcp对象交换给src,src随后被回收的时候会重置它.
      *
      * @author daixian
      * @date 2021/1/11
@@ -271,6 +591,18 @@ class TCPClient
      */
     int KCPSend(const char* data, size_t len, int type = -1);
 
+    /**
+     * 走kcp通道发送一条广播的帧.帧里的协议头和数据已经打包好了,kcp直接分片.
+     *
+     * @author daixian
+     * @date 2021/3/31
+     *
+     * @param [in] frame 广播的帧.
+     *
+     * @returns 成功返回0,失败返回负数.
+     */
+    int KCPSendFrame(BroadcastFrame& frame);
+
     /**
      * KCP的接收.
      *
@@ -297,6 +629,23 @@ class TCPClient
      */
     int KCPReceive(const char* data, size_t len, std::vector<TextMessage>& msgs);
 
+    /**
+     * (内部调用)和上面的一样,但是得到的是消息视图,在这个客户端下一次KCP接收之前有效.
+     * 服务器端的客户端的视图指向ClientManager里所有客户端共用的kcp接收缓存,
+     * 所以服务器上任何一个客户端的下一次KCP接收都会让它失效.TCPServer::KCPReceive()每次只接收一个客户端,
+     * 并且在返回之前就把视图拷贝到了输出里.
+     *
+     * @author daixian
+     * @date 2021/3/25
+     *
+     * @param       data socket接收到的数据.
+     * @param       len  socket接收到的数据长度.
+     * @param [out] msgs 消息视图.
+     *
+     * @returns 接收到的数据条数.
+     */
+    int KCPReceive(const char* data, size_t len, std::vector<MessageView>& msgs);
+
     /**
      * 当前等待发送的消息计数.如果这个数量太多,那么已经拥塞.
      *
@@ -338,6 +687,17 @@ class TCPClient
      */
     Poco::BasicEvent<TCPEventRemoteClose>& EventRemoteClose();
 
+    /**
+     * 发送队列积压的事件.待发送的数据超过了TCPOptions::sendQueueHighWater或者回落到了
+     * TCPOptions::sendQueueLowWater时发出,事件处理中可以设置disconnect来断开这个连接.
+     *
+     * @author daixian
+     * @date 2021/3/17
+     *
+     * @returns A reference to a Poco::BasicEvent<TCPEventBackpressure>
+     */
+    Poco::BasicEvent<TCPEventBackpressure>& EventBackpressure();
+
   private:
     class Impl;
     // 使用智能指针来拷贝.
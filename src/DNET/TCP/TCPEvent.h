@@ -53,4 +53,30 @@ class TCPEventRemoteClose
     int tcpID = 0;
 };
 
+/**
+ * 发送队列积压的事件.待发送的数据超过了高水位或者回落到了低水位.
+ *
+ * @author daixian
+ * @date 2021/3/17
+ */
+class TCPEventBackpressure
+{
+  public:
+    TCPEventBackpressure(int tcpID, size_t queueSize, bool isHigh)
+        : tcpID(tcpID), queueSize(queueSize), isHigh(isHigh) {}
+    ~TCPEventBackpressure() {}
+
+    // tcp连接里的id
+    int tcpID = 0;
+
+    // 当前发送队列里等待发送的字节数
+    size_t queueSize = 0;
+
+    // true表示超过了高水位,false表示回落到了低水位
+    bool isHigh = false;
+
+    // 事件处理中设置为true则断开这个连接(处理慢的客户端)
+    bool disconnect = false;
+};
+
 } // namespace dxlib
\ No newline at end of file
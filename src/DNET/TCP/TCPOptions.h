@@ -0,0 +1,106 @@
+﻿#pragma once
+
+#include <map>
+
+// 发送的优先级:控制消息,数字越小越优先
+#define DNET_SEND_PRIORITY_HIGH 0
+
+// 发送的优先级:默认的
+#define DNET_SEND_PRIORITY_NORMAL 1
+
+// 发送的优先级:大块的数据(资源文件等)
+#define DNET_SEND_PRIORITY_LOW 2
+
+// 发送的优先级的个数
+#define DNET_SEND_PRIORITY_COUNT 3
+
+namespace dnet {
+
+/**
+ * TCP连接的socket选项和发送策略,TCPServer会把它应用到所有接受的连接上.
+ *
+ * @author daixian
+ * @date 2021/3/16
+ */
+class TCPOptions
+{
+  public:
+    TCPOptions() {}
+    ~TCPOptions() {}
+
+    // 是否关闭Nagle算法(TCP_NODELAY).
+    bool noDelay = true;
+
+    // 是否开启TCP_QUICKACK,每次接收之后会重新设置(只在linux上有效).
+    bool quickAck = false;
+
+    // 是否开启TCP_CORK(linux)或TCP_NOPUSH(macOS),由内核合并小的数据段.
+    bool cork = false;
+
+    // Cork()之后缓存的待发送数据达到这个长度时会自动发送一次.
+    int corkFlushSize = 64 * 1024;
+
+    // 发送队列的高水位,待发送的数据超过它时发出TCPEventBackpressure事件.
+    size_t sendQueueHighWater = 4 * 1024 * 1024;
+
+    // 发送队列的低水位,超过高水位之后回落到它以下时发出TCPEventBackpressure事件.
+    size_t sendQueueLowWater = 1024 * 1024;
+
+    // 是否在握手时协商使用紧凑的协议头(CompactPacket),对方不支持时仍然使用FastPacket.
+    bool compactPacket = true;
+
+    // 一条消息的最大长度,协议头里的长度超过它的时候当作非法数据丢弃,防止恶意的长度让接收缓存无限增长.
+    int maxMessageSize = 64 * 1024 * 1024;
+
+    // 超过这个长度的消息会分块的交给用户(MessageView::chunk),接收缓存不会为它扩大到整条消息的长度.为0表示不分块.
+    int streamThreshold = 0;
+
+    // 发送队列的上限,超过它之后Send()不再接受新的消息并返回-2.为0表示不限制.
+    size_t sendQueueLimit = 64 * 1024 * 1024;
+
+    // TCPServer监听队列的长度(listen的backlog),需要在Start()之前设置.
+    int listenBacklog = 1024;
+
+    // TCPServer每次Receive()最多accept的连接数,监听队列里没有连接了就会提前结束.
+    int acceptBudget = 256;
+
+    // TCPServer最多的连接数,超过之后新的连接会被直接关闭.为0表示不限制.
+    int maxConnections = 0;
+
+    // socket的内核接收缓存大小(SO_RCVBUF).为0表示不设置,使用系统的默认值(linux上由内核自动调整).
+    // 在连接之前(TCPClient的Connect(),TCPServer的Start())设置才能用于握手,也会应用到KCP使用的UDP socket上.
+    int socketReceiveBufferSize = 8 * 1024;
+
+    // socket的内核发送缓存大小(SO_SNDBUF).为0表示不设置,使用系统的默认值.同样也应用到UDP socket上.
+    int socketSendBufferSize = 8 * 1024;
+
+    // 用户态的接收缓存大小,一次从socket最多接收这么多数据(最大64KB).
+    int receiveBufferSize = 8 * 1024;
+
+    // socket的接收超时毫秒数(SO_RCVTIMEO),只对阻塞的操作有效.
+    int receiveTimeoutMs = 5000;
+
+    // socket的发送超时毫秒数(SO_SNDTIMEO),只对阻塞的操作有效.
+    int sendTimeoutMs = 5000;
+
+    // 是否根据每个连接观测到的吞吐量和RTT自动扩大它的socket缓存(只扩大不缩小),缓存大小为0的方向不调整.
+    bool autoTuneBuffer = false;
+
+    // 自动调整的时候socket缓存的上限.
+    int autoTuneMaxBufferSize = 4 * 1024 * 1024;
+
+    // 超过这个毫秒数没有收到任何消息(TCP和KCP)的连接当作已经断开.为0表示不检察.
+    int heartbeatTimeoutMs = 600 * 1000;
+
+    // TCPServer上新的连接在这个毫秒数之内没有完成握手就关闭它.为0表示不限制.
+    int handshakeTimeoutMs = 30 * 1000;
+
+    // TCPServer上出错了的连接保留这个毫秒数之后再删除,在这之前同一个uuid重连上来可以继承它的KCP.
+    int errorReapDelayMs = 100 * 1000;
+
+    // 消息类型对应的发送优先级(DNET_SEND_PRIORITY_*),Send()没有指定优先级的时候使用,不在这里的类型是DNET_SEND_PRIORITY_NORMAL.
+    // 发送队列积压的时候优先级高的消息会在帧的边界上插到优先级低的前面,同一个优先级的消息保持顺序.
+    std::map<int, int> typePriority;
+};
+
+} // namespace dnet
@@ -15,12 +15,39 @@
 
 #include <thread>
 #include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 #include <regex>
 
 #include "dlog/dlog.h"
 
 #include "ClientManager.h"
+#include "Poller.h"
+#include "ServerShard.h"
+#include "ReceiveArena.h"
+#include "SocketUtil.h"
+#include "TimerWheel.h"
+#include "BroadcastFrame.h"
+#include "PostedMessage.h"
+#include "MonotonicClock.h"
 #include "./Protocol/FastPacket.h"
+#include "../kcp/ikcp.h"
+
+// 删除了的客户端对象放进对象池的间隔毫秒数
+#define DNET_SERVER_RECYCLE_INTERVAL_MS 1000
+
+// 开启了自动调整socket缓存的时候更新每个客户端的间隔毫秒数
+#define DNET_SERVER_UPDATE_INTERVAL_MS 1000
+
+// 每次Receive()最多发送的投递消息条数,剩下的下一次再发送
+#define DNET_SERVER_POST_BUDGET 65536
+
+// 监听socket和UDP socket在Poller里的key,客户端的key是它的AcceptID(),带版本号的id不会和它们重复
+#define DNET_SERVER_POLL_ACCEPT_KEY 0
+#define DNET_SERVER_POLL_UDP_KEY 1
 
 namespace dnet {
 
@@ -32,8 +59,17 @@ class TCPServer::Impl
         //随机生成一个uuid
         Poco::UUIDGenerator uuidGen;
         uuid = uuidGen.createRandom().toString();
+        clientManager.uuid = uuid;
 
         clientManager.eventAccept = &eventAccept;
+        clientManager.eventBackpressure = &eventBackpressure;
+        clientManager.onDeleteClient = [this](TCPClient* client) {
+            auto itr = clientShards.find(client);
+            if (itr != clientShards.end()) {
+                itr->second->Remove(client);
+                clientShards.erase(itr);
+            }
+        };
     }
     ~Impl()
     {
@@ -64,27 +100,115 @@ class TCPServer::Impl
     // 远程端关闭的事件
     Poco::BasicEvent<TCPEventRemoteClose> eventRemoteClose;
 
+    // 客户端发送队列积压的事件
+    Poco::BasicEvent<TCPEventBackpressure> eventBackpressure;
+
     // 客户端记录.
     ClientManager clientManager;
 
     // TCP协议
     FastPacket packet;
 
-    void Start(const std::string& name, const std::string& host, int port)
+    // 当前是否Cork()了,新连接进来的客户端也要Cork()
+    bool isCorked = false;
+
+    // socket的就绪通知
+    Poller poller;
+
+    // 就绪了的socket的key
+    std::vector<uint64_t> readyKeys;
+
+    // 定时器的类型,定时器的id是tcpID
+    enum TimerType
+    {
+        // 握手超时
+        TIMER_HANDSHAKE = 1,
+        // 心跳超时
+        TIMER_HEARTBEAT = 2,
+        // 删除出错了的客户端
+        TIMER_REAP = 3,
+        // 更新客户端(自动调整socket缓存)
+        TIMER_UPDATE = 4,
+    };
+
+    // 所有客户端的定时器
+    TimerWheel timerWheel;
+
+    // 到期了的定时器,重复使用
+    std::vector<TimerWheel::Timer> expiredTimers;
+
+    // 从clientManager取走的出错了的客户端,重复使用
+    std::vector<int> errorIDs;
+
+    // 发送队列里还有数据的客户端
+    std::unordered_set<int> flushIDs;
+
+    // 上一次回收客户端对象的时间
+    int64_t lastRecycleTime = 0;
+
+    // 其它线程投递过来等待发送的消息
+    PostQueue postQueue;
+
+    // 是否已经为投递的消息唤醒过Receive()了,Receive()取消息之前清除
+    std::atomic<bool> isPostWakeup{false};
+
+    // IO线程,为空则是单线程的
+    std::vector<std::shared_ptr<ServerShard>> shards;
+
+    // 每个客户端所在的IO线程
+    std::unordered_map<TCPClient*, ServerShard*> clientShards;
+
+    // 从每个IO线程取走的消息,返回的MessageView指向它们,下一次Receive之前有效
+    std::vector<ShardReceived> shardReceived;
+
+    // 一个客户端的消息视图
+    std::vector<MessageView> shardViews;
+
+    // 接受连接的统计
+    AcceptStats acceptStats;
+
+    // 一个客户端接收到的消息视图,重复使用
+    std::vector<MessageView> clientViews;
+
+    // 单线程接收的时候所有客户端共用的接收缓存
+    ReceiveArena receArena;
+
+    // 启动完成的通知,WaitStarted()使用
+    std::mutex startMut;
+    std::condition_variable startCond;
+
+    void Start(const std::string& name, const std::string& host, int port, int ioThreadCount)
     {
         Close();
 
         this->name = name;
         Poco::Net::SocketAddress sAddr(Poco::Net::AddressFamily::IPv4, host, port);
+        std::unique_lock<std::mutex> lock(startMut);
         try {
-            serverSocket = new Poco::Net::ServerSocket(sAddr);
+            // socket缓存大小要在listen之前设置,accept得到的socket会继承它,这样握手的时候就使用了选项里的缓存大小
+            serverSocket = new Poco::Net::ServerSocket();
+            serverSocket->bind(sAddr, true);
+            ApplyBufferOptions(*serverSocket, clientManager.options);
+            serverSocket->listen(clientManager.options.listenBacklog);
             serverSocket->setBlocking(false); //这里不能设置为false,因为Accept的时候只能Block,执行Accept函数的时候会直接异常.
 
             acceptUDPSocket = new Poco::Net::DatagramSocket(sAddr);
             acceptUDPSocket->setBlocking(false);
+            ApplyBufferOptions(*acceptUDPSocket, clientManager.options);
+            // receiveFrom()每次只取一个数据报,8K足够放下KCP的一个包(mtu),和receiveBufferSize无关
             receBuffUDP.resize(8 * 1024);
 
             clientManager.acceptUDPSocket = acceptUDPSocket;
+
+            if (poller.IsValid()) {
+                poller.Add(*serverSocket, DNET_SERVER_POLL_ACCEPT_KEY);
+                poller.Add(*acceptUDPSocket, DNET_SERVER_POLL_UDP_KEY);
+            }
+
+            if (ioThreadCount > 0) {
+                StartShards(ioThreadCount);
+            }
+            timerWheel.Reset(MonotonicClock::Refresh());
         }
         catch (const Poco::Exception& e) {
             LogE("TCPServer.Start():创建Socket异常e=%s,%s", e.what(), e.message().c_str());
@@ -93,6 +217,9 @@ class TCPServer::Impl
             LogE("TCPServer.Start():创建Socket异常e=%s", e.what());
         }
 
+        lock.unlock();
+        startCond.notify_all();
+
         LogI("TCPServer.Start():启动...");
     }
 
@@ -101,8 +228,17 @@ class TCPServer::Impl
         if (!IsStarted()) //如果还没启动那么直接返回
             return;
 
-        //关闭所有客户端
+        //先停止IO线程再关闭所有客户端
+        for (auto& shard : shards) {
+            shard->Stop();
+        }
         clientManager.Clear();
+        shards.clear();
+        clientShards.clear();
+        shardReceived.clear();
+        postQueue.Clear();
+        timerWheel.Reset(MonotonicClock::Refresh());
+        flushIDs.clear();
 
         if (acceptUDPSocket != nullptr) {
             try {
@@ -118,13 +254,56 @@ class TCPServer::Impl
             catch (const std::exception& e) {
                 LogE("TCPServer.Close():关闭Socket异常e=%s", e.what());
             }
+            std::lock_guard<std::mutex> lock(startMut);
             serverSocket = nullptr;
             acceptUDPSocket = nullptr;
+            acceptStats = AcceptStats();
         }
         TCPEventClose evArgs = TCPEventClose();
         eventClose.notify(this, evArgs);
     }
 
+    // 启动IO线程
+    void StartShards(int ioThreadCount)
+    {
+        if (!poller.IsValid()) {
+            LogW("TCPServer.StartShards():当前平台不支持IO线程,使用单线程!");
+            return;
+        }
+        for (int i = 0; i < ioThreadCount; i++) {
+            std::shared_ptr<ServerShard> shard(new ServerShard());
+            if (!shard->Start(&poller)) {
+                LogE("TCPServer.StartShards():启动IO线程失败!");
+                break;
+            }
+            shards.push_back(shard);
+        }
+        LogI("TCPServer.StartShards():启动了%zu个IO线程.", shards.size());
+    }
+
+    /**
+     * 锁住一个客户端所在的IO线程,单线程的时候返回的锁是空的.
+     * 应用线程访问客户端之前都要调用它.
+     *
+     * @param [in] client 客户端.
+     *
+     * @returns 锁.
+     */
+    std::unique_lock<std::recursive_mutex> LockClient(TCPClient* client)
+    {
+        auto itr = clientShards.find(client);
+        if (itr == clientShards.end()) {
+            return std::unique_lock<std::recursive_mutex>();
+        }
+        return std::unique_lock<std::recursive_mutex>(itr->second->mut);
+    }
+
+    bool WaitStarted(int timeoutMs)
+    {
+        std::unique_lock<std::mutex> lock(startMut);
+        return startCond.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]() { return serverSocket != nullptr; });
+    }
+
     bool IsStarted()
     {
         if (serverSocket != nullptr) {
@@ -135,14 +314,169 @@ class TCPServer::Impl
         }
     }
 
-    int Send(int tcpID, const char* data, size_t len, int type)
+    int Send(int tcpID, const char* data, size_t len, int type, int priority = -1)
     {
         TCPClient* client = clientManager.GetClient(tcpID);
         if (client == nullptr) {
             return -1;
         }
+        auto lock = LockClient(client);
 
-        return client->Send(data, len, type); //发送打包后的数据
+        int res = client->Send(data, len, type, priority); //发送打包后的数据
+        CheckSendQueue(client);
+        return res;
+    }
+
+    /**
+     * 向所有完成了握手的客户端发送同一个帧.
+     *
+     * @param [in] frame  广播的帧.
+     * @param      filter 过滤函数,为空则发送给所有客户端.
+     * @param      isKCP  是否走kcp通道.
+     *
+     * @returns 发送成功的客户端个数.
+     */
+    int Broadcast(BroadcastFrame& frame, const std::function<bool(int)>& filter, bool isKCP)
+    {
+        if (isKCP) {
+            MonotonicClock::Refresh(); // 所有客户端的ikcp_update()都使用这个时间
+        }
+        int count = 0;
+        for (size_t i = 0; i < clientManager.mClients.Size(); i++) {
+            if (filter && !filter(clientManager.mClients.IdAt(i))) {
+                continue;
+            }
+            if (SendFrame(clientManager.mClients.ValueAt(i), frame, isKCP)) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    /**
+     * 向一个组的所有成员发送同一个帧.
+     *
+     * @param      groupID 组id.
+     * @param [in] frame   广播的帧.
+     * @param      isKCP   是否走kcp通道.
+     *
+     * @returns 发送成功的客户端个数,组不存在返回-1.
+     */
+    int GroupSend(int groupID, BroadcastFrame& frame, bool isKCP)
+    {
+        const std::vector<int>* members = clientManager.groups.Members(groupID);
+        if (members == nullptr) {
+            return -1;
+        }
+        if (isKCP) {
+            MonotonicClock::Refresh(); // 所有成员的ikcp_update()都使用这个时间
+        }
+        int count = 0;
+        for (int tcpID : *members) {
+            TCPClient* client = clientManager.GetClient(tcpID);
+            if (client != nullptr && SendFrame(client, frame, isKCP)) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    // 向一个完成了握手的客户端发送一个广播的帧,返回是否成功
+    bool SendFrame(TCPClient* client, BroadcastFrame& frame, bool isKCP)
+    {
+        auto lock = LockClient(client);
+        if (client->isError() || !client->IsAccepted()) {
+            return false;
+        }
+        if (isKCP) {
+            return client->KCPSendFrame(frame) >= 0;
+        }
+        int res = client->SendFrame(frame);
+        CheckSendQueue(client);
+        return res >= 0;
+    }
+
+    /**
+     * 投递一条消息,任意线程都可以调用.消息进入无锁队列,由Receive()所在的线程发送.
+     *
+     * @returns 投递之后队列里的消息条数.
+     */
+    size_t Post(int tcpID, const char* data, size_t len, int type, bool isKCP)
+    {
+        size_t prevCount = postQueue.Push(PostedMessage(tcpID, data, len, type, isKCP));
+        if (!isPostWakeup.exchange(true)) {
+            poller.Wakeup(); // 让阻塞在Receive()里的线程马上醒来发送
+        }
+        return prevCount + 1;
+    }
+
+    // 发送其它线程投递过来的消息
+    void SendPosted()
+    {
+        isPostWakeup.store(false); // 在这之后投递的消息会再次唤醒
+        PostedMessage msg;
+        for (int i = 0; i < DNET_SERVER_POST_BUDGET; i++) {
+            if (!postQueue.Pop(msg)) {
+                return;
+            }
+            if (msg.isKCP) {
+                KCPSend(msg.tcpID, msg.data.data(), msg.data.size(), msg.type);
+            }
+            else {
+                Send(msg.tcpID, msg.data.data(), msg.data.size(), msg.type);
+            }
+        }
+        if (postQueue.Size() > 0 && !isPostWakeup.exchange(true)) {
+            poller.Wakeup(); // 还有没发送的,下一次Receive()不等待
+        }
+    }
+
+    void SetOptions(const TCPOptions& options)
+    {
+        // 原来关闭了的检察要给已有的客户端补上定时器
+        bool isStartHeartbeat = clientManager.options.heartbeatTimeoutMs <= 0 && options.heartbeatTimeoutMs > 0;
+        bool isStartAutoTune = !clientManager.options.autoTuneBuffer && options.autoTuneBuffer;
+        int64_t now = MonotonicClock::Refresh();
+
+        // 之后accept的连接使用新的缓存大小
+        if (serverSocket != nullptr) {
+            ApplyBufferOptions(*serverSocket, options);
+            ApplyBufferOptions(*acceptUDPSocket, options);
+        }
+
+        clientManager.options = options;
+        for (size_t i = 0; i < clientManager.mClients.Size(); i++) {
+            TCPClient* client = clientManager.mClients.ValueAt(i);
+            auto lock = LockClient(client);
+            client->SetOptions(options);
+            if (isStartHeartbeat) {
+                timerWheel.Add(now + options.heartbeatTimeoutMs, clientManager.mClients.IdAt(i), TIMER_HEARTBEAT);
+            }
+            if (isStartAutoTune) {
+                timerWheel.Add(now + DNET_SERVER_UPDATE_INTERVAL_MS, clientManager.mClients.IdAt(i), TIMER_UPDATE);
+            }
+        }
+    }
+
+    void Cork()
+    {
+        isCorked = true;
+        for (size_t i = 0; i < clientManager.mClients.Size(); i++) {
+            TCPClient* client = clientManager.mClients.ValueAt(i);
+            auto lock = LockClient(client);
+            client->Cork();
+        }
+    }
+
+    void Uncork()
+    {
+        isCorked = false;
+        for (size_t i = 0; i < clientManager.mClients.Size(); i++) {
+            TCPClient* client = clientManager.mClients.ValueAt(i);
+            auto lock = LockClient(client);
+            client->Uncork();
+            CheckSendQueue(client);
+        }
     }
 
     //客户端接收查询
@@ -152,87 +486,406 @@ class TCPServer::Impl
         if (client == nullptr) { //客户端不存在
             return -1;
         }
-
+        auto lock = LockClient(client);
         return client->Available();
     }
 
-    int WaitAvailable(int tcpID, int waitCount)
+    int WaitAvailable(int tcpID, int timeoutMs)
     {
         TCPClient* client = clientManager.GetClient(tcpID);
         if (client == nullptr) { //客户端不存在
             return -1;
         }
+        auto lock = LockClient(client);
+        if (!lock.owns_lock()) {
+            return client->WaitAvailableFor(timeoutMs);
+        }
 
-        return client->WaitAvailable(waitCount);
+        // 等待的时候不能拿着分片的锁,否则这个分片的IO线程都要等着.
+        // 客户端只会在这个线程里被删除,socket复制一份引用,等待期间被关闭了也没有关系
+        Poco::Net::StreamSocket socket = *(Poco::Net::StreamSocket*)client->Socket();
+        lock.unlock();
+        try {
+            socket.poll(Poco::Timespan(timeoutMs / 1000, (timeoutMs % 1000) * 1000), Poco::Net::Socket::SELECT_READ);
+        }
+        catch (const Poco::Exception& e) {
+            LogE("TCPServer.WaitAvailable():异常e=%s,%s", e.what(), e.message().c_str());
+        }
+        catch (const std::exception& e) {
+            LogE("TCPServer.WaitAvailable():异常e=%s", e.what());
+        }
+        lock.lock();
+        return client->Available();
     }
 
-    int WaitAccepted(int tcpID, int waitCount)
+    int WaitAccepted(int tcpID, int timeoutMs)
     {
         TCPClient* client = clientManager.GetClient(tcpID);
         if (client == nullptr) { //客户端不存在
             return -1;
         }
-
-        return client->WaitAccepted(waitCount);
+        auto lock = LockClient(client);
+        return client->WaitAcceptedFor(timeoutMs);
     }
 
+    // 一次accept监听队列里的所有连接,最多TCPOptions::acceptBudget个,重连风暴的时候监听队列不会溢出
     void SocketAccept()
     {
         if (serverSocket == nullptr) {
             return;
         }
 
-        try {
-            // 注意这里是异步poll调用了
-            if (serverSocket->poll(Poco::Timespan(0), Poco::Net::Socket::SELECT_READ)) {
+        const TCPOptions& options = clientManager.options;
+        int budget = options.acceptBudget > 0 ? options.acceptBudget : 1;
+        acceptStats.lastBatchCount = 0;
+        for (int i = 0; i < budget; i++) {
+            try {
+                // 注意这里是异步poll调用了,没有连接了就结束
+                if (!serverSocket->poll(Poco::Timespan(0), Poco::Net::Socket::SELECT_READ)) {
+                    break;
+                }
                 Poco::Net::StreamSocket streamSocket = serverSocket->acceptConnection();
+                if (options.maxConnections > 0 && (int)clientManager.mClients.Size() >= options.maxConnections) {
+                    LogW("TCPServer.SocketAccept():连接数已经达到了%d,拒绝新的连接!", options.maxConnections);
+                    streamSocket.close();
+                    acceptStats.rejectedCount++;
+                    continue;
+                }
                 streamSocket.setBlocking(false);
                 TCPClient* client = clientManager.AddClient(streamSocket); //添加这个用户
+                if (client == nullptr) {
+                    streamSocket.close();
+                    acceptStats.rejectedCount++;
+                    continue;
+                }
+                if (isCorked) {
+                    client->Cork();
+                }
+                if (!shards.empty()) {
+                    // 按tcpID固定的分配到一个IO线程
+                    ServerShard* shard = shards[client->TcpID() % shards.size()].get();
+                    clientShards[client] = shard;
+                    shard->Add(client);
+                }
+                else {
+                    client->SetReceiveArena(&receArena);
+                    if (poller.IsValid()) {
+                        poller.Add(*(Poco::Net::StreamSocket*)client->Socket(), (uint64_t)client->AcceptID());
+                    }
+                }
+                AddClientTimers(client->TcpID());
+                acceptStats.acceptedCount++;
+                acceptStats.lastBatchCount++;
                 LogI("TCPServer.SocketAccept():新连接来了一个客户端,临时tcpid=%d", client->TcpID());
+            }
+            catch (const Poco::Exception& e) {
+                LogE("TCPServer.SocketAccept():异常e=%s,%s", e.what(), e.message().c_str());
+                acceptStats.rejectedCount++;
+                break;
+            }
+            catch (const std::exception& e) {
+                LogE("TCPServer.SocketAccept():异常e=%s", e.what());
+                acceptStats.rejectedCount++;
+                break;
+            }
+        }
+    }
 
-                //eventAccept->notify(this, TCPEventAccept(tcpID)); //发出这个事件消息
+    /**
+     * 接收所有客户端的消息.linux上使用epoll只接收就绪了的客户端,其它平台上轮询所有的客户端.
+     *
+     * @tparam TOut 输出的类型,以tcpID为key的map或者MessageBatch.
+     * @param [out] out       所有客户端的消息.
+     * @param       timeoutMs 没有任何socket就绪的时候最多阻塞等待的毫秒数.
+     *
+     * @returns map为接收到消息的客户端个数,MessageBatch为消息条数.
+     */
+    template <typename TOut>
+    int Receive(TOut& out, int timeoutMs)
+    {
+        ClearOutput(out);
+
+        if (!shards.empty()) {
+            return ReceiveShards(out, timeoutMs);
+        }
+
+        // 上一次得到的消息视图在这里失效
+        receArena.Reset();
+
+        if (poller.IsValid()) {
+            poller.Wait(readyKeys, timeoutMs);
+        }
+        else {
+            // 不支持就绪通知的平台上所有的都当作就绪了
+            readyKeys.clear();
+            readyKeys.push_back(DNET_SERVER_POLL_ACCEPT_KEY);
+            for (size_t i = 0; i < clientManager.mClients.Size(); i++) {
+                readyKeys.push_back((uint64_t)clientManager.mClients.ValueAt(i)->AcceptID());
             }
-            else {
+        }
+        MonotonicClock::Refresh(); // 这一轮里所有的时间戳都使用这个时间
+
+        for (size_t i = 0; i < readyKeys.size(); i++) {
+            uint64_t key = readyKeys[i];
+            if (key == DNET_SERVER_POLL_UDP_KEY) {
+                continue; // KCP的数据在KCPReceive()里接收,这里只是让等待可以被唤醒
+            }
+            if (key == DNET_SERVER_POLL_ACCEPT_KEY) {
+                // 执行tcp socket的accept
+                SocketAccept();
+                continue;
+            }
+            TCPClient* client = clientManager.GetLiveClient((int)key);
+            if (client == nullptr) {
+                continue; // 这个连接在处理前面的消息的时候已经被删除了
             }
+            if (poller.IsValid() && client->Available() == 0) {
+                // 通知了可读但是没有数据,说明对方关闭了连接或者出错了,不再等待它就绪.
+                // 下面的Receive()里recv()返回0,在这个线程里处理错误并且发出关闭的事件
+                poller.Remove(*(Poco::Net::StreamSocket*)client->Socket());
+            }
+            if (client->Receive(clientViews) > 0) {
+                Output(out, client->TcpID(), clientViews); // 接收的时候tcpID可能被重新分配了
+            }
+            CheckSendQueue(client); // 处理消息的时候可能回复了消息
         }
-        catch (const Poco::Exception& e) {
-            LogE("TCPServer.SocketAccept():异常e=%s,%s", e.what(), e.message().c_str());
+
+        SendPosted();
+        UpdateClients();
+        return OutputCount(out);
+    }
+
+    /**
+     * 多线程的时候的接收:这里只执行accept,然后取走IO线程接收到的消息,在这个线程里处理CMD消息和分发.
+     *
+     * @tparam TOut 输出的类型,以tcpID为key的map或者MessageBatch.
+     * @param [out] out       所有客户端的消息.
+     * @param       timeoutMs 没有任何消息的时候最多阻塞等待的毫秒数.
+     *
+     * @returns map为接收到消息的客户端个数,MessageBatch为消息条数.
+     */
+    template <typename TOut>
+    int ReceiveShards(TOut& out, int timeoutMs)
+    {
+        shardReceived.resize(shards.size());
+        bool isReceived = false;
+        for (size_t i = 0; i < shards.size(); i++) {
+            isReceived = shards[i]->TakeReceived(shardReceived[i]) || isReceived;
         }
-        catch (const std::exception& e) {
-            LogE("TCPServer.SocketAccept():异常e=%s", e.what());
+        if (!isReceived) {
+            // IO线程接收到消息之后会唤醒这个等待
+            poller.Wait(readyKeys, timeoutMs);
+            for (size_t i = 0; i < shards.size(); i++) {
+                shards[i]->TakeReceived(shardReceived[i]);
+            }
+        }
+        else {
+            poller.Wait(readyKeys, 0);
+        }
+        MonotonicClock::Refresh(); // 这一轮里所有的时间戳都使用这个时间
+
+        for (size_t i = 0; i < readyKeys.size(); i++) {
+            if (readyKeys[i] == DNET_SERVER_POLL_ACCEPT_KEY) {
+                SocketAccept();
+            }
+        }
+
+        for (ShardReceived& received : shardReceived) {
+            for (const ShardReceived::Range& range : received.ranges) {
+                TCPClient* client = clientManager.GetLiveClient(range.acceptID);
+                if (client == nullptr) {
+                    continue; // 这个连接在处理前面的消息的时候已经被删除了
+                }
+                auto lock = LockClient(client);
+
+                shardViews.clear();
+                for (size_t msgIndex = range.begin; msgIndex < range.end; msgIndex++) {
+                    shardViews.push_back(received.batch.View(msgIndex));
+                }
+                if (client->ProcMessages(shardViews) > 0) {
+                    Output(out, client->TcpID(), shardViews); // 处理的时候tcpID可能被重新分配了
+                }
+                CheckSendQueue(client); // 处理消息的时候可能回复了消息
+            }
+        }
+
+        SendPosted();
+        UpdateClients();
+        return OutputCount(out);
+    }
+
+    template <typename TMsg>
+    static void ClearOutput(std::map<int, std::vector<TMsg>>& msgs)
+    {
+        msgs.clear();
+    }
+
+    static void ClearOutput(MessageBatch& batch)
+    {
+        batch.Clear();
+    }
+
+    template <typename TMsg>
+    static int OutputCount(std::map<int, std::vector<TMsg>>& msgs)
+    {
+        return (int)msgs.size();
+    }
+
+    static int OutputCount(MessageBatch& batch)
+    {
+        return (int)batch.Size();
+    }
+
+    // 输出一个客户端的消息
+    template <typename TMsg>
+    static void Output(std::map<int, std::vector<TMsg>>& msgs, int tcpID, const std::vector<MessageView>& views)
+    {
+        std::vector<TMsg>& clientMsgs = msgs[tcpID];
+        for (size_t msgIndex = 0; msgIndex < views.size(); msgIndex++) {
+            clientMsgs.emplace_back();
+            CopyMessage(views[msgIndex], clientMsgs.back());
+        }
+    }
+
+    static void Output(MessageBatch& batch, int tcpID, const std::vector<MessageView>& views)
+    {
+        for (size_t msgIndex = 0; msgIndex < views.size(); msgIndex++) {
+            batch.Add(tcpID, views[msgIndex]);
         }
     }
 
+    static void CopyMessage(const MessageView& view, MessageView& msg)
+    {
+        msg = view;
+    }
+
     template <typename T>
-    int Receive(std::map<int, std::vector<Message<T>>>& msgs)
+    static void CopyMessage(const MessageView& view, Message<T>& msg)
     {
-        // 执行tcp socket的accept
-        SocketAccept();
+        msg.type = view.type;
+        msg.chunk = view.chunk;
+        msg.data.assign(view.data, view.data + view.len);
+    }
 
-        msgs.clear();
+    // 新连接进来的客户端开始握手超时,心跳超时等的计时
+    void AddClientTimers(int tcpID)
+    {
+        const TCPOptions& options = clientManager.options;
+        int64_t now = MonotonicClock::NowMs();
+        if (options.handshakeTimeoutMs > 0) {
+            timerWheel.Add(now + options.handshakeTimeoutMs, tcpID, TIMER_HANDSHAKE);
+        }
+        if (options.heartbeatTimeoutMs > 0) {
+            timerWheel.Add(now + options.heartbeatTimeoutMs, tcpID, TIMER_HEARTBEAT);
+        }
+        if (options.autoTuneBuffer) {
+            timerWheel.Add(now + DNET_SERVER_UPDATE_INTERVAL_MS, tcpID, TIMER_UPDATE);
+        }
+    }
 
-        for (auto itr = clientManager.mClients.begin(); itr != clientManager.mClients.end();) {
-            std::vector<Message<T>> clientMsgs; //TODO:这里考虑先创建在传入参数,如果没有消息再擦除
-            if (itr->second->Receive(clientMsgs) > 0) {
-                msgs[itr->first] = clientMsgs;
-            }
+    // 如果客户端的发送队列里还有数据,记录下来在UpdateClients()里继续发送
+    void CheckSendQueue(TCPClient* client)
+    {
+        if (client->SendQueueSize() > 0) {
+            flushIDs.insert(client->TcpID());
+        }
+    }
+
+    /**
+     * 删除一个客户端并且发出远程关闭的事件.
+     *
+     * @param [in]     client 客户端.
+     * @param [in,out] lock   这个客户端的锁,删除之前会解锁.
+     */
+    void RemoveClient(TCPClient* client, std::unique_lock<std::recursive_mutex>& lock)
+    {
+        int tcpID = client->TcpID();
+        TCPEventRemoteClose evArgs = TCPEventRemoteClose(tcpID);
+        eventRemoteClose.notify(this, evArgs); //发出事件
+
+        clientManager.EraseAcceptRecord(client);
+        if (lock.owns_lock()) {
+            lock.unlock();
+        }
+        clientManager.mClients.Remove(tcpID);
+        clientManager.groups.LeaveAll(tcpID);
+        clientManager.DeleteClient(client);
+        flushIDs.erase(tcpID);
+    }
 
-            //清理出错的客户端
-            if (itr->second->isError() && itr->second->TimeFormErrorToNow() > 100) {
-                LogI("TCPServer.Receive():一个客户端 id=%d 已经网络错误,删除它!", itr->second->TcpID());
-                TCPEventRemoteClose evArgs = TCPEventRemoteClose(itr->second->TcpID());
-                eventRemoteClose.notify(this, evArgs); //发出事件
+    // 回收客户端对象,处理到期了的定时器,继续发送发送队列里的数据.开销只和到期的定时器以及有待发送数据的客户端个数有关
+    void UpdateClients()
+    {
+        int64_t now = MonotonicClock::NowMs();
+        if (now - lastRecycleTime >= DNET_SERVER_RECYCLE_INTERVAL_MS) {
+            lastRecycleTime = now;
+            clientManager.RecycleClients(); // 删除了的客户端对象放进对象池
+        }
 
-                clientManager.mAcceptClients.erase(itr->second->AcceptData()->uuidC);
-                delete itr->second;
-                itr = clientManager.mClients.erase(itr);
+        UpdateTimers(now);
+
+        for (auto itr = flushIDs.begin(); itr != flushIDs.end();) {
+            TCPClient* client = clientManager.GetClient(*itr);
+            if (client == nullptr) {
+                itr = flushIDs.erase(itr);
+                continue;
             }
-            else {
-                itr++;
+            auto lock = LockClient(client);
+            if (client->Update() < 0 || client->SendQueueSize() == 0) {
+                itr = flushIDs.erase(itr);
+                continue;
             }
+            ++itr;
         }
+    }
 
-        return (int)msgs.size();
+    // 处理到期了的定时器:握手超时,心跳超时,删除出错了的客户端
+    void UpdateTimers(int64_t now)
+    {
+        const TCPOptions& options = clientManager.options;
+
+        // 出错了的客户端保留一段时间再删除,这段时间内可以断线重连
+        clientManager.TakeErrors(errorIDs);
+        for (int tcpID : errorIDs) {
+            timerWheel.Add(now + options.errorReapDelayMs, tcpID, TIMER_REAP);
+        }
+
+        timerWheel.Advance(now, expiredTimers);
+        for (const TimerWheel::Timer& timer : expiredTimers) {
+            // 客户端已经删除了的时候tcpID的版本号不一样了,这里会找不到.
+            // 断线重连的客户端会继承旧的tcpID,也继承了它的定时器
+            TCPClient* client = clientManager.GetClient(timer.id);
+            if (client == nullptr) {
+                continue;
+            }
+            auto lock = LockClient(client);
+
+            if (timer.type == TIMER_HANDSHAKE) {
+                if (!client->isError() && !client->IsAccepted()) {
+                    LogW("TCPServer.UpdateTimers():客户端 id=%d 在%dms内没有完成握手,删除它!", timer.id, options.handshakeTimeoutMs);
+                    RemoveClient(client, lock);
+                }
+            }
+            else if (timer.type == TIMER_HEARTBEAT) {
+                if (options.heartbeatTimeoutMs > 0) {
+                    int remainMs = client->isError() ? 0 : client->CheckHeartbeat(); // 超时了会出错,之后由TIMER_REAP删除
+                    timerWheel.Add(now + (remainMs > 0 ? remainMs : options.heartbeatTimeoutMs), timer.id, TIMER_HEARTBEAT);
+                }
+            }
+            else if (timer.type == TIMER_REAP) {
+                // 继承了这个tcpID的客户端可能是后来才出错的,它有自己的TIMER_REAP
+                if (client->isError() && client->TimeFormErrorToNow() * 1000 + DNET_TIMER_WHEEL_TICK_MS >= options.errorReapDelayMs) {
+                    LogI("TCPServer.UpdateTimers():一个客户端 id=%d 已经网络错误,删除它!", timer.id);
+                    RemoveClient(client, lock);
+                }
+            }
+            else if (timer.type == TIMER_UPDATE) {
+                if (options.autoTuneBuffer) {
+                    client->Update(); // 自动调整socket缓存
+                    timerWheel.Add(now + DNET_SERVER_UPDATE_INTERVAL_MS, timer.id, TIMER_UPDATE);
+                }
+            }
+        }
     }
 
     int KCPSend(int tcpID, const char* data, size_t len, int type)
@@ -241,16 +894,19 @@ class TCPServer::Impl
         if (client == nullptr) {
             return -1;
         }
-
+        MonotonicClock::Refresh(); // 只调用KCP的函数的时候时钟也要更新,ikcp_update()使用它
+        auto lock = LockClient(client);
         return client->KCPSend(data, len, type); //发送打包后的数据
     }
 
-    int KCPReceive(std::map<int, std::vector<TextMessage>>& msgs)
+    template <typename TOut>
+    int KCPReceive(TOut& out)
     {
         if (acceptUDPSocket == nullptr) {
             return -1;
         }
-        msgs.clear();
+        ClearOutput(out);
+        MonotonicClock::Refresh(); // 这一次KCP接收的时间戳都使用这个时间
 
         // 当前接收长度
         int receLen = 0;
@@ -266,24 +922,21 @@ class TCPServer::Impl
             LogE("TCPServer.KCPReceive():异常e=%s", e.what());
         }
 
-        for (auto itr = clientManager.mAcceptClients.begin(); itr != clientManager.mAcceptClients.end();) {
-            std::vector<TextMessage> clientMsgs;
-            int res = itr->second->KCPReceive(receBuffUDP.data(), receLen, clientMsgs);
-            if (res < 0) {
-                //-1或者未初始化等其他值是不匹配的信道
-                itr++;
-                continue;
-            }
-            else {
-                //==0或者大于0是匹配的信道,那么不需要再往下遍历了
-                if (res > 0) {
-                    msgs[itr->second->TcpID()] = clientMsgs;
-                }
-                break;
+        if (receLen < 24) {
+            return OutputCount(out); // 没有数据或者比kcp的包头(24字节)还短
+        }
+
+        // kcp的conv就是tcpID,直接找到这个信道
+        TCPClient* client = clientManager.GetClient((int)ikcp_getconv(receBuffUDP.data()));
+        if (client != nullptr) {
+            auto lock = LockClient(client);
+            //-1或者未初始化等其他值是不匹配的信道
+            if (client->KCPReceive(receBuffUDP.data(), receLen, clientViews) > 0) {
+                Output(out, client->TcpID(), clientViews);
             }
         }
 
-        return (int)msgs.size();
+        return OutputCount(out);
     }
 };
 
@@ -306,12 +959,13 @@ std::string TCPServer::UUID()
 std::string TCPServer::SetUUID(const std::string& uuid)
 {
     _impl->uuid = uuid;
+    _impl->clientManager.uuid = uuid;
     return _impl->uuid;
 }
 
-void TCPServer::Start()
+void TCPServer::Start(int ioThreadCount)
 {
-    _impl->Start(name, host, port);
+    _impl->Start(name, host, port, ioThreadCount);
 }
 
 void TCPServer::Close()
@@ -324,11 +978,9 @@ bool TCPServer::IsStarted()
     return _impl->IsStarted();
 }
 
-void TCPServer::WaitStarted()
+bool TCPServer::WaitStarted(int timeoutMs)
 {
-    while (!IsStarted()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    }
+    return _impl->WaitStarted(timeoutMs);
 }
 
 int TCPServer::Send(int tcpID, const char* data, size_t len, int type)
@@ -336,6 +988,102 @@ int TCPServer::Send(int tcpID, const char* data, size_t len, int type)
     return _impl->Send(tcpID, data, len, type);
 }
 
+int TCPServer::Send(int tcpID, const char* data, size_t len, int type, int priority)
+{
+    return _impl->Send(tcpID, data, len, type, priority);
+}
+
+int TCPServer::Broadcast(const char* data, size_t len, int type, const std::function<bool(int)>& filter)
+{
+    BroadcastFrame frame(data, len, type);
+    return _impl->Broadcast(frame, filter, false);
+}
+
+int TCPServer::KCPBroadcast(const char* data, size_t len, int type, const std::function<bool(int)>& filter)
+{
+    BroadcastFrame frame(data, len, type);
+    return _impl->Broadcast(frame, filter, true);
+}
+
+size_t TCPServer::Post(int tcpID, const char* data, size_t len, int type)
+{
+    return _impl->Post(tcpID, data, len, type, false);
+}
+
+size_t TCPServer::KCPPost(int tcpID, const char* data, size_t len, int type)
+{
+    return _impl->Post(tcpID, data, len, type, true);
+}
+
+size_t TCPServer::PostQueueSize()
+{
+    return _impl->postQueue.Size();
+}
+
+int TCPServer::CreateGroup()
+{
+    return _impl->clientManager.groups.Create();
+}
+
+bool TCPServer::RemoveGroup(int groupID)
+{
+    return _impl->clientManager.groups.Remove(groupID);
+}
+
+bool TCPServer::JoinGroup(int groupID, int tcpID)
+{
+    if (_impl->clientManager.GetClient(tcpID) == nullptr) {
+        return false;
+    }
+    return _impl->clientManager.groups.Join(groupID, tcpID);
+}
+
+bool TCPServer::LeaveGroup(int groupID, int tcpID)
+{
+    return _impl->clientManager.groups.Leave(groupID, tcpID);
+}
+
+std::vector<int> TCPServer::GroupMembers(int groupID)
+{
+    const std::vector<int>* members = _impl->clientManager.groups.Members(groupID);
+    if (members == nullptr) {
+        return std::vector<int>();
+    }
+    return *members;
+}
+
+int TCPServer::GroupSend(int groupID, const char* data, size_t len, int type)
+{
+    BroadcastFrame frame(data, len, type);
+    return _impl->GroupSend(groupID, frame, false);
+}
+
+int TCPServer::GroupKCPSend(int groupID, const char* data, size_t len, int type)
+{
+    BroadcastFrame frame(data, len, type);
+    return _impl->GroupSend(groupID, frame, true);
+}
+
+void TCPServer::SetOptions(const TCPOptions& options)
+{
+    _impl->SetOptions(options);
+}
+
+const TCPOptions& TCPServer::Options()
+{
+    return _impl->clientManager.options;
+}
+
+void TCPServer::Cork()
+{
+    _impl->Cork();
+}
+
+void TCPServer::Uncork()
+{
+    _impl->Uncork();
+}
+
 Poco::BasicEvent<TCPEventAccept>& TCPServer::EventAccept()
 {
     return _impl->eventAccept;
@@ -351,29 +1099,96 @@ Poco::BasicEvent<TCPEventRemoteClose>& TCPServer::EventRemoteClose()
     return _impl->eventRemoteClose;
 }
 
+Poco::BasicEvent<TCPEventBackpressure>& TCPServer::EventBackpressure()
+{
+    return _impl->eventBackpressure;
+}
+
+size_t TCPServer::MemoryUsage(int tcpID)
+{
+    TCPClient* client = _impl->clientManager.GetClient(tcpID);
+    if (client == nullptr) {
+        return 0;
+    }
+    auto lock = _impl->LockClient(client);
+    return client->MemoryUsage();
+}
+
+size_t TCPServer::SendQueueSize(int tcpID)
+{
+    TCPClient* client = _impl->clientManager.GetClient(tcpID);
+    if (client == nullptr) {
+        return 0;
+    }
+    auto lock = _impl->LockClient(client);
+    return client->SendQueueSize();
+}
+
+AcceptStats TCPServer::GetAcceptStats()
+{
+    AcceptStats stats = _impl->acceptStats;
+    stats.pendingCount = (int)(_impl->clientManager.mClients.Size() - _impl->clientManager.mAcceptClients.Size());
+    stats.backlogCount = _impl->serverSocket != nullptr ? ListenQueueLength(*_impl->serverSocket) : -1;
+    return stats;
+}
+
 int TCPServer::Available(int tcpID)
 {
     return _impl->Available(tcpID);
 }
 
-int TCPServer::Receive(std::map<int, std::vector<BinMessage>>& msgs)
+int TCPServer::Receive(std::map<int, std::vector<BinMessage>>& msgs, int timeoutMs)
+{
+    return _impl->Receive(msgs, timeoutMs);
+}
+
+int TCPServer::Receive(std::map<int, std::vector<TextMessage>>& msgs, int timeoutMs)
 {
-    return _impl->Receive(msgs);
+    return _impl->Receive(msgs, timeoutMs);
 }
 
-int TCPServer::Receive(std::map<int, std::vector<TextMessage>>& msgs)
+int TCPServer::Receive(std::map<int, std::vector<MessageView>>& msgs, int timeoutMs)
 {
-    return _impl->Receive(msgs);
+    return _impl->Receive(msgs, timeoutMs);
+}
+
+int TCPServer::Receive(MessageBatch& batch, int timeoutMs)
+{
+    return _impl->Receive(batch, timeoutMs);
+}
+
+void TCPServer::RegisterHandler(int type, const MessageHandler& handler)
+{
+    if (type == XUEXUE_TCP_CLIENT_INTERNAL_CMD_TYPE) {
+        LogE("TCPServer.RegisterHandler():%d是保留的命令类型,不能注册!", type);
+        return;
+    }
+    _impl->clientManager.dispatcher.Register(type, handler);
+}
+
+void TCPServer::UnregisterHandler(int type)
+{
+    _impl->clientManager.dispatcher.Unregister(type);
+}
+
+int TCPServer::WaitAvailableFor(int tcpID, int timeoutMs)
+{
+    return _impl->WaitAvailable(tcpID, timeoutMs);
 }
 
 int TCPServer::WaitAvailable(int tcpID, int waitCount)
 {
-    return _impl->WaitAvailable(tcpID, waitCount);
+    return WaitAvailableFor(tcpID, waitCount * DNET_WAIT_COUNT_MS);
+}
+
+int TCPServer::WaitAcceptedFor(int tcpID, int timeoutMs)
+{
+    return _impl->WaitAccepted(tcpID, timeoutMs);
 }
 
 int TCPServer::WaitAccepted(int tcpID, int waitCount)
 {
-    return _impl->WaitAccepted(tcpID, waitCount);
+    return WaitAcceptedFor(tcpID, waitCount * DNET_WAIT_COUNT_MS);
 }
 
 void* TCPServer::GetClientSocket(int tcpID)
@@ -386,15 +1201,15 @@ void* TCPServer::GetClientSocket(int tcpID)
 }
 int TCPServer::RemoteCount()
 {
-    return (int)_impl->clientManager.mAcceptClients.size();
+    return (int)_impl->clientManager.mAcceptClients.Size();
 }
 
 std::map<int, TCPClient*> TCPServer::GetRemotes()
 {
     std::map<int, TCPClient*> map;
-    for (auto& kvp : _impl->clientManager.mAcceptClients) {
-        map[kvp.second->TcpID()] = kvp.second;
-    }
+    _impl->clientManager.mAcceptClients.ForEach([&map](const std::string& uuid, TCPClient*& client) {
+        map[client->TcpID()] = client;
+    });
     return map;
 }
 
@@ -407,4 +1222,9 @@ int TCPServer::KCPReceive(std::map<int, std::vector<TextMessage>>& msgs)
 {
     return _impl->KCPReceive(msgs);
 }
+
+int TCPServer::KCPReceive(MessageBatch& batch)
+{
+    return _impl->KCPReceive(batch);
+}
 } // namespace dnet
@@ -3,9 +3,12 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <functional>
 
 #include "TCPEvent.h"
 #include "TCPClient.h"
+#include "AcceptStats.h"
+#include "Protocol/MessageBatch.hpp"
 
 #include "Poco/BasicEvent.h"
 #include "Poco/Delegate.h"
@@ -52,12 +55,17 @@ class TCPServer
     std::string SetUUID(const std::string& uuid);
 
     /**
-     * 启动监听.
+     * 启动监听.ioThreadCount大于0的时候(只支持linux)启动这么多个IO线程,
+     * 客户端按tcpID分配到各个IO线程里接收和解包,Receive()只是取走它们接收到的消息.
+     * 握手,心跳,发送和各种事件仍然在调用Receive()等函数的线程里执行.
+     * KCP不分配到IO线程,因为所有客户端的KCP数据都从同一个UDP socket收到,仍然在调用KCPReceive()的线程里执行.
      *
      * @author daixian
      * @date 2020/12/21
+     *
+     * @param  ioThreadCount (Optional) IO线程的个数,为0则所有工作都在调用Receive()的线程里执行.
      */
-    void Start();
+    void Start(int ioThreadCount = 0);
 
     /**
      * 关闭服务器.
@@ -78,12 +86,16 @@ class TCPServer
     bool IsStarted();
 
     /**
-     * 等待启动完成.
+     * 等待启动完成,可以在其它线程里等待Start().
      *
      * @author daixian
      * @date 2020/12/23
+     *
+     * @param  timeoutMs (Optional) 最多等待的毫秒数.
+     *
+     * @returns 已经启动了返回true.
      */
-    void WaitStarted();
+    bool WaitStarted(int timeoutMs = 5000);
 
     /**
      * 得到Accept的事件.
@@ -116,7 +128,52 @@ class TCPServer
     Poco::BasicEvent<TCPEventRemoteClose>& EventRemoteClose();
 
     /**
-     * 非阻塞的发送一段数据.正常发送成功返回0.
+     * 客户端发送队列积压的事件.事件处理中可以设置disconnect来断开这个慢的客户端.
+     *
+     * @author daixian
+     * @date 2021/3/17
+     *
+     * @returns A reference to a Poco::BasicEvent<TCPEventBackpressure>
+     */
+    Poco::BasicEvent<TCPEventBackpressure>& EventBackpressure();
+
+    /**
+     * 某个客户端发送队列里等待发送的字节数.
+     *
+     * @author daixian
+     * @date 2021/3/17
+     *
+     * @param  tcpID tcp连接的ID.
+     *
+     * @returns 字节数.
+     */
+    size_t SendQueueSize(int tcpID);
+
+    /**
+     * 某个客户端连接当前占用的内存字节数(估计值).空闲的连接不占用接收缓存,
+     * 接收缓存是每个接收线程的所有连接共用的.
+     *
+     * @author daixian
+     * @date 2021/3/28
+     *
+     * @param  tcpID tcp连接的ID.
+     *
+     * @returns 字节数,找不到这个连接返回0.
+     */
+    size_t MemoryUsage(int tcpID);
+
+    /**
+     * 得到接受连接的统计.
+     *
+     * @author daixian
+     * @date 2021/3/23
+     *
+     * @returns 统计.
+     */
+    AcceptStats GetAcceptStats();
+
+    /**
+     * 非阻塞的发送一段数据,发送不完的部分进入这个客户端的发送队列.
      *
      * @author daixian
      * @date 2020/5/12
@@ -126,10 +183,122 @@ class TCPServer
      * @param  len   数据长度.
      * @param  type (Optional) 这个数据的类型,注意-1024是认证命令等保留类型,不能使用,应该使用非负的数作为类型.
      *
-     * @returns 发送成功的数据长度.
+     * @returns 发送或者进入发送队列的数据长度,失败返回-1,发送队列超过上限返回-2.
      */
     int Send(int tcpID, const char* data, size_t len, int type = -1);
 
+    /**
+     * 以指定的优先级非阻塞的发送一段数据.这个客户端的发送队列积压的时候,优先级高的消息在当前的帧发送完之后
+     * 插到优先级低的消息前面,同一个优先级的消息保持顺序.协议不变,对方不需要支持优先级.
+     *
+     * @author daixian
+     * @date 2021/4/3
+     *
+     * @param  tcpID    tcp连接的ID.
+     * @param  data     要发送的数据.
+     * @param  len      数据长度.
+     * @param  type     这个数据的类型.
+     * @param  priority 发送优先级(DNET_SEND_PRIORITY_*),小于0表示由TCPOptions::typePriority决定.
+     *
+     * @returns 发送或者进入发送队列的数据长度,失败返回-1,发送队列超过上限返回-2.
+     */
+    int Send(int tcpID, const char* data, size_t len, int type, int priority);
+
+    /**
+     * 从任意线程投递一条消息.数据拷贝进一个无锁的多生产者单消费者队列,不会阻塞也不加锁,
+     * 由调用Receive()的线程在每一轮里批量的取出来发送(和Send()一样).
+     * 其它的发送函数都只能在调用Receive()的线程里调用.
+     *
+     * @author daixian
+     * @date 2021/4/2
+     *
+     * @param  tcpID tcp连接的ID.
+     * @param  data  要发送的数据.
+     * @param  len   数据长度.
+     * @param  type  (Optional) 这个数据的类型.
+     *
+     * @returns 投递之后队列里等待发送的消息条数(估计值).
+     */
+    size_t Post(int tcpID, const char* data, size_t len, int type = -1);
+
+    /**
+     * 从任意线程投递一条走kcp通道的消息,和Post()一样由调用Receive()的线程发送.
+     *
+     * @author daixian
+     * @date 2021/4/2
+     *
+     * @param  tcpID tcp连接的ID.
+     * @param  data  要发送的数据.
+     * @param  len   数据长度.
+     * @param  type  (Optional) 这个数据的类型.
+     *
+     * @returns 投递之后队列里等待发送的消息条数(估计值).
+     */
+    size_t KCPPost(int tcpID, const char* data, size_t len, int type = -1);
+
+    /**
+     * 投递了还没有发送的消息条数(估计值),任意线程都可以调用,用于监控.
+     *
+     * @author daixian
+     * @date 2021/4/2
+     *
+     * @returns 消息条数.
+     */
+    size_t PostQueueSize();
+
+    /**
+     * 向所有完成了握手的客户端广播一段数据.数据只打包一次,所有客户端的发送队列共享同一个帧,
+     * 每多一个接收者只是多一次入队,不会重新打包和拷贝.
+     *
+     * @author daixian
+     * @date 2021/3/31
+     *
+     * @param  data   要发送的数据.
+     * @param  len    数据长度.
+     * @param  type   这个数据的类型.
+     * @param  filter (Optional) 过滤函数,参数是tcpID,返回false的客户端不发送.为空则发送给所有客户端.
+     *
+     * @returns 发送成功(或者进入了发送队列)的客户端个数.
+     */
+    int Broadcast(const char* data, size_t len, int type, const std::function<bool(int)>& filter = nullptr);
+
+    /**
+     * 设置所有客户端连接的TCP选项(Nagle/QUICKACK/CORK策略等),对已经连接的客户端也立即生效.
+     *
+     * @author daixian
+     * @date 2021/3/16
+     *
+     * @param  options TCP选项.
+     */
+    void SetOptions(const TCPOptions& options);
+
+    /**
+     * 当前的TCP选项.
+     *
+     * @author daixian
+     * @date 2021/3/16
+     *
+     * @returns TCP选项.
+     */
+    const TCPOptions& Options();
+
+    /**
+     * 所有客户端开始攒发送的数据,之后Send()的消息会在Uncork()的时候每个客户端一次发送出去.
+     * 通常在一帧的开始调用.
+     *
+     * @author daixian
+     * @date 2021/3/16
+     */
+    void Cork();
+
+    /**
+     * 所有客户端停止攒发送的数据,并且把攒下的消息每个客户端一次发送出去.通常在一帧的结束调用.
+     *
+     * @author daixian
+     * @date 2021/3/16
+     */
+    void Uncork();
+
     /**
      * 可读取(接收)的数据数.
      *
@@ -140,9 +309,25 @@ class TCPServer
      */
     int Available(int tcpID);
 
+    /**
+     * 等待,一直等到可接收有数据.使用了IO线程的时候数据可能会马上被IO线程取走,
+     * 所以这时返回的Available()可能是0.
+     *
+     * @author daixian
+     * @date 2021/3/25
+     *
+     * @param  tcpID     tcpID.
+     * @param  timeoutMs (Optional) 最多等待的毫秒数,数据一到达就会返回.
+     *
+     * @returns 等于Available()函数的返回值.
+     */
+    int WaitAvailableFor(int tcpID, int timeoutMs = 5000);
+
     /**
      * 等待,一直等到可接收有数据.
      *
+     * @deprecated 使用WaitAvailableFor(),它的参数是毫秒数.
+     *
      * @author daixian
      * @date 2020/12/23
      *
@@ -157,12 +342,27 @@ class TCPServer
      * 等待Accepte完成.会调用Receive()函数.
      *
      * @author daixian
+     * @date 2021/3/25
+     *
+     * @param  tcpID     tcpID.
+     * @param  timeoutMs (Optional) 最多等待的毫秒数.
+     *
+     * @returns 认证通过了返回1,超时或者连接断开了返回0.
+     */
+    int WaitAcceptedFor(int tcpID, int timeoutMs = 5000);
+
+    /**
+     * 等待Accepte完成.会调用Receive()函数.
+     *
+     * @deprecated 使用WaitAcceptedFor(),它的参数是毫秒数.
+     *
+     * @author daixian
      * @date 2021/1/11
      *
      * @param  tcpID     tcpID.
-     * @param  waitCount (Optional) Number of waits.
+     * @param  waitCount (Optional) 等待的次数,一次100ms.
      *
-     * @returns An int.
+     * @returns 认证通过了返回1,超时或者连接断开了返回0.
      */
     int WaitAccepted(int tcpID, int waitCount = 50);
 
@@ -172,12 +372,13 @@ class TCPServer
      * @author daixian
      * @date 2020/5/12
      *
-     * @param [out] msgs  以conv为key的客户端的所有消息.
+     * @param [out] msgs      以conv为key的客户端的所有消息.
+     * @param       timeoutMs (Optional) 没有任何socket就绪的时候最多阻塞等待的毫秒数(linux上使用epoll时有效).
      *
      * @returns 返回大于0的实际接收到的消息条数.
      */
 
-    int Receive(std::map<int, std::vector<BinMessage>>& msgs);
+    int Receive(std::map<int, std::vector<BinMessage>>& msgs, int timeoutMs = 0);
 
     /**
      * 尝试非阻塞的接收.返回-1表示没有接收到完整的消息或者接收失败,只有接收成功了这里才会返回>0的实际接收消息条数.
@@ -185,12 +386,62 @@ class TCPServer
      * @author daixian
      * @date 2020/12/22
      *
-     * @param [out] types 以conv为key的所有客户端的消息类型.
-     * @param [out] msgs  以conv为key的所有客户端的消息.
+     * @param [out] msgs      以conv为key的所有客户端的消息.
+     * @param       timeoutMs (Optional) 没有任何socket就绪的时候最多阻塞等待的毫秒数(linux上使用epoll时有效).
      *
      * @returns 接收到的数据条数.
      */
-    int Receive(std::map<int, std::vector<TextMessage>>& msgs);
+    int Receive(std::map<int, std::vector<TextMessage>>& msgs, int timeoutMs = 0);
+
+    /**
+     * 尝试非阻塞的接收消息的视图,不拷贝消息数据.视图直接指向接收缓存,
+     * 只在下一次调用Receive之前有效.
+     *
+     * @author daixian
+     * @date 2021/3/12
+     *
+     * @param [out] msgs      以conv为key的所有客户端的消息视图.
+     * @param       timeoutMs (Optional) 没有任何socket就绪的时候最多阻塞等待的毫秒数(linux上使用epoll时有效).
+     *
+     * @returns 接收到消息的客户端个数.
+     */
+    int Receive(std::map<int, std::vector<MessageView>>& msgs, int timeoutMs = 0);
+
+    /**
+     * 接收所有客户端的消息到一个平铺的批次里.batch由调用者重复使用,它清空的时候不释放内存,
+     * 所以单线程运行的时候预热之后每次接收都不会再分配内存.
+     *
+     * @author daixian
+     * @date 2021/3/25
+     *
+     * @param [out] batch     所有客户端的消息.
+     * @param       timeoutMs (Optional) 没有任何socket就绪的时候最多阻塞等待的毫秒数(linux上使用epoll时有效).
+     *
+     * @returns 接收到的消息条数.
+     */
+    int Receive(MessageBatch& batch, int timeoutMs = 0);
+
+    /**
+     * 注册一个消息类型的处理函数,对所有客户端有效.这个类型的消息在Receive()和KCPReceive()
+     * 解包之后直接交给处理函数,不会再出现在Receive()的结果里.
+     *
+     * @author daixian
+     * @date 2021/3/20
+     *
+     * @param  type    消息类型,不能是-1024等保留类型.
+     * @param  handler 处理函数,参数里有消息来自的tcpID,为空则移除.
+     */
+    void RegisterHandler(int type, const MessageHandler& handler);
+
+    /**
+     * 移除一个消息类型的处理函数.
+     *
+     * @author daixian
+     * @date 2021/3/20
+     *
+     * @param  type 消息类型.
+     */
+    void UnregisterHandler(int type);
 
     /**
      * 得到这个客户端的Poco的Socket指针(Poco::Net::StreamSocket).
@@ -239,6 +490,112 @@ class TCPServer
      */
     int KCPSend(int tcpID, const char* data, size_t len, int type = -1);
 
+    /**
+     * 走kcp通道向所有完成了握手的客户端广播一段数据.协议头只打包一次,所有信道共用打包好的帧.
+     *
+     * @author daixian
+     * @date 2021/3/31
+     *
+     * @param  data   要发送的数据.
+     * @param  len    数据长度.
+     * @param  type   这个数据的类型.
+     * @param  filter (Optional) 过滤函数,参数是tcpID,返回false的客户端不发送.为空则发送给所有客户端.
+     *
+     * @returns 发送成功的客户端个数.
+     */
+    int KCPBroadcast(const char* data, size_t len, int type, const std::function<bool(int)>& filter = nullptr);
+
+    /**
+     * 创建一个客户端的分组(房间,地图区域等),之后可以对组里的所有客户端一起发送.
+     * 客户端断开之后被删除的时候会自动离开它所有的组,断线重连的客户端继承原来的tcpID所以也保留了分组.
+     *
+     * @author daixian
+     * @date 2021/4/1
+     *
+     * @returns 组id,失败返回-1.
+     */
+    int CreateGroup();
+
+    /**
+     * 删除一个组.
+     *
+     * @author daixian
+     * @date 2021/4/1
+     *
+     * @param  groupID 组id.
+     *
+     * @returns 组不存在返回false.
+     */
+    bool RemoveGroup(int groupID);
+
+    /**
+     * 一个客户端加入一个组.
+     *
+     * @author daixian
+     * @date 2021/4/1
+     *
+     * @param  groupID 组id.
+     * @param  tcpID   客户端的tcpID.
+     *
+     * @returns 组或者客户端不存在,或者已经在组里了返回false.
+     */
+    bool JoinGroup(int groupID, int tcpID);
+
+    /**
+     * 一个客户端离开一个组.
+     *
+     * @author daixian
+     * @date 2021/4/1
+     *
+     * @param  groupID 组id.
+     * @param  tcpID   客户端的tcpID.
+     *
+     * @returns 组不存在或者客户端不在组里返回false.
+     */
+    bool LeaveGroup(int groupID, int tcpID);
+
+    /**
+     * 一个组的所有成员.
+     *
+     * @author daixian
+     * @date 2021/4/1
+     *
+     * @param  groupID 组id.
+     *
+     * @returns 成员的tcpID,组不存在返回空.
+     */
+    std::vector<int> GroupMembers(int groupID);
+
+    /**
+     * 向一个组的所有成员发送一段数据,和Broadcast()一样数据只打包一次.
+     *
+     * @author daixian
+     * @date 2021/4/1
+     *
+     * @param  groupID 组id.
+     * @param  data    要发送的数据.
+     * @param  len     数据长度.
+     * @param  type    (Optional) 这个数据的类型.
+     *
+     * @returns 发送成功(或者进入了发送队列)的客户端个数,组不存在返回-1.
+     */
+    int GroupSend(int groupID, const char* data, size_t len, int type = -1);
+
+    /**
+     * 走kcp通道向一个组的所有成员发送一段数据,和KCPBroadcast()一样协议头只打包一次.
+     *
+     * @author daixian
+     * @date 2021/4/1
+     *
+     * @param  groupID 组id.
+     * @param  data    要发送的数据.
+     * @param  len     数据长度.
+     * @param  type    (Optional) 这个数据的类型.
+     *
+     * @returns 发送成功的客户端个数,组不存在返回-1.
+     */
+    int GroupKCPSend(int groupID, const char* data, size_t len, int type = -1);
+
     /**
      * Kcp receive
      *
@@ -251,6 +608,18 @@ class TCPServer
      */
     int KCPReceive(std::map<int, std::vector<TextMessage>>& msgs);
 
+    /**
+     * KCP接收所有客户端的消息到一个平铺的批次里,batch由调用者重复使用.
+     *
+     * @author daixian
+     * @date 2021/3/25
+     *
+     * @param [out] batch 所有客户端的消息.
+     *
+     * @returns 接收到的消息条数,还没有启动返回-1.
+     */
+    int KCPReceive(MessageBatch& batch);
+
   private:
     class Impl;
     Impl* _impl;
@@ -0,0 +1,184 @@
+﻿#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "MonotonicClock.h"
+
+// 时间轮每一层的槽位数的位数
+#define DNET_TIMER_WHEEL_BITS 6
+
+// 时间轮的层数,一共可以表示(1 << (DNET_TIMER_WHEEL_BITS * DNET_TIMER_WHEEL_LEVELS))个tick
+#define DNET_TIMER_WHEEL_LEVELS 4
+
+// 时间轮默认的一个tick的毫秒数
+#define DNET_TIMER_WHEEL_TICK_MS 10
+
+namespace dnet {
+
+/**
+ * 分层的时间轮,用来管理大量连接的超时(心跳,握手,错误之后的删除).
+ * 添加定时器是O(1)的,Advance()的开销只和经过的tick数以及到期的定时器个数有关,和定时器总数无关.
+ * 定时器不能取消,到期之后由使用者检察它对应的对象(比如用SlotMap的带版本号的id)是否还需要处理.
+ * 时间使用MonotonicClock的毫秒数.只能在一个线程里使用.
+ *
+ * @author daixian
+ * @date 2021/3/30
+ */
+class TimerWheel
+{
+  public:
+    /**
+     * 一个定时器.
+     */
+    struct Timer
+    {
+        // 到期的tick.
+        uint64_t expire;
+
+        // 定时器对应的对象的id.
+        int id;
+
+        // 定时器的类型,由使用者定义.
+        int type;
+    };
+
+    /**
+     * 构造.
+     *
+     * @param  tickMs 一个tick的毫秒数,定时器的精度.
+     */
+    TimerWheel(int tickMs = DNET_TIMER_WHEEL_TICK_MS)
+        : tickMs(tickMs > 0 ? tickMs : 1)
+    {
+        wheels.resize(DNET_TIMER_WHEEL_LEVELS * SLOT_COUNT);
+        currentTick = (uint64_t)MonotonicClock::NowMs() / this->tickMs;
+    }
+    ~TimerWheel() {}
+
+    /**
+     * 删除所有的定时器,并且把当前时间设置为nowMs.
+     *
+     * @param  nowMs 当前的毫秒数.
+     */
+    void Reset(int64_t nowMs)
+    {
+        for (auto& slot : wheels) {
+            slot.clear();
+        }
+        count = 0;
+        currentTick = (uint64_t)nowMs / tickMs;
+    }
+
+    /**
+     * 添加一个定时器.已经过了的时间会在下一次Advance()的时候到期.
+     *
+     * @param  expireMs 到期的毫秒数(MonotonicClock的时间).
+     * @param  id       对象的id.
+     * @param  type     定时器的类型.
+     */
+    void Add(int64_t expireMs, int id, int type)
+    {
+        Timer timer;
+        timer.expire = expireMs > 0 ? (uint64_t)expireMs / tickMs : 0;
+        if (timer.expire <= currentTick) {
+            timer.expire = currentTick + 1; // 当前tick的槽位已经处理过了
+        }
+        timer.id = id;
+        timer.type = type;
+        Place(timer);
+        count++;
+    }
+
+    /**
+     * 时间前进到nowMs,取出所有到期了的定时器,按到期的先后顺序.
+     *
+     * @param       nowMs   当前的毫秒数.
+     * @param [out] expired 到期了的定时器(会先清空).
+     *
+     * @returns 到期了的定时器个数.
+     */
+    int Advance(int64_t nowMs, std::vector<Timer>& expired)
+    {
+        expired.clear();
+        uint64_t targetTick = (uint64_t)nowMs / tickMs;
+        while (currentTick < targetTick) {
+            if (count == 0) {
+                currentTick = targetTick; // 没有定时器的时候直接跳过去
+                break;
+            }
+            currentTick++;
+
+            // 高层的槽位转到了的时候把它里面的定时器重新放到低层
+            for (int level = 1; level < DNET_TIMER_WHEEL_LEVELS; level++) {
+                if ((currentTick & (((uint64_t)1 << (DNET_TIMER_WHEEL_BITS * level)) - 1)) != 0) {
+                    break;
+                }
+                std::vector<Timer>& slot = Slot(level, SlotIndex(currentTick, level));
+                cascade.swap(slot);
+                for (const Timer& timer : cascade) {
+                    Place(timer);
+                }
+                cascade.clear();
+            }
+
+            std::vector<Timer>& slot = Slot(0, SlotIndex(currentTick, 0));
+            count -= slot.size();
+            expired.insert(expired.end(), slot.begin(), slot.end());
+            slot.clear();
+        }
+        return (int)expired.size();
+    }
+
+    // 定时器的个数.
+    size_t Size() const
+    {
+        return count;
+    }
+
+  private:
+    // 每一层的槽位数
+    static const uint64_t SLOT_COUNT = (uint64_t)1 << DNET_TIMER_WHEEL_BITS;
+
+    // 一个tick的毫秒数
+    int64_t tickMs;
+
+    // 当前的tick,这个tick的定时器已经取出了
+    uint64_t currentTick;
+
+    // 所有层的槽位,第level层的第index个槽位是wheels[level * SLOT_COUNT + index]
+    std::vector<std::vector<Timer>> wheels;
+
+    // 降层的时候临时使用
+    std::vector<Timer> cascade;
+
+    // 定时器的个数
+    size_t count = 0;
+
+    static size_t SlotIndex(uint64_t tick, int level)
+    {
+        return (size_t)((tick >> (DNET_TIMER_WHEEL_BITS * level)) & (SLOT_COUNT - 1));
+    }
+
+    std::vector<Timer>& Slot(int level, size_t index)
+    {
+        return wheels[level * SLOT_COUNT + index];
+    }
+
+    // 按到期时间放到对应层的槽位,timer.expire不小于currentTick
+    void Place(Timer timer)
+    {
+        uint64_t delta = timer.expire - currentTick;
+        int level = 0;
+        while (level < DNET_TIMER_WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (DNET_TIMER_WHEEL_BITS * (level + 1)))) {
+            level++;
+        }
+        uint64_t maxDelta = ((uint64_t)1 << (DNET_TIMER_WHEEL_BITS * DNET_TIMER_WHEEL_LEVELS)) - 1;
+        if (delta > maxDelta) {
+            timer.expire = currentTick + maxDelta; // 超出了时间轮的范围,提前到最远的时间
+        }
+        Slot(level, SlotIndex(timer.expire, level)).push_back(timer);
+    }
+};
+
+} // namespace dnet
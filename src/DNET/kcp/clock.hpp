@@ -49,14 +49,20 @@ static inline void itimeofday(long *sec, long *usec)
 #endif
 }
 
-/* get clock in millisecond 64 */
+/* get monotonic clock in millisecond 64 */
 static inline IINT64 iclock64(void)
 {
+#if defined(__unix)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((IINT64)ts.tv_sec) * 1000 + (ts.tv_nsec / 1000000);
+#else
     long s, u;
     IINT64 value;
     itimeofday(&s, &u);
     value = ((IINT64)s) * 1000 + (u / 1000);
     return value;
+#endif
 }
 
 static inline IUINT32 iclock()
@@ -463,16 +463,49 @@ int ikcp_peeksize(const ikcpcb *kcp)
 }
 
 
+//---------------------------------------------------------------------
+// copy [pos, pos + size) of the gathered data (head + buffer) to dst
+//---------------------------------------------------------------------
+static void ikcp_gather(char *dst, int pos, int size, const char *head,
+	int headlen, const char *buffer)
+{
+	if (pos < headlen) {
+		int n = (headlen - pos < size)? (headlen - pos) : size;
+		if (head) {
+			memcpy(dst, head + pos, n);
+		}
+		dst += n;
+		pos += n;
+		size -= n;
+	}
+	if (buffer && size > 0) {
+		memcpy(dst, buffer + (pos - headlen), size);
+	}
+}
+
+
 //---------------------------------------------------------------------
 // user/upper level send, returns below zero for error
 //---------------------------------------------------------------------
 int ikcp_send(ikcpcb *kcp, const char *buffer, int len)
+{
+	return ikcp_sendv(kcp, NULL, 0, buffer, len);
+}
+
+
+//---------------------------------------------------------------------
+// gather send: head and buffer are sent as one message
+//---------------------------------------------------------------------
+int ikcp_sendv(ikcpcb *kcp, const char *head, int headlen,
+	const char *buffer, int len)
 {
 	IKCPSEG *seg;
 	int count, i;
+	int pos = 0;
 
 	assert(kcp->mss > 0);
-	if (len < 0) return -1;
+	if (len < 0 || headlen < 0) return -1;
+	len += headlen;
 
 	// append to previous segment in streaming mode (if possible)
 	if (kcp->stream != 0) {
@@ -488,10 +521,8 @@ int ikcp_send(ikcpcb *kcp, const char *buffer, int len)
 				}
 				iqueue_add_tail(&seg->node, &kcp->snd_queue);
 				memcpy(seg->data, old->data, old->len);
-				if (buffer) {
-					memcpy(seg->data + old->len, buffer, extend);
-					buffer += extend;
-				}
+				ikcp_gather(seg->data + old->len, pos, extend, head, headlen, buffer);
+				pos += extend;
 				seg->len = old->len + extend;
 				seg->frg = 0;
 				len -= extend;
@@ -519,17 +550,15 @@ int ikcp_send(ikcpcb *kcp, const char *buffer, int len)
 		if (seg == NULL) {
 			return -2;
 		}
-		if (buffer && len > 0) {
-			memcpy(seg->data, buffer, size);
+		if (len > 0) {
+			ikcp_gather(seg->data, pos, size, head, headlen, buffer);
 		}
 		seg->len = size;
 		seg->frg = (kcp->stream == 0)? (count - i - 1) : 0;
 		iqueue_init(&seg->node);
 		iqueue_add_tail(&seg->node, &kcp->snd_queue);
 		kcp->nsnd_que++;
-		if (buffer) {
-			buffer += size;
-		}
+		pos += size;
 		len -= size;
 	}
 
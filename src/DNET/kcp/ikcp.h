@@ -358,6 +358,11 @@ int ikcp_recv(ikcpcb *kcp, char *buffer, int len);
 // user/upper level send, returns below zero for error
 int ikcp_send(ikcpcb *kcp, const char *buffer, int len);
 
+// gather send: 'head' and 'buffer' are copied into the segments as one
+// message, so the caller does not need to join them first
+int ikcp_sendv(ikcpcb *kcp, const char *head, int headlen,
+	const char *buffer, int len);
+
 // update state (call it repeatedly, every 10ms-100ms), or you can ask 
 // ikcp_check when to call it again (without ikcp_input/_send calling).
 // 'current' - current timestamp in millisec. 
@@ -51,4 +51,80 @@ TEST(Accept, fail)
     int conv = 0;
     bool success = accept.VerifyReplyAccept(str2);
     ASSERT_FALSE(success);
-}
\ No newline at end of file
+}
+
+TEST(Accept, packet)
+{
+    // 双方都支持紧凑协议
+    Accept accept;
+    std::string str = accept.CreateAcceptString("uuid_clinet", "clinet", DNET_ACCEPT_PACKET_COMPACT);
+    Accept acceptS;
+    std::string str2 = acceptS.ReplyAcceptString(str, "uuid_service", "service", 1, DNET_ACCEPT_PACKET_COMPACT);
+    ASSERT_EQ(acceptS.packet, DNET_ACCEPT_PACKET_COMPACT);
+    ASSERT_TRUE(accept.VerifyReplyAccept(str2));
+    ASSERT_EQ(accept.packet, DNET_ACCEPT_PACKET_COMPACT);
+
+    // 服务器端不支持
+    str = accept.CreateAcceptString("uuid_clinet", "clinet", DNET_ACCEPT_PACKET_COMPACT);
+    str2 = acceptS.ReplyAcceptString(str, "uuid_service", "service", 1);
+    ASSERT_TRUE(accept.VerifyReplyAccept(str2));
+    ASSERT_EQ(accept.packet, DNET_ACCEPT_PACKET_FAST);
+
+    // 客户端不支持
+    str = accept.CreateAcceptString("uuid_clinet", "clinet");
+    str2 = acceptS.ReplyAcceptString(str, "uuid_service", "service", 1, DNET_ACCEPT_PACKET_COMPACT);
+    ASSERT_TRUE(accept.VerifyReplyAccept(str2));
+    ASSERT_EQ(accept.packet, DNET_ACCEPT_PACKET_FAST);
+}
+
+// 旧版本的握手数据,没有packet字段
+class OldAccept : XUEXUE_JSON_OBJECT
+{
+  public:
+    std::string nameC;
+    std::string nameS;
+    std::string keyC;
+    std::string keyS;
+    std::string uuidC;
+    std::string uuidS;
+    int conv = -1;
+
+    XUEXUE_JSON_OBJECT_M7(nameC, nameS, keyC, keyS, uuidC, uuidS, conv)
+};
+
+TEST(Accept, packetOldPeer)
+{
+    // 旧版本的客户端连接新版本的服务器,服务器回复FastPacket
+    OldAccept oldC;
+    oldC.nameC = "clinet";
+    oldC.uuidC = "uuid_clinet";
+    oldC.keyC = "0123456789abcdef";
+    std::string str = xuexue::json::JsonMapper::toJson(oldC);
+    ASSERT_EQ(str.find("packet"), std::string::npos);
+
+    Accept acceptS;
+    std::string str2 = acceptS.ReplyAcceptString(str, "uuid_service", "service", 1, DNET_ACCEPT_PACKET_COMPACT);
+    ASSERT_FALSE(str2.empty());
+    ASSERT_EQ(acceptS.packet, DNET_ACCEPT_PACKET_FAST);
+
+    // 旧版本的客户端能解析带packet字段的回复
+    OldAccept oldReply = xuexue::json::JsonMapper::toObject<OldAccept>(str2);
+    ASSERT_EQ(oldReply.keyC, oldC.keyC);
+    ASSERT_EQ(oldReply.uuidS, "uuid_service");
+    ASSERT_EQ(oldReply.conv, 1);
+
+    // 新版本的客户端连接旧版本的服务器,回复里没有packet字段,使用FastPacket
+    Accept accept;
+    str = accept.CreateAcceptString("uuid_clinet", "clinet", DNET_ACCEPT_PACKET_COMPACT);
+    OldAccept oldS = xuexue::json::JsonMapper::toObject<OldAccept>(str);
+    ASSERT_EQ(oldS.keyC, accept.keyC);
+    oldS.nameS = "service";
+    oldS.uuidS = "uuid_service";
+    oldS.keyS = "fedcba9876543210";
+    oldS.conv = 2;
+    str2 = xuexue::json::JsonMapper::toJson(oldS);
+    ASSERT_EQ(str2.find("packet"), std::string::npos);
+    ASSERT_TRUE(accept.VerifyReplyAccept(str2));
+    ASSERT_EQ(accept.packet, DNET_ACCEPT_PACKET_FAST);
+    ASSERT_EQ(accept.conv, 2);
+}
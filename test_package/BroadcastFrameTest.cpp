@@ -0,0 +1,32 @@
+﻿#include "gtest/gtest.h"
+
+#include "DNET/TCP/BroadcastFrame.h"
+#include "DNET/TCP/Protocol/CompactPacket.h"
+
+using namespace dnet;
+using namespace std;
+
+TEST(BroadcastFrame, packOnce)
+{
+    string data(1000, 'x');
+    BroadcastFrame frame(data.c_str(), data.size(), 7);
+
+    // 每种协议只打包一次,之后得到的是同一个帧
+    auto fast = frame.Get(false);
+    auto compact = frame.Get(true);
+    ASSERT_TRUE(fast == frame.Get(false));
+    ASSERT_TRUE(compact == frame.Get(true));
+    ASSERT_TRUE(fast != compact);
+
+    vector<BinMessage> msgs;
+    FastPacket fastPacket;
+    ASSERT_EQ(fastPacket.Unpack(fast->data(), (int)fast->size(), msgs), 1);
+    ASSERT_EQ(msgs[0].type, 7);
+    ASSERT_EQ(string(msgs[0].data.begin(), msgs[0].data.end()), data);
+
+    CompactPacket compactPacket;
+    ASSERT_EQ(compactPacket.Unpack(compact->data(), (int)compact->size(), msgs), 1);
+    ASSERT_EQ(msgs[0].type, 7);
+    ASSERT_EQ(string(msgs[0].data.begin(), msgs[0].data.end()), data);
+    ASSERT_LT(compact->size(), fast->size());
+}
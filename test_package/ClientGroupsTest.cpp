@@ -0,0 +1,53 @@
+﻿#include "gtest/gtest.h"
+
+#include "DNET/TCP/ClientGroups.h"
+
+#include <algorithm>
+
+using namespace dnet;
+using namespace std;
+
+TEST(ClientGroups, joinLeave)
+{
+    ClientGroups groups;
+    int room1 = groups.Create();
+    int room2 = groups.Create();
+    ASSERT_GT(room1, 0);
+    ASSERT_NE(room1, room2);
+    ASSERT_EQ(groups.Size(), 2);
+
+    for (int tcpID = 1; tcpID <= 200; tcpID++) {
+        ASSERT_TRUE(groups.Join(room1, tcpID));
+    }
+    ASSERT_FALSE(groups.Join(room1, 5)); // 已经在组里了
+    ASSERT_TRUE(groups.Join(room2, 5));
+    ASSERT_EQ(groups.Members(room1)->size(), 200);
+    ASSERT_EQ(groups.GroupsOf(5)->size(), 2);
+
+    ASSERT_TRUE(groups.Leave(room1, 10));
+    ASSERT_FALSE(groups.Leave(room1, 10));
+    ASSERT_EQ(groups.Members(room1)->size(), 199);
+    ASSERT_TRUE(groups.GroupsOf(10) == nullptr);
+
+    // 客户端被删除的时候离开所有的组
+    groups.LeaveAll(5);
+    ASSERT_EQ(groups.Members(room1)->size(), 198);
+    ASSERT_EQ(groups.Members(room2)->size(), 0);
+    ASSERT_TRUE(groups.GroupsOf(5) == nullptr);
+    const vector<int>& members = *groups.Members(room1);
+    ASSERT_TRUE(find(members.begin(), members.end(), 5) == members.end());
+
+    // 删除了的组的旧id不会找到新的组
+    ASSERT_TRUE(groups.Remove(room1));
+    ASSERT_FALSE(groups.Remove(room1));
+    ASSERT_TRUE(groups.Members(room1) == nullptr);
+    ASSERT_FALSE(groups.Join(room1, 1));
+    ASSERT_TRUE(groups.GroupsOf(1) == nullptr);
+    int room3 = groups.Create();
+    ASSERT_NE(room3, room1);
+    ASSERT_EQ(groups.Size(), 2);
+
+    groups.Clear();
+    ASSERT_EQ(groups.Size(), 0);
+    ASSERT_TRUE(groups.Members(room2) == nullptr);
+}
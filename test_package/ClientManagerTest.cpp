@@ -0,0 +1,124 @@
+﻿#include "gtest/gtest.h"
+
+#include "DNET/TCP/ClientManager.h"
+#include "DNET/TCP/KCPChannel.h"
+
+#include "Poco/Net/ServerSocket.h"
+#include "Poco/Net/StreamSocket.h"
+#include "Poco/Net/SocketAddress.h"
+
+using namespace dnet;
+using namespace std;
+
+using Poco::Net::ServerSocket;
+using Poco::Net::SocketAddress;
+using Poco::Net::StreamSocket;
+
+// 在本机建立一个连接,peer是连接的另一端(不接收数据),返回accept得到的socket
+static StreamSocket AcceptOne(ServerSocket& listener, StreamSocket& peer)
+{
+    peer.connect(SocketAddress("127.0.0.1", listener.address().port()));
+    return listener.acceptConnection();
+}
+
+// 回收的客户端对象要等两次RecycleClients()之后才重新使用
+TEST(ClientManager, recycleDelay)
+{
+    ServerSocket listener(SocketAddress("127.0.0.1", 0));
+    ClientManager manager;
+
+    StreamSocket peer1;
+    StreamSocket socket1 = AcceptOne(listener, peer1);
+    TCPClient* client = manager.AddClient(socket1);
+    ASSERT_TRUE(client != nullptr);
+    int tcpID = client->TcpID();
+    int acceptID = client->AcceptID();
+
+    manager.RemoveClient(tcpID);
+    ASSERT_TRUE(manager.GetClient(tcpID) == nullptr);
+    ASSERT_TRUE(manager.GetLiveClient(acceptID) == nullptr);
+    ASSERT_EQ(client->TcpID(), -1);
+    ASSERT_EQ(client->AcceptID(), -1);
+
+    // 第一次回收之后还不能使用
+    manager.RecycleClients();
+    ASSERT_TRUE(manager.mClientPool.empty());
+    StreamSocket peer2;
+    StreamSocket socket2 = AcceptOne(listener, peer2);
+    TCPClient* client2 = manager.AddClient(socket2);
+    ASSERT_TRUE(client2 != client);
+
+    // 第二次回收之后进入对象池,下一个连接使用它
+    manager.RecycleClients();
+    ASSERT_EQ(manager.mClientPool.size(), 1);
+    StreamSocket peer3;
+    StreamSocket socket3 = AcceptOne(listener, peer3);
+    TCPClient* client3 = manager.AddClient(socket3);
+    ASSERT_TRUE(client3 == client);
+    ASSERT_TRUE(manager.mClientPool.empty());
+
+    manager.Clear();
+}
+
+// 重新使用的客户端对象的状态都被重置了,旧的tcpID和acceptID都找不到它
+TEST(ClientManager, reuseResetsState)
+{
+    ServerSocket listener(SocketAddress("127.0.0.1", 0));
+    ClientManager manager;
+
+    StreamSocket peer1;
+    StreamSocket socket1 = AcceptOne(listener, peer1);
+    TCPClient* client = manager.AddClient(socket1);
+    ASSERT_TRUE(client != nullptr);
+    int staleID = client->TcpID();
+    int staleAcceptID = client->AcceptID();
+
+    // 对方不接收,发送的数据积压在发送队列里
+    std::vector<char> data(64 * 1024, 'a');
+    for (int i = 0; i < 64 && client->SendQueueSize() == 0; i++) {
+        ASSERT_GE(client->Send(data.data(), data.size()), 0);
+    }
+    ASSERT_GT(client->SendQueueSize(), 0);
+
+    // 握手之后才有的kcp和分组
+    KCPChannel* kcp = (KCPChannel*)client->GetKCPClient();
+    kcp->Create(staleID);
+    ASSERT_EQ(kcp->Conv(), staleID);
+    int room = manager.groups.Create();
+    ASSERT_TRUE(manager.groups.Join(room, staleID));
+
+    manager.RemoveClient(staleID);
+    ASSERT_TRUE(manager.groups.GroupsOf(staleID) == nullptr);
+    ASSERT_EQ(manager.groups.Members(room)->size(), 0);
+    manager.RecycleClients();
+    manager.RecycleClients();
+
+    StreamSocket peer2;
+    StreamSocket socket2 = AcceptOne(listener, peer2);
+    TCPClient* reused = manager.AddClient(socket2);
+    ASSERT_TRUE(reused == client);
+
+    // 新的连接有新的tcpID,旧的tcpID已经失效了
+    ASSERT_NE(reused->TcpID(), staleID);
+    ASSERT_GT(reused->AcceptID(), 0);
+    ASSERT_NE(reused->AcceptID(), staleAcceptID);
+    ASSERT_TRUE(manager.GetClient(staleID) == nullptr);
+    ASSERT_TRUE(manager.GetLiveClient(staleAcceptID) == nullptr);
+    ASSERT_TRUE(manager.GetClient(reused->TcpID()) == reused);
+    ASSERT_TRUE(manager.GetLiveClient(reused->AcceptID()) == reused);
+
+    // 旧连接的状态都没有了
+    ASSERT_EQ(reused->SendQueueSize(), 0);
+    ASSERT_EQ(((KCPChannel*)reused->GetKCPClient())->Conv(), -1);
+    ASSERT_TRUE(manager.groups.GroupsOf(reused->TcpID()) == nullptr);
+    ASSERT_FALSE(reused->IsAccepted());
+    ASSERT_FALSE(reused->isError());
+    ASSERT_TRUE(reused->AcceptData() == nullptr);
+
+    // 新的连接可以正常的发送
+    std::string msg = "hello";
+    ASSERT_GT(reused->Send(msg.c_str(), msg.size()), 0);
+    ASSERT_EQ(reused->SendQueueSize(), 0);
+
+    manager.Clear();
+}
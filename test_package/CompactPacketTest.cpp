@@ -0,0 +1,145 @@
+﻿#include "gtest/gtest.h"
+
+#include "DNET/TCP/Protocol/CompactPacket.h"
+#include "dlog/dlog.h"
+
+using namespace dnet;
+using namespace std;
+
+TEST(CompactPacket, pack)
+{
+    CompactPacket pack;
+    string data = "12fkldsangkjdfn";
+
+    vector<char> packetedData;
+    pack.Pack(data.c_str(), data.size(), packetedData, 12);
+
+    // 小消息的协议头只有3个字节
+    ASSERT_EQ(packetedData.size(), data.size() + 3);
+    ASSERT_EQ(packetedData[0], DNET_COMPACT_PACKET_TAG);
+    ASSERT_EQ(packetedData[1], (char)data.size());
+    ASSERT_EQ(packetedData[2], (char)24);
+
+    // 内部命令的负数类型也很短
+    ASSERT_EQ(CompactPacket::HeadLength(0, -1024), 4);
+    ASSERT_EQ(CompactPacket::HeadLength(INT32_MAX, INT32_MIN), DNET_COMPACT_PACKET_MAX_HEAD_LEN);
+}
+
+TEST(CompactPacket, packUnpackTypes)
+{
+    CompactPacket pack;
+    vector<int> types = {0, 1, -1, 63, -64, 64, 127, 128, -1024, 100000, INT32_MAX, INT32_MIN};
+    vector<int> lens = {0, 1, 127, 128, 16383, 16384, 70000};
+
+    for (int type : types) {
+        for (int len : lens) {
+            vector<char> data(len);
+            for (int i = 0; i < len; i++) {
+                data[i] = (char)(i * 7);
+            }
+            vector<char> packetedData;
+            pack.Pack(data.data(), len, packetedData, type);
+            ASSERT_EQ(pack.PeekFrameLength(packetedData.data(), (int)packetedData.size()), (int)packetedData.size());
+
+            std::vector<BinMessage> result;
+            ASSERT_EQ(pack.Unpack(packetedData.data(), (int)packetedData.size(), result), 1);
+            ASSERT_EQ(result[0].type, type);
+            ASSERT_TRUE(result[0].data == data);
+        }
+    }
+}
+
+TEST(CompactPacket, unpackLen1)
+{
+    CompactPacket pack;
+    string data = "z12fklxxdsangkjzdfngkldfxsngjsdkfnjgfsdhnz";
+
+    vector<char> packetedData;
+    pack.Pack(data.c_str(), data.size(), packetedData, -1024);
+
+    // 一个一个的往里面添加数据去检察是否能够正常解包
+    int msgCount = 0;
+    for (size_t i = 0; i < packetedData.size(); i++) {
+        std::vector<TextMessage> result;
+        int res = pack.Unpack(&packetedData[i], 1, result);
+        if (res > 0) {
+            ASSERT_EQ(result.size(), 1);
+            ASSERT_EQ(result[0].type, -1024);
+            ASSERT_EQ(result[0].data, data);
+            msgCount++;
+        }
+    }
+    ASSERT_EQ(msgCount, 1);
+    ASSERT_FALSE(pack.isUnpackCached());
+}
+
+TEST(CompactPacket, unpackMixedFastPacket)
+{
+    // 握手协商之后对方会从FastPacket切换到CompactPacket,同一个流里两种帧都要能解析
+    FastPacket fastPack;
+    CompactPacket compactPack;
+
+    vector<char> stream;
+    vector<char> packetedData;
+    for (int i = 0; i < 100; i++) {
+        string data = "msg" + to_string(i) + string(i * 13, 'x');
+        if (i % 3 == 0) {
+            fastPack.Pack(data.c_str(), data.size(), packetedData, i);
+        }
+        else {
+            compactPack.Pack(data.c_str(), data.size(), packetedData, i);
+        }
+        stream.insert(stream.end(), packetedData.begin(), packetedData.end());
+    }
+
+    for (int cut = 1; cut < 200; cut += 17) {
+        CompactPacket pack;
+        vector<TextMessage> result;
+        for (size_t i = 0; i < stream.size(); i += cut) {
+            int len = (int)std::min((size_t)cut, stream.size() - i);
+            pack.Unpack(&stream[i], len, result);
+        }
+        ASSERT_EQ(result.size(), 100);
+        for (int i = 0; i < 100; i++) {
+            ASSERT_EQ(result[i].type, i);
+            ASSERT_EQ(result[i].data, "msg" + to_string(i) + string(i * 13, 'x'));
+        }
+    }
+
+    // 不缓存的解包
+    CompactPacket pack;
+    vector<MessageView> views;
+    int used = pack.UnpackView(stream.data(), (int)stream.size() - 1, views);
+    ASSERT_EQ(views.size(), 99);
+    for (int i = 0; i < 99; i++) {
+        ASSERT_EQ(views[i].type, i);
+        ASSERT_EQ(views[i].to_string(), "msg" + to_string(i) + string(i * 13, 'x'));
+    }
+    ASSERT_TRUE(used < (int)stream.size() - 1);
+    ASSERT_EQ(pack.PeekFrameLength(stream.data() + used, (int)stream.size() - used), (int)stream.size() - used);
+}
+
+TEST(CompactPacket, maxMessageSize)
+{
+    CompactPacket pack;
+    pack.SetMaxMessageSize(1024);
+
+    vector<char> stream;
+    char head[DNET_COMPACT_PACKET_MAX_HEAD_LEN];
+    int headLen = pack.PackHead(1024 * 1024 * 1024, 1, head, sizeof(head));
+    stream.insert(stream.end(), head, head + headLen);
+    vector<char> packetedData;
+    string data = "hello";
+    pack.Pack(data.c_str(), data.size(), packetedData, 2);
+    stream.insert(stream.end(), packetedData.begin(), packetedData.end());
+
+    ASSERT_EQ(pack.PeekFrameLength(stream.data(), (int)stream.size()), -1);
+
+    std::vector<TextMessage> result;
+    for (size_t i = 0; i < stream.size(); i++) {
+        pack.Unpack(&stream[i], 1, result);
+    }
+    ASSERT_EQ(result.size(), 1);
+    ASSERT_EQ(result[0].data, data);
+    ASSERT_FALSE(pack.isUnpackCached());
+}
@@ -117,4 +117,123 @@ TEST(FastPacket, unpackLenManyString)
         ASSERT_EQ(result[0].data.size(), data.size());
         ASSERT_EQ(result[0].data, data);
     }
-}
\ No newline at end of file
+}
+
+TEST(FastPacket, unpackManyMessages)
+{
+    FastPacket pack;
+    vector<string> datas = {"x12fxxxsangkjdf", "", "abcdefghijklmn", "xxxxxxxxx", "1"};
+
+    // 多条消息连在一起,中间夹杂一些垃圾数据
+    vector<char> stream = {'1', '2'};
+    for (size_t i = 0; i < datas.size(); i++) {
+        vector<char> packetedData;
+        pack.Pack(datas[i].c_str(), datas[i].size(), packetedData, (int)i);
+        stream.insert(stream.end(), packetedData.begin(), packetedData.end());
+    }
+
+    //每次传入的unPackLen不同,进行n次试验
+    for (size_t unPackLen = 1; unPackLen <= stream.size(); unPackLen++) {
+        std::vector<TextMessage> result;
+        for (size_t i = 0; i < stream.size(); i += unPackLen) {
+            size_t len = std::min(unPackLen, stream.size() - i);
+            pack.Unpack(&stream[i], (int)len, result);
+        }
+
+        ASSERT_FALSE(pack.isUnpackCached());
+        ASSERT_EQ(result.size(), datas.size());
+        for (size_t j = 0; j < datas.size(); j++) {
+            ASSERT_EQ(result[j].type, j);
+            ASSERT_EQ(result[j].data, datas[j]);
+        }
+    }
+}
+
+TEST(FastPacket, unpackView)
+{
+    FastPacket pack;
+    vector<string> datas = {"x12fxxxsangkjdf", "", "abcdefghijklmn"};
+
+    vector<char> stream;
+    vector<size_t> frameEnds; // 每一条消息的结束位置
+    for (size_t i = 0; i < datas.size(); i++) {
+        vector<char> packetedData;
+        pack.Pack(datas[i].c_str(), datas[i].size(), packetedData, (int)i);
+        stream.insert(stream.end(), packetedData.begin(), packetedData.end());
+        frameEnds.push_back(stream.size());
+    }
+
+    //不完整的消息不应该被消费
+    for (size_t len = 0; len <= stream.size(); len++) {
+        size_t frameCount = 0;
+        while (frameCount < frameEnds.size() && frameEnds[frameCount] <= len) {
+            frameCount++;
+        }
+
+        std::vector<MessageView> result;
+        int used = pack.UnpackView(stream.data(), (int)len, result);
+        ASSERT_EQ(result.size(), frameCount);
+        ASSERT_EQ(used, frameCount == 0 ? 0 : frameEnds[frameCount - 1]);
+        for (size_t j = 0; j < result.size(); j++) {
+            ASSERT_EQ(result[j].type, j);
+            ASSERT_EQ(result[j].to_string(), datas[j]);
+        }
+        ASSERT_EQ(pack.PeekFrameLength(stream.data() + used, (int)len - used) > 0, (int)len - used >= 9);
+    }
+}
+
+TEST(FastPacket, maxMessageSize)
+{
+    FastPacket pack;
+    pack.SetMaxMessageSize(1024);
+
+    // 一个声称有1G数据的协议头不能让解包缓存增长
+    vector<char> stream;
+    vector<char> packetedData;
+    char head[DNET_FAST_PACKET_HEAD_LEN];
+    pack.PackHead(1024 * 1024 * 1024, 1, head, sizeof(head));
+    stream.insert(stream.end(), head, head + sizeof(head));
+    string data = "hello";
+    pack.Pack(data.c_str(), data.size(), packetedData, 2);
+    stream.insert(stream.end(), packetedData.begin(), packetedData.end());
+
+    ASSERT_EQ(pack.PeekFrameLength(stream.data(), (int)stream.size()), -1);
+
+    std::vector<TextMessage> result;
+    for (size_t i = 0; i < stream.size(); i++) {
+        pack.Unpack(&stream[i], 1, result);
+    }
+    ASSERT_EQ(result.size(), 1);
+    ASSERT_EQ(result[0].type, 2);
+    ASSERT_EQ(result[0].data, data);
+    ASSERT_FALSE(pack.isUnpackCached());
+
+    std::vector<MessageView> views;
+    int used = pack.UnpackView(stream.data(), (int)stream.size(), views);
+    ASSERT_EQ(used, stream.size());
+    ASSERT_EQ(views.size(), 1);
+    ASSERT_EQ(views[0].to_string(), data);
+}
+
+TEST(FastPacket, unpackReserveBounded)
+{
+    FastPacket pack;
+
+    // 协议头声称有60M数据(没有超过最大长度),但是只收到了一点,解包缓存不能按协议头里的长度分配
+    int len = 60 * 1024 * 1024;
+    char head[DNET_FAST_PACKET_HEAD_LEN];
+    pack.PackHead(len, 1, head, sizeof(head));
+    std::vector<BinMessage> result;
+    pack.Unpack(head, sizeof(head), result);
+    ASSERT_TRUE(pack.isUnpackCached());
+    ASSERT_LE(pack.UnpackCacheCapacity(), (size_t)DNET_PACKET_UNPACK_RESERVE_SIZE);
+
+    // 数据按实际收到的增长,最后还是一条完整的消息
+    std::vector<char> data(len, 'd');
+    for (int i = 0; i < len; i += 1024 * 1024) {
+        pack.Unpack(data.data() + i, 1024 * 1024, result);
+    }
+    ASSERT_EQ(result.size(), 1);
+    ASSERT_EQ(result[0].data.size(), (size_t)len);
+    ASSERT_FALSE(pack.isUnpackCached());
+}
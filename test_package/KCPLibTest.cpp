@@ -182,3 +182,47 @@ avgrtt=156 maxrtt=571
 fast mode result (20207ms):
 avgrtt=138 maxrtt=392
 */
+
+// 直接把kcp1的输出送给kcp2
+int direct_output(const char *buf, int len, ikcpcb *kcp, void *user)
+{
+    ikcp_input((ikcpcb *)user, buf, len);
+    return 0;
+}
+
+TEST(KCPLib, sendv)
+{
+    for (int stream = 0; stream < 2; stream++) {
+        ikcpcb *kcp2 = ikcp_create(0x11223344, NULL);
+        ikcpcb *kcp1 = ikcp_create(0x11223344, kcp2);
+        kcp1->output = direct_output;
+        kcp1->stream = stream;
+        kcp2->stream = stream;
+        ikcp_nodelay(kcp1, 1, 10, 2, 1);
+        ikcp_wndsize(kcp1, 128, 128);
+        ikcp_wndsize(kcp2, 128, 128);
+
+        // 一段跨越多个segment的数据
+        std::string head = "head123";
+        std::string data;
+        for (int i = 0; i < 3000; i++) {
+            data.push_back((char)('a' + i % 26));
+        }
+        ASSERT_EQ(ikcp_sendv(kcp1, head.data(), (int)head.size(), data.data(), (int)data.size()), 0);
+        ASSERT_EQ(ikcp_sendv(kcp1, head.data(), (int)head.size(), NULL, 0), 0);
+        ikcp_update(kcp1, iclock());
+        ikcp_flush(kcp1);
+
+        std::string expect = head + data + head;
+        std::string result;
+        char buffer[4096];
+        int hr;
+        while ((hr = ikcp_recv(kcp2, buffer, sizeof(buffer))) > 0) {
+            result.append(buffer, hr);
+        }
+        ASSERT_EQ(result, expect);
+
+        ikcp_release(kcp1);
+        ikcp_release(kcp2);
+    }
+}
@@ -86,6 +86,8 @@ TEST(KCPServer, SendRece)
         ASSERT_TRUE(kvp.second->IsAccepted());
     }
 
+    // tcpID带有版本号,不是从1开始的
+    int tcpID = client.TcpID();
     int successCount = 0;
     while (true) {
         // 接收驱动
@@ -97,8 +99,8 @@ TEST(KCPServer, SendRece)
 
         if (!smsgs.empty()) {
             ASSERT_EQ(smsgs.size(), 1);
-            ASSERT_TRUE(smsgs[1].size() > 0); // 1号客户端的消息一条(现在是32条)
-            ASSERT_EQ(smsgs[1][0].data, "123456");
+            ASSERT_TRUE(smsgs[tcpID].size() > 0); // 这个客户端的消息一条(现在是32条)
+            ASSERT_EQ(smsgs[tcpID][0].data, "123456");
             successCount++;
             LogI("successCount=%d", successCount);
             if (successCount > 200) {
@@ -119,6 +121,6 @@ TEST(KCPServer, SendRece)
         std::this_thread::yield();
 
         client.KCPSend("123456", 6);     // c->s
-        server.KCPSend(1, "abcdefg", 7); // s->c
+        server.KCPSend(tcpID, "abcdefg", 7); // s->c
     }
 }
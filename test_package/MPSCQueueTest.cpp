@@ -0,0 +1,72 @@
+﻿#include "gtest/gtest.h"
+
+#include "DNET/TCP/MPSCQueue.h"
+
+#include <thread>
+#include <vector>
+
+using namespace dnet;
+using namespace std;
+
+TEST(MPSCQueue, pushPop)
+{
+    MPSCQueue<int> queue;
+    int value = 0;
+    ASSERT_FALSE(queue.Pop(value));
+    ASSERT_EQ(queue.Push(1), 0);
+    ASSERT_EQ(queue.Push(2), 1);
+    ASSERT_EQ(queue.Size(), 2);
+    ASSERT_TRUE(queue.Pop(value));
+    ASSERT_EQ(value, 1);
+    ASSERT_TRUE(queue.Pop(value));
+    ASSERT_EQ(value, 2);
+    ASSERT_FALSE(queue.Pop(value));
+    ASSERT_EQ(queue.Size(), 0);
+
+    // 取空之后还能继续使用
+    queue.Push(3);
+    ASSERT_TRUE(queue.Pop(value));
+    ASSERT_EQ(value, 3);
+    queue.Push(4);
+    queue.Push(5);
+    queue.Clear();
+    ASSERT_FALSE(queue.Pop(value));
+}
+
+TEST(MPSCQueue, multiProducer)
+{
+    MPSCQueue<int> queue;
+    const int producerCount = 4;
+    const int countPerProducer = 100000;
+
+    vector<thread> producers;
+    for (int p = 0; p < producerCount; p++) {
+        producers.emplace_back([&queue, p, countPerProducer]() {
+            for (int i = 0; i < countPerProducer; i++) {
+                queue.Push(p * countPerProducer + i);
+            }
+        });
+    }
+
+    // 每个生产者的数据按顺序取出,一个也不少
+    vector<int> last(producerCount, -1);
+    int total = 0;
+    while (total < producerCount * countPerProducer) {
+        int value;
+        if (!queue.Pop(value)) {
+            this_thread::yield();
+            continue;
+        }
+        int p = value / countPerProducer;
+        int i = value % countPerProducer;
+        ASSERT_EQ(i, last[p] + 1);
+        last[p] = i;
+        total++;
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    int value;
+    ASSERT_FALSE(queue.Pop(value));
+    ASSERT_EQ(queue.Size(), 0);
+}
@@ -0,0 +1,24 @@
+﻿#include "gtest/gtest.h"
+
+#include "DNET/TCP/MonotonicClock.h"
+
+#include <thread>
+
+using namespace dnet;
+using namespace std;
+
+TEST(MonotonicClock, refreshCached)
+{
+    int64_t t1 = MonotonicClock::Refresh();
+    ASSERT_EQ(MonotonicClock::NowMs(), t1);
+
+    // 不Refresh()的时候读到的是缓存的值
+    this_thread::sleep_for(chrono::milliseconds(20));
+    ASSERT_EQ(MonotonicClock::NowMs(), t1);
+    ASSERT_GE(MonotonicClock::ReadMs() - t1, 20);
+
+    int64_t t2 = MonotonicClock::Refresh();
+    ASSERT_GE(t2 - t1, 20);
+    ASSERT_EQ(MonotonicClock::NowMs(), t2);
+    ASSERT_EQ(MonotonicClock::NowMs32(), (uint32_t)(t2 & 0xffffffff));
+}
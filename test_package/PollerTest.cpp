@@ -0,0 +1,104 @@
+﻿#include "gtest/gtest.h"
+
+#include "DNET/TCP/Poller.h"
+
+#include "Poco/Net/ServerSocket.h"
+#include "Poco/Net/StreamSocket.h"
+#include "Poco/Net/SocketAddress.h"
+
+#include <thread>
+#include <chrono>
+
+using namespace dnet;
+using namespace std;
+
+// 建立一对本机的tcp连接
+static void ConnectPair(Poco::Net::ServerSocket& server, Poco::Net::StreamSocket& client, Poco::Net::StreamSocket& accepted)
+{
+    server.bind(Poco::Net::SocketAddress("127.0.0.1", 0), true);
+    server.listen();
+    client.connect(Poco::Net::SocketAddress("127.0.0.1", server.address().port()));
+    accepted = server.acceptConnection();
+}
+
+TEST(Poller, wait)
+{
+    Poller poller;
+    if (!poller.IsValid()) {
+        return; // 当前平台不支持就绪通知
+    }
+    Poco::Net::ServerSocket server;
+    Poco::Net::StreamSocket client;
+    Poco::Net::StreamSocket accepted;
+    ConnectPair(server, client, accepted);
+    ASSERT_TRUE(poller.Add(accepted, 1048577));
+
+    // 没有数据的时候超时返回
+    std::vector<uint64_t> keys;
+    ASSERT_EQ(poller.Wait(keys, 10), 0);
+    ASSERT_TRUE(keys.empty());
+
+    // 有数据了返回它的key,水平触发的没有读走之前一直返回
+    client.sendBytes("abc", 3);
+    ASSERT_EQ(poller.Wait(keys, 1000), 1);
+    ASSERT_EQ(keys[0], 1048577);
+    ASSERT_EQ(poller.Wait(keys, 0), 1);
+
+    char buff[8];
+    ASSERT_EQ(accepted.receiveBytes(buff, sizeof(buff)), 3);
+    ASSERT_EQ(poller.Wait(keys, 10), 0);
+}
+
+TEST(Poller, wakeup)
+{
+    Poller poller;
+    if (!poller.IsValid()) {
+        return;
+    }
+
+    // 其它线程唤醒之后不带任何key的立即返回
+    auto start = chrono::steady_clock::now();
+    std::thread thread([&poller]() {
+        this_thread::sleep_for(chrono::milliseconds(50));
+        poller.Wakeup();
+    });
+    std::vector<uint64_t> keys;
+    ASSERT_EQ(poller.Wait(keys, 5000), 0);
+    thread.join();
+    ASSERT_TRUE(keys.empty());
+    ASSERT_LT(chrono::steady_clock::now() - start, chrono::seconds(2));
+
+    // 唤醒的计数已经清掉了,下一次等待不会立即返回
+    start = chrono::steady_clock::now();
+    ASSERT_EQ(poller.Wait(keys, 50), 0);
+    ASSERT_GE(chrono::steady_clock::now() - start, chrono::milliseconds(40));
+}
+
+TEST(Poller, remove)
+{
+    Poller poller;
+    if (!poller.IsValid()) {
+        return;
+    }
+    Poco::Net::ServerSocket server;
+    Poco::Net::StreamSocket client;
+    Poco::Net::StreamSocket accepted;
+    ConnectPair(server, client, accepted);
+    ASSERT_TRUE(poller.Add(accepted, 1048577));
+    client.sendBytes("abc", 3);
+
+    // 移除之后即使有数据也不再返回
+    poller.Remove(accepted);
+    std::vector<uint64_t> keys;
+    ASSERT_EQ(poller.Wait(keys, 10), 0);
+
+    // 关闭了的socket自动移除
+    Poco::Net::StreamSocket client2;
+    Poco::Net::StreamSocket accepted2;
+    client2.connect(server.address());
+    accepted2 = server.acceptConnection();
+    ASSERT_TRUE(poller.Add(accepted2, 1048578));
+    client2.sendBytes("abc", 3);
+    accepted2.close();
+    ASSERT_EQ(poller.Wait(keys, 10), 0);
+}
@@ -0,0 +1,55 @@
+﻿#include "gtest/gtest.h"
+
+#include "DNET/TCP/ReceiveArena.h"
+
+#include <string>
+
+using namespace dnet;
+using namespace std;
+
+TEST(ReceiveArena, prepareCommit)
+{
+    ReceiveArena arena;
+    vector<char*> ptrs;
+    vector<string> datas;
+
+    // 写满好几块,之前写入的数据不会被移动或者覆盖
+    for (int i = 0; i < 100; i++) {
+        string data = "message" + to_string(i) + string(i * 50, 'x');
+        char* ptr = arena.Prepare(8 * 1024);
+        memcpy(ptr, data.data(), data.size());
+        arena.Commit(data.size());
+        ptrs.push_back(ptr);
+        datas.push_back(data);
+    }
+    for (size_t i = 0; i < ptrs.size(); i++) {
+        ASSERT_EQ(string(ptrs[i], datas[i].size()), datas[i]);
+    }
+
+    // Reset之后重新使用已经分配的内存
+    arena.Reset();
+    ASSERT_EQ(arena.Prepare(8 * 1024), ptrs[0]);
+}
+
+TEST(ReceiveArena, acquireRelease)
+{
+    ReceiveArena arena;
+    std::unique_ptr<ReceiveBuffer> buff = arena.AcquireBuffer(1024);
+    ASSERT_EQ(buff->Capacity(), 1024);
+    buff->Commit(10);
+    ReceiveBuffer* raw = buff.get();
+
+    arena.ReleaseBuffer(buff);
+    ASSERT_TRUE(buff == nullptr);
+
+    // 还回去的缓存被清空了之后再借出
+    buff = arena.AcquireBuffer(1024);
+    ASSERT_EQ(buff.get(), raw);
+    ASSERT_EQ(buff->ReadableSize(), 0);
+
+    // 扩大过的缓存不保留
+    buff->Reserve(DNET_RECEIVE_ARENA_BLOCK_SIZE + 1);
+    arena.ReleaseBuffer(buff);
+    buff = arena.AcquireBuffer(1024);
+    ASSERT_EQ(buff->Capacity(), 1024);
+}
@@ -0,0 +1,126 @@
+﻿#include "gtest/gtest.h"
+
+#include "DNET/TCP/SendQueue.h"
+
+#include "Poco/Net/ServerSocket.h"
+#include "Poco/Net/StreamSocket.h"
+#include "Poco/Net/SocketAddress.h"
+#include "Poco/Timespan.h"
+
+#include <chrono>
+
+using namespace dnet;
+using namespace std;
+
+using Poco::Net::ServerSocket;
+using Poco::Net::SocketAddress;
+using Poco::Net::StreamSocket;
+
+// 在本机建立一个连接,socket是非阻塞的发送端,peer是接收端.bufferSize大于0的时候两端的socket缓存都设置成它
+static void ConnectPair(ServerSocket& listener, StreamSocket& socket, StreamSocket& peer, int bufferSize = 0)
+{
+    peer = StreamSocket(SocketAddress::IPv4);
+    if (bufferSize > 0) {
+        peer.setReceiveBufferSize(bufferSize); // 要在连接之前设置
+    }
+    peer.connect(SocketAddress("127.0.0.1", listener.address().port()));
+    socket = listener.acceptConnection();
+    socket.setBlocking(false);
+    if (bufferSize > 0) {
+        socket.setSendBufferSize(bufferSize);
+    }
+}
+
+// 追加一帧,内容是len个c
+static void AppendFrame(SendQueue& queue, char c, int len, int priority, int offset = 0)
+{
+    std::string data(len, c);
+    SendBuf buf = {data.c_str(), len};
+    queue.Append(&buf, 1, offset, priority);
+}
+
+// 一边发送一边接收,直到对方收到了expectLen个字节
+static std::string FlushAll(SendQueue& queue, StreamSocket& socket, StreamSocket& peer, size_t expectLen)
+{
+    std::string received;
+    std::vector<char> buff(64 * 1024);
+    auto start = std::chrono::steady_clock::now();
+    while (received.size() < expectLen && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+        if (queue.Flush(socket) < 0) {
+            break;
+        }
+        if (peer.poll(Poco::Timespan(0, 10 * 1000), Poco::Net::Socket::SELECT_READ)) {
+            int n = peer.receiveBytes(buff.data(), (int)buff.size());
+            if (n <= 0) {
+                break;
+            }
+            received.append(buff.data(), n);
+        }
+    }
+    return received;
+}
+
+// 低优先级的一帧发送了一半的时候来了高优先级的帧,要先发送完这一帧
+TEST(SendQueue, partialFrameBeforeHigh)
+{
+    ServerSocket listener(SocketAddress("127.0.0.1", 0));
+    StreamSocket socket;
+    StreamSocket peer;
+    ConnectPair(listener, socket, peer, 4 * 1024);
+
+    // 对方不接收,socket只能发送出去一部分
+    SendQueue queue;
+    const int lowLen = 4 * 1024 * 1024;
+    AppendFrame(queue, 'a', lowLen, DNET_SEND_PRIORITY_LOW);
+    AppendFrame(queue, 'b', 100, DNET_SEND_PRIORITY_LOW);
+    int sent = queue.Flush(socket);
+    ASSERT_GT(sent, 0);
+    ASSERT_LT(sent, lowLen);
+
+    AppendFrame(queue, 'h', 10, DNET_SEND_PRIORITY_HIGH);
+    std::string received = FlushAll(queue, socket, peer, lowLen + 100 + 10);
+    ASSERT_TRUE(queue.Empty());
+    ASSERT_EQ(received, std::string(lowLen, 'a') + std::string(10, 'h') + std::string(100, 'b'));
+}
+
+// 有优先级更高的帧在等待的时候,一次合并发送只到正在发送的这一帧的结尾
+TEST(SendQueue, gatherStopsAtFrameBoundary)
+{
+    ServerSocket listener(SocketAddress("127.0.0.1", 0));
+    StreamSocket socket;
+    StreamSocket peer;
+    ConnectPair(listener, socket, peer);
+
+    // 第一帧前面的50个字节已经直接发送过了,同一个队列里后面还有几帧,socket一次就能全部发送
+    SendQueue queue;
+    AppendFrame(queue, 'a', 100, DNET_SEND_PRIORITY_LOW, 50);
+    AppendFrame(queue, 'b', 100, DNET_SEND_PRIORITY_LOW);
+    AppendFrame(queue, 'c', 100, DNET_SEND_PRIORITY_LOW);
+    AppendFrame(queue, 'h', 10, DNET_SEND_PRIORITY_HIGH);
+    ASSERT_EQ(queue.Size(), 260);
+
+    std::string received = FlushAll(queue, socket, peer, 260);
+    ASSERT_TRUE(queue.Empty());
+    ASSERT_EQ(received, std::string(50, 'a') + std::string(10, 'h') + std::string(100, 'b') + std::string(100, 'c'));
+}
+
+// 清空队列之后不再记得发送了一半的帧
+TEST(SendQueue, clearResetsActiveLane)
+{
+    ServerSocket listener(SocketAddress("127.0.0.1", 0));
+    StreamSocket socket;
+    StreamSocket peer;
+    ConnectPair(listener, socket, peer);
+
+    SendQueue queue;
+    AppendFrame(queue, 'x', 100, DNET_SEND_PRIORITY_LOW, 50);
+    queue.Clear();
+    ASSERT_TRUE(queue.Empty());
+    ASSERT_EQ(queue.Size(DNET_SEND_PRIORITY_LOW), 0);
+
+    AppendFrame(queue, 'l', 100, DNET_SEND_PRIORITY_LOW);
+    AppendFrame(queue, 'h', 10, DNET_SEND_PRIORITY_HIGH);
+    std::string received = FlushAll(queue, socket, peer, 110);
+    ASSERT_TRUE(queue.Empty());
+    ASSERT_EQ(received, std::string(10, 'h') + std::string(100, 'l'));
+}
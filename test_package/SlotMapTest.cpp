@@ -0,0 +1,121 @@
+﻿#include "gtest/gtest.h"
+
+#include "DNET/TCP/SlotMap.h"
+#include "DNET/TCP/StringHashMap.h"
+
+#include <map>
+
+using namespace dnet;
+using namespace std;
+
+TEST(SlotMap, insertGetRemove)
+{
+    SlotMap<int> slotMap;
+    int id1 = slotMap.Insert(10);
+    int id2 = slotMap.Insert(20);
+    int id3 = slotMap.Insert(30);
+    ASSERT_GT(id1, 0);
+    ASSERT_NE(id1, id2);
+    ASSERT_EQ(slotMap.Size(), 3);
+    ASSERT_EQ(*slotMap.Get(id2), 20);
+    ASSERT_TRUE(slotMap.Get(0) == nullptr);
+    ASSERT_TRUE(slotMap.Get(-1) == nullptr);
+
+    // 删除了之后旧的id找不到了
+    ASSERT_TRUE(slotMap.Remove(id1));
+    ASSERT_FALSE(slotMap.Remove(id1));
+    ASSERT_TRUE(slotMap.Get(id1) == nullptr);
+    ASSERT_EQ(*slotMap.Get(id2), 20);
+    ASSERT_EQ(*slotMap.Get(id3), 30);
+
+    // 槽位被重新使用,但是id不一样了
+    int id4 = slotMap.Insert(40);
+    ASSERT_NE(id4, id1);
+    ASSERT_TRUE(slotMap.Get(id1) == nullptr);
+    ASSERT_EQ(*slotMap.Get(id4), 40);
+
+    ASSERT_TRUE(slotMap.Set(id4, 41));
+    ASSERT_FALSE(slotMap.Set(id1, 11));
+    ASSERT_EQ(*slotMap.Get(id4), 41);
+
+    slotMap.Clear();
+    ASSERT_EQ(slotMap.Size(), 0);
+    ASSERT_TRUE(slotMap.Get(id2) == nullptr);
+}
+
+TEST(SlotMap, removeAtWhileIterating)
+{
+    SlotMap<int> slotMap;
+    map<int, int> expect;
+    for (int i = 0; i < 100; i++) {
+        expect[slotMap.Insert(i)] = i;
+    }
+
+    // 删除所有的奇数,删除之后最后一个会移动过来所以不增加序号
+    for (size_t i = 0; i < slotMap.Size();) {
+        if (slotMap.ValueAt(i) % 2 == 1) {
+            expect.erase(slotMap.IdAt(i));
+            slotMap.RemoveAt(i);
+            continue;
+        }
+        i++;
+    }
+
+    ASSERT_EQ(slotMap.Size(), 50);
+    for (auto& kvp : expect) {
+        ASSERT_TRUE(slotMap.Get(kvp.first) != nullptr);
+        ASSERT_EQ(*slotMap.Get(kvp.first), kvp.second);
+    }
+    for (size_t i = 0; i < slotMap.Size(); i++) {
+        ASSERT_EQ(*slotMap.Get(slotMap.IdAt(i)), slotMap.ValueAt(i));
+    }
+}
+
+TEST(StringHashMap, setFindErase)
+{
+    StringHashMap<int> hashMap;
+    ASSERT_TRUE(hashMap.Find("a") == nullptr);
+
+    for (int i = 0; i < 1000; i++) {
+        hashMap.Set(to_string(i), i);
+    }
+    ASSERT_EQ(hashMap.Size(), 1000);
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_EQ(*hashMap.Find(to_string(i)), i);
+    }
+
+    // 覆盖已有的key
+    hashMap.Set("5", 55);
+    ASSERT_EQ(hashMap.Size(), 1000);
+    ASSERT_EQ(*hashMap.Find("5"), 55);
+
+    for (int i = 0; i < 1000; i += 2) {
+        ASSERT_EQ(hashMap.Erase(to_string(i)), 1);
+    }
+    ASSERT_EQ(hashMap.Erase("0"), 0);
+    ASSERT_EQ(hashMap.Size(), 500);
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_EQ(hashMap.Find(to_string(i)) != nullptr, i % 2 == 1);
+    }
+
+    // 反复的添加删除,墓碑会被清理
+    for (int i = 0; i < 10000; i++) {
+        hashMap.Set("temp", i);
+        hashMap.Erase("temp");
+    }
+    ASSERT_EQ(hashMap.Size(), 500);
+
+    int sum = 0;
+    int count = 0;
+    hashMap.ForEach([&](const string& key, int& value) {
+        ASSERT_EQ(*hashMap.Find(key), value);
+        sum += value;
+        count++;
+    });
+    ASSERT_EQ(count, 500);
+    ASSERT_EQ(sum, 250000 + 50);
+
+    hashMap.Clear();
+    ASSERT_EQ(hashMap.Size(), 0);
+    ASSERT_TRUE(hashMap.Find("1") == nullptr);
+}
@@ -0,0 +1,21 @@
+﻿#include "gtest/gtest.h"
+
+#include "DNET/TCP/SocketUtil.h"
+
+using namespace dnet;
+using namespace std;
+
+TEST(SocketUtil, autoTuneBufferSize)
+{
+    // 1秒收到10M,RTT=10ms,一个RTT时间内100K,缓存要翻倍到放得下200K
+    ASSERT_EQ(AutoTuneBufferSize(16 * 1024, 10 * 1024 * 1024, 1000 * 1000, 10 * 1000, 4 * 1024 * 1024), 256 * 1024);
+
+    // 缓存已经足够大了不调整,也不缩小
+    ASSERT_EQ(AutoTuneBufferSize(1024 * 1024, 10 * 1024 * 1024, 1000 * 1000, 10 * 1000, 4 * 1024 * 1024), 1024 * 1024);
+
+    // 不超过上限
+    ASSERT_EQ(AutoTuneBufferSize(16 * 1024, 1000 * 1024 * 1024, 1000 * 1000, 100 * 1000, 4 * 1024 * 1024), 4 * 1024 * 1024);
+
+    // 使用系统默认缓存的方向不调整
+    ASSERT_EQ(AutoTuneBufferSize(0, 10 * 1024 * 1024, 1000 * 1000, 10 * 1000, 4 * 1024 * 1024), 0);
+}
@@ -1,6 +1,8 @@
 ﻿#include "gtest/gtest.h"
 #include "DNET/TCP/TCPClient.h"
 #include "DNET/TCP/TCPServer.h"
+#include "DNET/TCP/Protocol/CompactPacket.h"
+#include "DNET/TCP/KCPChannel.h"
 #include <thread>
 #include "dlog/dlog.h"
 #include <atomic>
@@ -85,6 +87,40 @@ class Target
     }
 };
 
+// 驱动服务器和这些客户端的接收,直到客户端都握手完成或者超过了timeoutMs毫秒.返回是否都握手完成了
+static bool PumpUntilAccepted(TCPServer& server, TCPClient* clients, size_t count, int timeoutMs = 10000)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (true) {
+        size_t acceptCount = 0;
+        for (size_t i = 0; i < count; i++) {
+            acceptCount += clients[i].IsAccepted() ? 1 : 0;
+        }
+        if (acceptCount == count) {
+            return true;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::map<int, std::vector<MessageView>> msgs;
+        server.Receive(msgs, 10);
+        for (size_t i = 0; i < count; i++) {
+            std::vector<MessageView> views;
+            clients[i].Receive(views);
+        }
+    }
+}
+
+static bool PumpUntilAccepted(TCPServer& server, TCPClient& client, int timeoutMs = 10000)
+{
+    return PumpUntilAccepted(server, &client, 1, timeoutMs);
+}
+
+static bool PumpUntilAccepted(TCPServer& server, std::vector<TCPClient>& clients, int timeoutMs = 10000)
+{
+    return PumpUntilAccepted(server, clients.data(), clients.size(), timeoutMs);
+}
+
 TEST(TCPServer, OpenClose)
 {
     Target target;
@@ -396,3 +432,1052 @@ TEST(TCPServer, sendText2)
 
     server.Close();
 }
+
+TEST(TCPServer, receiveView)
+{
+    TCPServer server("server", "127.0.0.1", 8341);
+    server.Start();
+    server.WaitStarted();
+
+    TCPClient client;
+    client.Connect("127.0.0.1", 8341);
+    ASSERT_TRUE(PumpUntilAccepted(server, client));
+
+    std::string msg = "1234567890";
+    std::string msg2 = "abcdefghijklmn";
+    client.Send(msg.c_str(), msg.size(), 1);
+    client.Send(msg2.c_str(), msg2.size(), 2);
+
+    int receCount = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (receCount < 2 && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+        std::map<int, std::vector<MessageView>> msgs;
+        server.Receive(msgs, 10);
+        for (auto& kvp : msgs) {
+            for (auto& view : kvp.second) {
+                ASSERT_EQ(view.type, receCount + 1);
+                ASSERT_EQ(view.to_string(), receCount == 0 ? msg : msg2);
+                // 回发这条数据
+                server.Send(kvp.first, view.data, view.len, view.type);
+                receCount++;
+            }
+        }
+    }
+    ASSERT_EQ(receCount, 2);
+
+    // 服务端在下一次Receive()时才会把回发的数据发出去
+    std::vector<std::string> clienMsgs;
+    start = std::chrono::steady_clock::now();
+    while (clienMsgs.size() < 2 && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+        std::map<int, std::vector<MessageView>> msgs;
+        server.Receive(msgs, 1);
+        std::vector<MessageView> views;
+        client.WaitAvailableFor(10);
+        client.Receive(views);
+        for (auto& view : views) {
+            clienMsgs.push_back(view.to_string());
+        }
+    }
+    ASSERT_EQ(clienMsgs.size(), 2);
+    ASSERT_EQ(clienMsgs[0], msg);
+    ASSERT_EQ(clienMsgs[1], msg2);
+
+    server.Close();
+}
+
+TEST(TCPServer, receiveHeadOnly)
+{
+    TCPServer server("server", "127.0.0.1", 8341);
+    server.Start();
+    server.WaitStarted();
+
+    TCPClient client;
+    client.Connect("127.0.0.1", 8341);
+    std::map<int, std::vector<MessageView>> msgs;
+    ASSERT_TRUE(PumpUntilAccepted(server, client));
+    int tcpID = client.TcpID();
+    size_t usage = server.MemoryUsage(tcpID);
+
+    // 只发一个声称有60M数据的消息头和一点数据,服务端不能按消息头里的长度分配接收缓存
+    CompactPacket packet;
+    char head[16];
+    int headLen = packet.PackHead(60 * 1024 * 1024, 1, head, sizeof(head));
+    std::string data(headLen + 100, 'a');
+    memcpy(&data[0], head, headLen);
+    Poco::Net::StreamSocket* socket = (Poco::Net::StreamSocket*)client.Socket();
+    socket->sendBytes(data.data(), (int)data.size());
+    for (int i = 0; i < 10; i++) {
+        server.Receive(msgs, 10);
+        ASSERT_TRUE(msgs[tcpID].empty());
+    }
+    ASSERT_LT(server.MemoryUsage(tcpID), usage + 1024 * 1024);
+
+    server.Close();
+}
+
+TEST(TCPServer, corkSend)
+{
+    TCPServer server("server", "127.0.0.1", 8341);
+    server.Start();
+    server.WaitStarted();
+
+    TCPClient client;
+    client.Connect("127.0.0.1", 8341);
+    ASSERT_TRUE(PumpUntilAccepted(server, client));
+    ASSERT_TRUE(server.RemoteCount() > 0);
+
+    // 攒50条消息一次发送
+    client.Cork();
+    ASSERT_TRUE(client.IsCorked());
+    for (int i = 0; i < 50; i++) {
+        std::string msg = "msg" + std::to_string(i);
+        client.Send(msg.c_str(), msg.size(), i);
+    }
+    ASSERT_TRUE(client.Uncork() > 0);
+    ASSERT_FALSE(client.IsCorked());
+
+    int receCount = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (receCount < 50 && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+        std::map<int, std::vector<TextMessage>> msgs;
+        server.Receive(msgs, 10);
+        for (auto& kvp : msgs) {
+            for (auto& msg : kvp.second) {
+                ASSERT_EQ(msg.type, receCount);
+                ASSERT_EQ(msg.data, "msg" + std::to_string(receCount));
+                receCount++;
+            }
+        }
+    }
+    ASSERT_EQ(receCount, 50);
+
+    server.Close();
+}
+
+TEST(TCPServer, sendQueue)
+{
+    TCPServer server("server", "127.0.0.1", 8342);
+    server.Start();
+    server.WaitStarted();
+
+    TCPClient client;
+    client.Connect("127.0.0.1", 8342);
+    ASSERT_TRUE(PumpUntilAccepted(server, client));
+
+    // 一次发送很多数据,socket发送缓存放不下的部分进入发送队列,Send不会阻塞
+    int tcpId = client.TcpID();
+    std::vector<char> data(1024 * 1024);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (char)i;
+    }
+    for (int i = 0; i < 16; i++) {
+        ASSERT_TRUE(server.Send(tcpId, data.data(), data.size(), i) > (int)data.size());
+    }
+
+    int receCount = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (receCount < 16 && std::chrono::steady_clock::now() - start < std::chrono::seconds(30)) {
+        std::map<int, std::vector<BinMessage>> serverMsgs;
+        server.Receive(serverMsgs); // 继续发送发送队列里的数据
+
+        std::vector<BinMessage> msgs;
+        client.WaitAvailableFor(100);
+        client.Receive(msgs);
+        for (auto& msg : msgs) {
+            ASSERT_EQ(msg.type, receCount);
+            ASSERT_TRUE(msg.data == data);
+            receCount++;
+        }
+    }
+    ASSERT_EQ(receCount, 16);
+    ASSERT_EQ(server.SendQueueSize(tcpId), 0);
+
+    server.Close();
+}
+
+TEST(TCPServer, streamReceive)
+{
+    TCPServer server("server", "127.0.0.1", 8343);
+    server.Start();
+    server.WaitStarted();
+
+    TCPClient client;
+    TCPOptions options = client.Options();
+    options.streamThreshold = 16 * 1024;
+    client.SetOptions(options);
+    client.Connect("127.0.0.1", 8343);
+    ASSERT_TRUE(PumpUntilAccepted(server, client));
+
+    // 大消息分块的交给用户,小消息还是完整的
+    int tcpId = client.TcpID();
+    std::vector<char> data(1024 * 1024);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (char)(i * 3);
+    }
+    server.Send(tcpId, data.data(), data.size(), 1);
+    server.Send(tcpId, "small", 5, 2);
+
+    std::vector<char> received;
+    int chunkCount = 0;
+    bool isReceSmall = false;
+    auto start = std::chrono::steady_clock::now();
+    while (!isReceSmall && std::chrono::steady_clock::now() - start < std::chrono::seconds(30)) {
+        std::map<int, std::vector<BinMessage>> serverMsgs;
+        server.Receive(serverMsgs);
+
+        std::vector<MessageView> msgs;
+        client.WaitAvailableFor(100);
+        client.Receive(msgs);
+        for (auto& msg : msgs) {
+            if (msg.type == 1) {
+                ASSERT_EQ(msg.chunk, chunkCount == 0 ? DNET_MESSAGE_CHUNK_FIRST : (received.size() + msg.len < data.size() ? DNET_MESSAGE_CHUNK_MIDDLE : DNET_MESSAGE_CHUNK_LAST));
+                received.insert(received.end(), msg.data, msg.data + msg.len);
+                chunkCount++;
+            }
+            else {
+                ASSERT_EQ(msg.type, 2);
+                ASSERT_EQ(msg.chunk, DNET_MESSAGE_CHUNK_NONE);
+                ASSERT_EQ(msg.to_string(), "small");
+                isReceSmall = true;
+            }
+        }
+    }
+    ASSERT_TRUE(isReceSmall);
+    ASSERT_TRUE(chunkCount > 1);
+    ASSERT_TRUE(received == data);
+
+    server.Close();
+}
+
+TEST(TCPServer, registerHandler)
+{
+    TCPServer server("server", "127.0.0.1", 8344);
+    server.Start();
+    server.WaitStarted();
+
+    // 类型1和类型1000的消息交给处理函数,其它类型的仍然从Receive返回
+    std::vector<std::string> handled;
+    server.RegisterHandler(1, [&](int tcpID, const MessageView& msg) {
+        handled.push_back(msg.to_string());
+    });
+    server.RegisterHandler(1000, [&](int tcpID, const MessageView& msg) {
+        handled.push_back(msg.to_string());
+    });
+
+    TCPClient client;
+    client.Connect("127.0.0.1", 8344);
+    ASSERT_TRUE(PumpUntilAccepted(server, client));
+
+    for (int i = 0; i < 30; i++) {
+        std::string msg = "msg" + std::to_string(i);
+        int type = i % 3 == 0 ? 1 : (i % 3 == 1 ? 1000 : 2);
+        client.Send(msg.c_str(), msg.size(), type);
+    }
+
+    int receCount = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (receCount + handled.size() < 30 && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+        std::map<int, std::vector<TextMessage>> msgs;
+        server.Receive(msgs, 10);
+        for (auto& kvp : msgs) {
+            for (auto& msg : kvp.second) {
+                ASSERT_EQ(msg.type, 2);
+                ASSERT_EQ(msg.data, "msg" + std::to_string(receCount * 3 + 2));
+                receCount++;
+            }
+        }
+    }
+    ASSERT_EQ(receCount, 10);
+    ASSERT_EQ(handled.size(), 20);
+    for (size_t i = 0; i < handled.size(); i++) {
+        ASSERT_EQ(handled[i], "msg" + std::to_string(i / 2 * 3 + i % 2));
+    }
+
+    server.Close();
+}
+
+TEST(TCPServer, ioThreads)
+{
+    TCPServer server("server", "127.0.0.1", 8345);
+    server.Start(4);
+    server.WaitStarted();
+
+    std::vector<TCPClient> clients;
+    clients.resize(16);
+    for (size_t i = 0; i < clients.size(); i++) {
+        clients[i].Connect("127.0.0.1", 8345);
+    }
+
+    // 等待所有客户端连接完成
+    ASSERT_TRUE(PumpUntilAccepted(server, clients));
+
+    for (size_t i = 0; i < clients.size(); i++) {
+        for (int j = 0; j < 100; j++) {
+            std::string msg = std::to_string(j);
+            clients[i].Send(msg.c_str(), msg.size());
+        }
+    }
+
+    // 每个客户端的消息都按顺序收到
+    std::map<int, int> receCounts;
+    int total = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (total < 16 * 100 && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+        std::map<int, std::vector<TextMessage>> msgs;
+        server.Receive(msgs, 100);
+        for (auto& kvp : msgs) {
+            for (auto& msg : kvp.second) {
+                ASSERT_EQ(msg.data, std::to_string(receCounts[kvp.first]));
+                receCounts[kvp.first]++;
+                total++;
+            }
+        }
+        // socket发送缓存放不下的消息在客户端的发送队列里
+        for (size_t i = 0; i < clients.size(); i++) {
+            clients[i].Update();
+        }
+    }
+    ASSERT_EQ(total, 16 * 100);
+    ASSERT_EQ(receCounts.size(), 16);
+
+    // 回发
+    for (auto& kvp : receCounts) {
+        std::string msg = "done";
+        ASSERT_GT(server.Send(kvp.first, msg.c_str(), msg.size()), 0);
+    }
+    for (size_t i = 0; i < clients.size(); i++) {
+        std::vector<TextMessage> msgs;
+        clients[i].WaitAvailable();
+        clients[i].Receive(msgs);
+        ASSERT_EQ(msgs.size(), 1);
+        ASSERT_EQ(msgs[0].data, "done");
+    }
+    server.Close();
+}
+
+// 多个客户端在各自的线程里同时发送,返回服务器收到的消息条数
+static size_t ReceiveFromSenders(int port, int ioThreadCount, size_t clientCount, int msgCount)
+{
+    TCPServer server("server", "127.0.0.1", port);
+    server.Start(ioThreadCount);
+    server.WaitStarted();
+
+    std::vector<TCPClient> clients;
+    clients.resize(clientCount);
+    for (size_t i = 0; i < clients.size(); i++) {
+        clients[i].Connect("127.0.0.1", port);
+    }
+    if (!PumpUntilAccepted(server, clients)) {
+        return 0;
+    }
+
+    std::string msg(128, 'a');
+    std::vector<std::thread> senders;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < clients.size(); i++) {
+        TCPClient* client = &clients[i];
+        senders.push_back(std::thread([client, &msg, msgCount, start]() {
+            for (int j = 0; j < msgCount; j++) {
+                client->Send(msg.c_str(), msg.size());
+            }
+            while (client->SendQueueSize() > 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(60)) {
+                client->Update();
+                this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }));
+    }
+
+    size_t total = 0;
+    size_t expect = clientCount * msgCount;
+    MessageBatch batch;
+    while (total < expect && std::chrono::steady_clock::now() - start < std::chrono::seconds(60)) {
+        total += server.Receive(batch, 10);
+    }
+    for (auto& sender : senders) {
+        sender.join();
+    }
+    server.Close();
+    return total;
+}
+
+// 多个客户端在各自的线程里同时发送很多消息,单线程和使用IO线程的时候都全部收到
+TEST(TCPServer, ioThreadsConcurrentSenders)
+{
+    ASSERT_EQ(ReceiveFromSenders(8358, 0, 8, 20000), (size_t)8 * 20000);
+    ASSERT_EQ(ReceiveFromSenders(8359, 4, 8, 20000), (size_t)8 * 20000);
+}
+
+class CloseThreadTarget
+{
+  public:
+    std::atomic_int count{0};
+    std::thread::id threadID;
+    void OnEventRemoteClose(const void* pSender, TCPEventRemoteClose& arg)
+    {
+        threadID = this_thread::get_id();
+        count++;
+    }
+};
+
+// IO线程发现的连接断开也在调用Receive()的线程里发出事件
+TEST(TCPServer, ioThreadsCloseEvent)
+{
+    TCPServer server("server", "127.0.0.1", 8360);
+    server.Start(2);
+    server.WaitStarted();
+
+    TCPClient client;
+    client.Connect("127.0.0.1", 8360);
+    ASSERT_TRUE(PumpUntilAccepted(server, client));
+
+    CloseThreadTarget target;
+    TCPClient* remote = server.GetRemotes()[client.TcpID()];
+    ASSERT_TRUE(remote != nullptr);
+    remote->EventRemoteClose() += Poco::delegate(&target, &CloseThreadTarget::OnEventRemoteClose);
+
+    client.Close();
+    auto start = std::chrono::steady_clock::now();
+    while (target.count == 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+        std::map<int, std::vector<TextMessage>> msgs;
+        server.Receive(msgs, 10);
+    }
+    ASSERT_EQ(target.count, 1);
+    ASSERT_EQ(target.threadID, this_thread::get_id());
+    ASSERT_TRUE(remote->isError());
+    server.Close();
+}
+
+// 单线程的时候对方关闭了连接也马上发出事件,之后这个连接不会再让Receive()立即返回
+TEST(TCPServer, closeEvent)
+{
+    TCPServer server("server", "127.0.0.1", 8363);
+    server.Start();
+    server.WaitStarted();
+
+    TCPClient client;
+    client.Connect("127.0.0.1", 8363);
+    ASSERT_TRUE(PumpUntilAccepted(server, client));
+
+    CloseThreadTarget target;
+    TCPClient* remote = server.GetRemotes()[client.TcpID()];
+    ASSERT_TRUE(remote != nullptr);
+    remote->EventRemoteClose() += Poco::delegate(&target, &CloseThreadTarget::OnEventRemoteClose);
+
+    client.Close();
+    auto start = std::chrono::steady_clock::now();
+    while (target.count == 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+        std::map<int, std::vector<TextMessage>> msgs;
+        server.Receive(msgs, 10);
+    }
+    ASSERT_EQ(target.count, 1);
+    ASSERT_EQ(target.threadID, this_thread::get_id());
+    ASSERT_TRUE(remote->isError());
+
+    // 没有就绪的socket了,Receive()阻塞到超时
+    for (int i = 0; i < 3; i++) {
+        std::map<int, std::vector<TextMessage>> msgs;
+        start = std::chrono::steady_clock::now();
+        server.Receive(msgs, 100);
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        ASSERT_GE(elapsed, 90);
+    }
+    ASSERT_EQ(target.count, 1);
+    server.Close();
+}
+
+TEST(TCPServer, acceptBatch)
+{
+    TCPServer server("server", "127.0.0.1", 8346);
+    TCPOptions options;
+    options.maxConnections = 64;
+    server.SetOptions(options);
+    server.Start();
+    server.WaitStarted();
+
+    // 先连接,服务器还没有执行accept,连接都在监听队列里
+    std::vector<TCPClient> clients;
+    clients.resize(70);
+    for (size_t i = 0; i < clients.size(); i++) {
+        clients[i].Connect("127.0.0.1", 8346);
+    }
+
+    // 一次Receive()就accept了所有的连接,超过maxConnections的被拒绝
+    std::map<int, std::vector<TextMessage>> msgs;
+    server.Receive(msgs, 100);
+    AcceptStats stats = server.GetAcceptStats();
+    ASSERT_EQ(stats.acceptedCount, 64);
+    ASSERT_EQ(stats.rejectedCount, 6);
+    ASSERT_EQ(stats.lastBatchCount, 64);
+    ASSERT_EQ(stats.pendingCount, 64);
+    ASSERT_TRUE(stats.backlogCount <= 0);
+
+    server.Close();
+}
+
+TEST(TCPServer, waitEvents)
+{
+    TCPServer server("server", "127.0.0.1", 8347);
+
+    // 在其它线程里启动,WaitStarted()在启动了之后立即返回
+    std::thread startThread([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        server.Start();
+    });
+    ASSERT_TRUE(server.WaitStarted());
+    startThread.join();
+
+    // 服务器在另一个线程里接收
+    std::atomic<bool> isRunning(true);
+    std::thread serverThread([&]() {
+        while (isRunning) {
+            std::map<int, std::vector<TextMessage>> msgs;
+            server.Receive(msgs, 10);
+            for (auto& kvp : msgs) {
+                for (auto& msg : kvp.second) {
+                    server.Send(kvp.first, msg.data.c_str(), msg.data.size());
+                }
+            }
+        }
+    });
+
+    TCPClient client;
+    client.Connect("127.0.0.1", 8347);
+    auto begin = std::chrono::steady_clock::now();
+    ASSERT_EQ(client.WaitAcceptedFor(5000), 1);
+
+    std::string msg = "hello";
+    client.Send(msg.c_str(), msg.size());
+    ASSERT_TRUE(client.WaitAvailableFor(5000) > 0);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    ASSERT_TRUE(elapsed < 1000); // 数据到达就返回,不会等到超时
+
+    std::vector<TextMessage> msgs;
+    client.Receive(msgs);
+    ASSERT_EQ(msgs.size(), 1);
+    ASSERT_EQ(msgs[0].data, msg);
+
+    // 没有数据的时候等到超时
+    ASSERT_EQ(client.WaitAvailableFor(50), 0);
+
+    // 弃用的WaitAvailable()的参数仍然是等待的次数,一次100ms
+    begin = std::chrono::steady_clock::now();
+    ASSERT_EQ(client.WaitAvailable(2), 0);
+    elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    ASSERT_TRUE(elapsed >= 150);
+
+    isRunning = false;
+    serverThread.join();
+    server.Close();
+}
+
+TEST(TCPClient, connectAsync)
+{
+    TCPServer server("server", "127.0.0.1", 8348);
+    server.Start();
+    server.WaitStarted();
+
+    // 一个线程里同时建立很多个连接
+    std::vector<TCPClient> clients;
+    clients.resize(32);
+    for (size_t i = 0; i < clients.size(); i++) {
+        ASSERT_EQ(clients[i].ConnectAsync("127.0.0.1", 8348), 0);
+    }
+
+    ASSERT_TRUE(PumpUntilAccepted(server, clients));
+    for (size_t i = 0; i < clients.size(); i++) {
+        ASSERT_FALSE(clients[i].isError());
+    }
+    ASSERT_EQ(server.RemoteCount(), 32);
+    server.Close();
+
+    // 连接不存在的服务器会失败
+    TCPClient client;
+    ASSERT_EQ(client.ConnectAsync("127.0.0.1", 8349, 1000), 0);
+    ASSERT_EQ(client.WaitAcceptedFor(2000), 0);
+    ASSERT_FALSE(client.IsConnecting());
+    ASSERT_TRUE(client.isError());
+}
+
+TEST(TCPServer, receiveBatch)
+{
+    TCPServer server("server", "127.0.0.1", 8350);
+    server.Start();
+    server.WaitStarted();
+
+    std::vector<TCPClient> clients;
+    clients.resize(4);
+    for (size_t i = 0; i < clients.size(); i++) {
+        clients[i].ConnectAsync("127.0.0.1", 8350);
+    }
+    ASSERT_TRUE(PumpUntilAccepted(server, clients));
+    MessageBatch batch;
+
+    // 同一个batch重复使用
+    for (int round = 0; round < 3; round++) {
+        for (size_t i = 0; i < clients.size(); i++) {
+            std::string msg = "round" + std::to_string(round) + "client" + std::to_string(i);
+            clients[i].Send(msg.c_str(), msg.size(), round);
+        }
+        std::map<int, int> counts;
+        auto start = std::chrono::steady_clock::now();
+        while (counts.size() < clients.size() && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+            server.Receive(batch, 100);
+            for (size_t i = 0; i < batch.Size(); i++) {
+                MessageView view = batch.View(i);
+                ASSERT_EQ(view.type, round);
+                ASSERT_EQ(view.to_string().substr(0, 6), "round" + std::to_string(round));
+                counts[batch.TcpID(i)]++;
+            }
+        }
+        ASSERT_EQ(counts.size(), clients.size());
+        for (auto& kvp : counts) {
+            ASSERT_EQ(kvp.second, 1);
+        }
+    }
+    server.Close();
+}
+
+TEST(TCPClient, resetLazyUUID)
+{
+    TCPClient client;
+    // uuid第一次使用的时候才生成,之后不变
+    std::string uuid = client.UUID();
+    ASSERT_FALSE(uuid.empty());
+    ASSERT_EQ(client.UUID(), uuid);
+
+    // 重置之后会重新生成
+    client.Reset();
+    ASSERT_FALSE(client.IsAccepted());
+    ASSERT_NE(client.UUID(), uuid);
+}
+
+TEST(TCPServer, memoryUsage)
+{
+    TCPServer server("server", "127.0.0.1", 8351);
+    server.Start();
+    server.WaitStarted();
+
+    TCPClient client;
+    client.Connect("127.0.0.1", 8351);
+    std::map<int, std::vector<MessageView>> msgs;
+    ASSERT_TRUE(PumpUntilAccepted(server, client));
+    int tcpID = client.TcpID();
+    size_t idleUsage = server.MemoryUsage(tcpID);
+    ASSERT_GT(idleUsage, 0);
+
+    // 一条比接收缓存大的消息,没有接收完整的时候连接占用着借来的接收缓存.
+    // 接收完整之后消息视图还指向它,下一次从这个连接接收的时候才还回去
+    std::string msg(200000, 'a');
+    client.Send(msg.c_str(), msg.size(), 1);
+    size_t receLen = 0;
+    size_t pendingUsage = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (receLen < msg.size() && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+        server.Receive(msgs, 100);
+        for (auto& view : msgs[tcpID]) {
+            ASSERT_EQ(view.type, 1);
+            receLen += view.len;
+        }
+        if (receLen == 0) {
+            pendingUsage = std::max(pendingUsage, server.MemoryUsage(tcpID));
+        }
+        client.Update(); // socket发送缓存放不下的部分在发送队列里
+    }
+    ASSERT_EQ(receLen, msg.size());
+
+    std::string small = "small";
+    client.Send(small.c_str(), small.size(), 2);
+    bool isReceived = false;
+    start = std::chrono::steady_clock::now();
+    while (!isReceived && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+        server.Receive(msgs, 100);
+        isReceived = !msgs[tcpID].empty();
+    }
+    ASSERT_TRUE(isReceived);
+    size_t doneUsage = server.MemoryUsage(tcpID);
+    ASSERT_GT(pendingUsage, doneUsage + msg.size() / 2);
+    ASSERT_EQ(server.MemoryUsage(tcpID + 1), 0);
+    server.Close();
+}
+
+TEST(TCPServer, bufferOptions)
+{
+    TCPServer server("server", "127.0.0.1", 8352);
+    TCPOptions serverOptions = server.Options();
+    serverOptions.socketReceiveBufferSize = 16 * 1024;
+    serverOptions.receiveBufferSize = 32 * 1024;
+    serverOptions.autoTuneBuffer = true;
+    server.SetOptions(serverOptions);
+    server.Start();
+    server.WaitStarted();
+
+    // 客户端使用系统默认的socket缓存
+    TCPClient client;
+    TCPOptions options = client.Options();
+    options.socketReceiveBufferSize = 0;
+    options.socketSendBufferSize = 0;
+    options.receiveTimeoutMs = 1000;
+    client.SetOptions(options);
+    client.Connect("127.0.0.1", 8352);
+    std::map<int, std::vector<BinMessage>> msgs;
+    ASSERT_TRUE(PumpUntilAccepted(server, client));
+    int tcpID = client.TcpID();
+
+    // 服务端的连接继承了监听socket的缓存大小(linux上读到的是设置值的两倍)
+    Poco::Net::StreamSocket* socket = (Poco::Net::StreamSocket*)server.GetClientSocket(tcpID);
+    int receBufSize = socket->getReceiveBufferSize();
+    ASSERT_TRUE(receBufSize >= 16 * 1024 && receBufSize <= 2 * 16 * 1024);
+
+    // 大量的数据都能完整的收到,持续发送直到自动调整扩大了接收缓存
+    std::string msg(100 * 1024, 'b');
+    int sendCount = 0;
+    int receCount = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+        // 发送队列积压得不多的时候才继续发送
+        while (client.SendQueueSize() < 1024 * 1024 && (sendCount < 20 || socket->getReceiveBufferSize() <= receBufSize)) {
+            ASSERT_TRUE(client.Send(msg.c_str(), msg.size(), sendCount % 20) > 0);
+            sendCount++;
+        }
+        server.Receive(msgs, 10);
+        for (auto& m : msgs[tcpID]) {
+            ASSERT_EQ(m.type, receCount % 20);
+            ASSERT_EQ(m.data.size(), msg.size());
+            receCount++;
+        }
+        client.Update();
+        if (receCount == sendCount && sendCount >= 20 && socket->getReceiveBufferSize() > receBufSize) {
+            break;
+        }
+    }
+    ASSERT_EQ(receCount, sendCount);
+    ASSERT_TRUE(socket->getReceiveBufferSize() > receBufSize);
+    ASSERT_EQ(server.Options().receiveBufferSize, 32 * 1024);
+    server.Close();
+}
+
+TEST(TCPServer, handshakeTimeout)
+{
+    TCPServer server("server", "127.0.0.1", 8353);
+    TCPOptions options = server.Options();
+    options.handshakeTimeoutMs = 200;
+    server.SetOptions(options);
+    server.Start();
+    server.WaitStarted();
+
+    // 只连接不握手的socket会被服务器关闭
+    StreamSocket socket;
+    socket.connect(SocketAddress("127.0.0.1", 8353));
+    std::map<int, std::vector<MessageView>> msgs;
+    server.Receive(msgs, 100);
+    ASSERT_EQ(server.GetAcceptStats().pendingCount, 1);
+
+    // 正常握手的客户端不受影响
+    TCPClient client;
+    client.Connect("127.0.0.1", 8353);
+    ASSERT_TRUE(PumpUntilAccepted(server, client));
+
+    auto start = std::chrono::steady_clock::now();
+    while (server.GetAcceptStats().pendingCount > 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+        server.Receive(msgs, 10);
+    }
+    ASSERT_EQ(server.GetAcceptStats().pendingCount, 0);
+    ASSERT_TRUE(client.IsAccepted());
+    ASSERT_GT(server.MemoryUsage(client.TcpID()), 0);
+    server.Close();
+}
+
+TEST(TCPServer, broadcast)
+{
+    TCPServer server("server", "127.0.0.1", 8354);
+    server.Start();
+    server.WaitStarted();
+
+    std::vector<TCPClient> clients(3);
+    std::map<int, std::vector<MessageView>> msgs;
+    for (auto& client : clients) {
+        client.Connect("127.0.0.1", 8354);
+        ASSERT_TRUE(PumpUntilAccepted(server, client));
+    }
+
+    // 不发送给第一个客户端
+    int excludeID = clients[0].TcpID();
+    std::string data(200 * 1024, 'c');
+    for (int i = 0; i < 10; i++) {
+        int count = server.Broadcast(data.c_str(), data.size(), i, [excludeID](int tcpID) { return tcpID != excludeID; });
+        ASSERT_EQ(count, 2);
+    }
+
+    std::vector<int> receCounts(clients.size(), 0);
+    auto start = std::chrono::steady_clock::now();
+    while ((receCounts[1] < 10 || receCounts[2] < 10) && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+        server.Receive(msgs, 1); // 继续发送发送队列里的数据
+        for (size_t i = 0; i < clients.size(); i++) {
+            std::vector<BinMessage> clientMsgs;
+            clients[i].Receive(clientMsgs);
+            for (auto& msg : clientMsgs) {
+                ASSERT_EQ(msg.type, receCounts[i]);
+                ASSERT_EQ(msg.data.size(), data.size());
+                receCounts[i]++;
+            }
+        }
+    }
+    ASSERT_EQ(receCounts[0], 0);
+    ASSERT_EQ(receCounts[1], 10);
+    ASSERT_EQ(receCounts[2], 10);
+    server.Close();
+}
+
+TEST(TCPServer, kcpBroadcast)
+{
+    TCPServer server("server", "127.0.0.1", 8361);
+    server.Start();
+    server.WaitStarted();
+
+    std::vector<TCPClient> clients(3);
+    std::map<int, std::vector<MessageView>> msgs;
+    for (auto& client : clients) {
+        client.Connect("127.0.0.1", 8361);
+        ASSERT_TRUE(PumpUntilAccepted(server, client));
+    }
+
+    // 不发送给第一个客户端
+    int excludeID = clients[0].TcpID();
+    std::string data(500, 'k');
+    for (int i = 0; i < 10; i++) {
+        int count = server.KCPBroadcast(data.c_str(), data.size(), i, [excludeID](int tcpID) { return tcpID != excludeID; });
+        ASSERT_EQ(count, 2);
+    }
+
+    std::map<int, TCPClient*> remotes = server.GetRemotes();
+    std::vector<int> receCounts(clients.size(), 0);
+    auto start = std::chrono::steady_clock::now();
+    while ((receCounts[1] < 10 || receCounts[2] < 10) && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+        // kcp只在发送的时候update,这里驱动两端的kcp把数据和ack发出去
+        for (auto& kvp : remotes) {
+            ((KCPChannel*)kvp.second->GetKCPClient())->Update();
+        }
+        std::map<int, std::vector<TextMessage>> smsgs;
+        server.KCPReceive(smsgs);
+        for (size_t i = 0; i < clients.size(); i++) {
+            ((KCPChannel*)clients[i].GetKCPClient())->Update();
+            std::vector<TextMessage> clientMsgs;
+            clients[i].KCPReceive(clientMsgs);
+            for (auto& msg : clientMsgs) {
+                ASSERT_EQ(msg.type, receCounts[i]);
+                ASSERT_EQ(msg.data, data);
+                receCounts[i]++;
+            }
+        }
+        this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQ(receCounts[0], 0);
+    ASSERT_EQ(receCounts[1], 10);
+    ASSERT_EQ(receCounts[2], 10);
+    server.Close();
+}
+
+TEST(TCPServer, groupSend)
+{
+    TCPServer server("server", "127.0.0.1", 8355);
+    server.Start();
+    server.WaitStarted();
+
+    std::vector<TCPClient> clients(3);
+    std::map<int, std::vector<MessageView>> msgs;
+    for (auto& client : clients) {
+        client.Connect("127.0.0.1", 8355);
+        ASSERT_TRUE(PumpUntilAccepted(server, client));
+    }
+
+    int room = server.CreateGroup();
+    ASSERT_TRUE(server.JoinGroup(room, clients[0].TcpID()));
+    ASSERT_TRUE(server.JoinGroup(room, clients[2].TcpID()));
+    ASSERT_FALSE(server.JoinGroup(room, clients[2].TcpID()));
+    ASSERT_FALSE(server.JoinGroup(room + 1, clients[1].TcpID()));
+    ASSERT_EQ(server.GroupMembers(room).size(), 2);
+
+    std::string data = "room message";
+    ASSERT_EQ(server.GroupSend(room, data.c_str(), data.size(), 3), 2);
+
+    std::vector<int> receCounts(clients.size(), 0);
+    auto start = std::chrono::steady_clock::now();
+    while ((receCounts[0] < 1 || receCounts[2] < 1) && std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+        server.Receive(msgs, 1);
+        for (size_t i = 0; i < clients.size(); i++) {
+            std::vector<BinMessage> clientMsgs;
+            clients[i].Receive(clientMsgs);
+            for (auto& msg : clientMsgs) {
+                ASSERT_EQ(msg.type, 3);
+                ASSERT_EQ(std::string(msg.data.begin(), msg.data.end()), data);
+                receCounts[i]++;
+            }
+        }
+    }
+    ASSERT_EQ(receCounts[0], 1);
+    ASSERT_EQ(receCounts[1], 0);
+    ASSERT_EQ(receCounts[2], 1);
+
+    ASSERT_TRUE(server.LeaveGroup(room, clients[0].TcpID()));
+    ASSERT_EQ(server.GroupMembers(room).size(), 1);
+    ASSERT_TRUE(server.RemoveGroup(room));
+    ASSERT_EQ(server.GroupSend(room, data.c_str(), data.size(), 3), -1);
+    server.Close();
+}
+
+TEST(TCPServer, groupKCPSend)
+{
+    TCPServer server("server", "127.0.0.1", 8362);
+    server.Start();
+    server.WaitStarted();
+
+    std::vector<TCPClient> clients(3);
+    std::map<int, std::vector<MessageView>> msgs;
+    for (auto& client : clients) {
+        client.Connect("127.0.0.1", 8362);
+        ASSERT_TRUE(PumpUntilAccepted(server, client));
+    }
+
+    int room = server.CreateGroup();
+    ASSERT_TRUE(server.JoinGroup(room, clients[0].TcpID()));
+    ASSERT_TRUE(server.JoinGroup(room, clients[2].TcpID()));
+
+    std::string data = "room kcp message";
+    for (int i = 0; i < 5; i++) {
+        ASSERT_EQ(server.GroupKCPSend(room, data.c_str(), data.size(), i), 2);
+    }
+
+    std::map<int, TCPClient*> remotes = server.GetRemotes();
+    std::vector<int> receCounts(clients.size(), 0);
+    auto start = std::chrono::steady_clock::now();
+    while ((receCounts[0] < 5 || receCounts[2] < 5) && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+        // kcp只在发送的时候update,这里驱动两端的kcp把数据和ack发出去
+        for (auto& kvp : remotes) {
+            ((KCPChannel*)kvp.second->GetKCPClient())->Update();
+        }
+        std::map<int, std::vector<TextMessage>> smsgs;
+        server.KCPReceive(smsgs);
+        for (size_t i = 0; i < clients.size(); i++) {
+            ((KCPChannel*)clients[i].GetKCPClient())->Update();
+            std::vector<TextMessage> clientMsgs;
+            clients[i].KCPReceive(clientMsgs);
+            for (auto& msg : clientMsgs) {
+                ASSERT_EQ(msg.type, receCounts[i]);
+                ASSERT_EQ(msg.data, data);
+                receCounts[i]++;
+            }
+        }
+        this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQ(receCounts[0], 5);
+    ASSERT_EQ(receCounts[1], 0);
+    ASSERT_EQ(receCounts[2], 5);
+
+    ASSERT_TRUE(server.RemoveGroup(room));
+    ASSERT_EQ(server.GroupKCPSend(room, data.c_str(), data.size(), 0), -1);
+    server.Close();
+}
+
+TEST(TCPServer, crossThreadPost)
+{
+    TCPServer server("server", "127.0.0.1", 8356);
+    server.Start();
+    server.WaitStarted();
+
+    TCPClient client;
+    std::map<int, std::vector<MessageView>> msgs;
+    client.Connect("127.0.0.1", 8356);
+    ASSERT_TRUE(PumpUntilAccepted(server, client));
+
+    // 几个工作线程同时投递,由调用Receive()的线程发送
+    const int threadCount = 4;
+    const int postCount = 1000;
+    int tcpID = client.TcpID();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; t++) {
+        threads.push_back(std::thread([&server, &client, tcpID, t]() {
+            std::string data = "post" + std::to_string(t);
+            for (int i = 0; i < postCount; i++) {
+                server.Post(tcpID, data.c_str(), data.size(), 1);
+                client.Post(data.c_str(), data.size(), 2);
+            }
+        }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    int clientReceCount = 0;
+    int serverReceCount = 0;
+    auto start = std::chrono::steady_clock::now();
+    while ((clientReceCount < threadCount * postCount || serverReceCount < threadCount * postCount) &&
+           std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+        server.Receive(msgs, 1);
+        for (auto& kvp : msgs) {
+            for (auto& msg : kvp.second) {
+                ASSERT_EQ(msg.type, 2);
+                serverReceCount++;
+            }
+        }
+        std::vector<BinMessage> clientMsgs;
+        client.Receive(clientMsgs);
+        for (auto& msg : clientMsgs) {
+            ASSERT_EQ(msg.type, 1);
+            clientReceCount++;
+        }
+    }
+    ASSERT_EQ(clientReceCount, threadCount * postCount);
+    ASSERT_EQ(serverReceCount, threadCount * postCount);
+    ASSERT_EQ(server.PostQueueSize(), 0);
+    ASSERT_EQ(client.PostQueueSize(), 0);
+    server.Close();
+}
+
+TEST(TCPServer, sendPriority)
+{
+    TCPServer server("server", "127.0.0.1", 8357);
+    server.Start();
+    server.WaitStarted();
+
+    TCPClient client;
+    client.Connect("127.0.0.1", 8357);
+    ASSERT_TRUE(PumpUntilAccepted(server, client));
+
+    // 大块的数据积压在发送队列里,之后发送的高优先级的小消息在帧的边界上插到它们前面
+    int tcpId = client.TcpID();
+    std::vector<char> data(1024 * 1024, 'a');
+    for (int i = 0; i < 16; i++) {
+        // 返回打包之后的长度,协议头的长度和协商的协议有关
+        ASSERT_GT(server.Send(tcpId, data.data(), data.size(), 1, DNET_SEND_PRIORITY_LOW), (int)data.size());
+    }
+    std::string event = "player died";
+    ASSERT_GT(server.Send(tcpId, event.c_str(), event.size(), 2, DNET_SEND_PRIORITY_HIGH), 0);
+
+    int receCount = 0;
+    int eventIndex = -1;
+    auto start = std::chrono::steady_clock::now();
+    while (receCount < 17 && std::chrono::steady_clock::now() - start < std::chrono::seconds(20)) {
+        std::map<int, std::vector<BinMessage>> serverMsgs;
+        server.Receive(serverMsgs); // 继续发送发送队列里的数据
+
+        std::vector<BinMessage> msgs;
+        client.WaitAvailableFor(100);
+        client.Receive(msgs);
+        for (auto& msg : msgs) {
+            if (msg.type == 2) {
+                ASSERT_EQ(std::string(msg.data.begin(), msg.data.end()), event);
+                eventIndex = receCount;
+            }
+            else {
+                ASSERT_TRUE(msg.data == data);
+            }
+            receCount++;
+        }
+    }
+    ASSERT_EQ(receCount, 17);
+    ASSERT_GE(eventIndex, 0);
+    ASSERT_LT(eventIndex, 16);
+    ASSERT_EQ(server.SendQueueSize(tcpId), 0);
+
+    server.Close();
+}
@@ -0,0 +1,89 @@
+﻿#include "gtest/gtest.h"
+
+#include "DNET/TCP/TimerWheel.h"
+
+#include <map>
+
+using namespace dnet;
+using namespace std;
+
+TEST(TimerWheel, expireInOrder)
+{
+    TimerWheel wheel(10);
+    wheel.Reset(1000);
+    vector<TimerWheel::Timer> expired;
+
+    wheel.Add(1050, 1, 0);
+    wheel.Add(1020, 2, 0);
+    wheel.Add(900, 3, 0); // 已经过了的时间在下一个tick到期
+    ASSERT_EQ(wheel.Size(), 3);
+
+    ASSERT_EQ(wheel.Advance(1005, expired), 0);
+    ASSERT_EQ(wheel.Advance(1010, expired), 1);
+    ASSERT_EQ(expired[0].id, 3);
+    ASSERT_EQ(wheel.Advance(1040, expired), 1);
+    ASSERT_EQ(expired[0].id, 2);
+    ASSERT_EQ(wheel.Advance(1100, expired), 1);
+    ASSERT_EQ(expired[0].id, 1);
+    ASSERT_EQ(wheel.Size(), 0);
+}
+
+TEST(TimerWheel, cascadeLevels)
+{
+    TimerWheel wheel(1);
+    wheel.Reset(0);
+    vector<TimerWheel::Timer> expired;
+
+    // 分布在各层的定时器,每一个都在它自己的时间到期,不会提前也不会推迟
+    map<int64_t, int> expect;
+    int64_t times[] = {1, 63, 64, 65, 4095, 4096, 4097, 100000, 262143, 262144, 1000000, 16000000};
+    for (int i = 0; i < (int)(sizeof(times) / sizeof(times[0])); i++) {
+        wheel.Add(times[i], i, i % 3);
+        expect[times[i]] = i;
+    }
+
+    int64_t now = 0;
+    for (auto& kvp : expect) {
+        if (kvp.first - 1 > now) {
+            ASSERT_EQ(wheel.Advance(kvp.first - 1, expired), 0);
+        }
+        ASSERT_EQ(wheel.Advance(kvp.first, expired), 1);
+        ASSERT_EQ(expired[0].id, kvp.second);
+        ASSERT_EQ(expired[0].type, kvp.second % 3);
+        now = kvp.first;
+    }
+    ASSERT_EQ(wheel.Size(), 0);
+}
+
+TEST(TimerWheel, manyTimers)
+{
+    TimerWheel wheel(10);
+    wheel.Reset(0);
+    vector<TimerWheel::Timer> expired;
+
+    for (int i = 0; i < 10000; i++) {
+        wheel.Add(i * 7 % 60000 + 10, i, 0);
+    }
+
+    // 跳着前进,所有的定时器都到期并且每个只到期一次
+    vector<int> count(10000, 0);
+    int total = 0;
+    for (int64_t now = 0; now <= 60010; now += 333) {
+        wheel.Advance(now, expired);
+        for (auto& timer : expired) {
+            ASSERT_LE((int64_t)timer.expire * 10, now);
+            count[timer.id]++;
+        }
+        total += (int)expired.size();
+    }
+    wheel.Advance(60010, expired);
+    total += (int)expired.size();
+    for (auto& timer : expired) {
+        count[timer.id]++;
+    }
+    ASSERT_EQ(total, 10000);
+    for (int c : count) {
+        ASSERT_EQ(c, 1);
+    }
+    ASSERT_EQ(wheel.Size(), 0);
+}